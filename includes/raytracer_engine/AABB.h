@@ -1,5 +1,7 @@
 #pragma once
 
+#include <algorithm>
+
 #include "Vec3.h"
 #include "Ray.h"
 
@@ -87,88 +89,44 @@ namespace LaplataRayTracer
 			return AABB(vSmall, vBig);
 		}
 
+		// The per-axis entry and exit distances come from the ray's cached reciprocal direction,
+		// the sign bits pick the near and the far slab, so there is no division and no branch per axis.
 		inline bool HitTestImpl(Ray const& inRay, float& txmin, float& tymin, float& tzmin, float& txmax, float& tymax, float& tzmax, float& t0) const
 		{
 			//
-			float ox = inRay.O().X();
-			float oy = inRay.O().Y();
-			float oz = inRay.O().Z();
-
-			float dx = inRay.D().X();
-			float dy = inRay.D().Y();
-			float dz = inRay.D().Z();
+			Vec3f const& o = inRay.O();
+			Vec3f const& inv_d = inRay.InvD();
 
-		//	float tx_min, ty_min, tz_min;
-		//	float tx_max, ty_max, tz_max;
+			const float xs[2] = { mX0, mX1 };
+			const float ys[2] = { mY0, mY1 };
+			const float zs[2] = { mZ0, mZ1 };
 
-			//
-			float a = 1.0f / dx;
-			if (a >= 0)
-			{
-				txmin = (mX0 - ox) * a;
-				txmax = (mX1 - ox) * a;
-			}
-			else
-			{
-				txmin = (mX1 - ox) * a;
-				txmax = (mX0 - ox) * a;
-			}
-
-			float b = 1.0f / dy;
-			if (b >= 0)
-			{
-				tymin = (mY0 - oy) * b;
-				tymax = (mY1 - oy) * b;
-			}
-			else
-			{
-				tymin = (mY1 - oy) * b;
-				tymax = (mY0 - oy) * b;
-			}
-
-			float c = 1.0f / dz;
-			if (c >= 0)
-			{
-				tzmin = (mZ0 - oz) * c;
-				tzmax = (mZ1 - oz) * c;
-			}
-			else {
-				tzmin = (mZ1 - oz) * c;
-				tzmax = (mZ0 - oz) * c;
-			}
+			txmin = (xs[inRay.Sign(0)] - o.X()) * inv_d.X();
+			txmax = (xs[1 - inRay.Sign(0)] - o.X()) * inv_d.X();
+			tymin = (ys[inRay.Sign(1)] - o.Y()) * inv_d.Y();
+			tymax = (ys[1 - inRay.Sign(1)] - o.Y()) * inv_d.Y();
+			tzmin = (zs[inRay.Sign(2)] - o.Z()) * inv_d.Z();
+			tzmax = (zs[1 - inRay.Sign(2)] - o.Z()) * inv_d.Z();
 
 			//
-			float t1;
-
-			if (txmin > tymin)
-			{
-				t0 = txmin;
-			}
-			else
-			{
-				t0 = tymin;
-			}
-			if (tzmin > t0)
-			{
-				t0 = tzmin;
-			}
-
-			if (txmax < tymax)
-			{
-				t1 = txmax;
-			}
-			else
-			{
-				t1 = tymax;
-			}
-			if (tzmax < t1)
-			{
-				t1 = tzmax;
-			}
+			t0 = std::max<float>(std::max<float>(txmin, tymin), tzmin);
+			float t1 = std::min<float>(std::min<float>(txmax, tymax), tzmax);
 
 			return (t0 < t1 && t1 > KEpsilon());
 		}
 
+		// The slab test clipped to [tmin, tmax], tnear is the entry distance.
+		inline bool HitTestSlab(Ray const& inRay, float tmin, float tmax, float& tnear) const
+		{
+			float tx_min, ty_min, tz_min, tx_max, ty_max, tz_max;
+			float t0;
+			this->HitTestImpl(inRay, tx_min, ty_min, tz_min, tx_max, ty_max, tz_max, t0);
+
+			tnear = std::max<float>(t0, tmin);
+			float t1 = std::min<float>(std::min<float>(std::min<float>(tx_max, ty_max), tz_max), tmax);
+			return (tnear <= t1);
+		}
+
 	public:
 		inline static float KEpsilon() { return 0.001f; }
 
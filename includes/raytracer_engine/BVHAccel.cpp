@@ -0,0 +1,813 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "Utility.h"
+#include "BVHAccel.h"
+
+namespace LaplataRayTracer
+{
+	//
+	inline static AABB empty_box() {
+		return AABB(FLT_MAX, -FLT_MAX, FLT_MAX, -FLT_MAX, FLT_MAX, -FLT_MAX);
+	}
+
+	inline static void grow_box(AABB& box, AABB const& other) {
+		box.mX0 = std::min<float>(box.mX0, other.mX0); box.mX1 = std::max<float>(box.mX1, other.mX1);
+		box.mY0 = std::min<float>(box.mY0, other.mY0); box.mY1 = std::max<float>(box.mY1, other.mY1);
+		box.mZ0 = std::min<float>(box.mZ0, other.mZ0); box.mZ1 = std::max<float>(box.mZ1, other.mZ1);
+	}
+
+	inline static void grow_box(AABB& box, Vec3f const& pt) {
+		box.mX0 = std::min<float>(box.mX0, pt.X()); box.mX1 = std::max<float>(box.mX1, pt.X());
+		box.mY0 = std::min<float>(box.mY0, pt.Y()); box.mY1 = std::max<float>(box.mY1, pt.Y());
+		box.mZ0 = std::min<float>(box.mZ0, pt.Z()); box.mZ1 = std::max<float>(box.mZ1, pt.Z());
+	}
+
+	inline static float box_min(AABB const& box, int axis) { return (axis == 0) ? box.mX0 : ((axis == 1) ? box.mY0 : box.mZ0); }
+	inline static float box_max(AABB const& box, int axis) { return (axis == 0) ? box.mX1 : ((axis == 1) ? box.mY1 : box.mZ1); }
+
+	inline static AABB node_box(BVHNode const& node) {
+		return AABB(node.mBounds[0], node.mBounds[1], node.mBounds[2], node.mBounds[3], node.mBounds[4], node.mBounds[5]);
+	}
+
+	//
+	thread_local NodeCacheCounter *BVHTree::mpNodeCacheCounter = nullptr;
+
+	//
+	BVHTree::BVHTree() {
+		mnMaxLeafPrims = 4;
+		mnPrimBlockWidth = 1;
+		mBuildMode = BVH_BUILD_BINNED_SAH;
+		mnBuildThreads = 0;
+		mfBuildTime = 0.0f;
+		mfBuildSAHCost = 0.0f;
+		mfMotionTime0 = 0.0f;
+		mfMotionInvDuration = 0.0f;
+	}
+
+	BVHTree::~BVHTree() {
+		Clear();
+	}
+
+	//
+	void BVHTree::Build(vector<AABB> const& primBounds, int maxLeafPrims, int primBlockWidth) {
+		Clear();
+
+		int prim_count = (int)primBounds.size();
+		if (prim_count == 0) {
+			return;
+		}
+
+		std::chrono::high_resolution_clock::time_point start_time = std::chrono::high_resolution_clock::now();
+
+		mnMaxLeafPrims = RTMath::Clamp(maxLeafPrims, 1, BVHTree::MAX_LEAF_PRIMS);
+		mnPrimBlockWidth = RTMath::Clamp(primBlockWidth, 1, mnMaxLeafPrims);
+
+		vector<BuildPrim> build_prims;
+		build_prims.reserve(prim_count);
+		for (int i = 0; i < prim_count; ++i) {
+			BuildPrim prim;
+			prim.box = primBounds[i];
+			prim.centroid.Set(0.5f * (prim.box.mX0 + prim.box.mX1),
+				0.5f * (prim.box.mY0 + prim.box.mY1),
+				0.5f * (prim.box.mZ0 + prim.box.mZ1));
+			prim.index = i;
+			build_prims.push_back(prim);
+		}
+
+		// a binary tree with n leaves has 2n-1 nodes at most.
+		mvecNodes.reserve(2 * prim_count - 1);
+		mvecPrimIndices.reserve(prim_count);
+
+		if (mBuildMode == BVH_BUILD_BINNED_SAH) {
+			build_binned(build_prims);
+		}
+		else if (mBuildMode == BVH_BUILD_LBVH) {
+			build_lbvh(build_prims);
+		}
+		else {
+			build_recursive(build_prims, 0, prim_count, 0);
+		}
+
+		std::chrono::duration<float> build_time = std::chrono::high_resolution_clock::now() - start_time;
+		mfBuildTime = build_time.count();
+
+		// the reference of the refits.
+		mfBuildSAHCost = SAHCost();
+	}
+
+	float BVHTree::Refit(vector<AABB> const& primBounds) {
+		if (mvecNodes.empty()) {
+			return 1.0f;
+		}
+
+		vector<AABB> node_bounds;
+		if (!fit_node_bounds(primBounds, node_bounds)) {
+			// not the primitives it was built upon, only a rebuild helps.
+			return FLT_MAX;
+		}
+
+		int node_count = (int)mvecNodes.size();
+		for (int i = 0; i < node_count; ++i) {
+			fill_node_bounds(mvecNodes[i], node_bounds[i]);
+		}
+		vector<BVHMotionBounds>().swap(mvecMotionBounds);
+
+		if (mfBuildSAHCost <= 0.0f) {
+			return 1.0f;
+		}
+
+		return SAHCost() / mfBuildSAHCost;
+	}
+
+	void BVHTree::SetMotionBounds(vector<AABB> const& primBounds0, vector<AABB> const& primBounds1, float time0, float time1) {
+		vector<AABB> node_bounds0, node_bounds1;
+		if (!fit_node_bounds(primBounds0, node_bounds0) || !fit_node_bounds(primBounds1, node_bounds1) || time1 <= time0) {
+			vector<BVHMotionBounds>().swap(mvecMotionBounds);
+			return;
+		}
+
+		int node_count = (int)mvecNodes.size();
+		mvecMotionBounds.resize(node_count);
+		for (int i = 0; i < node_count; ++i) {
+			AABB const& box0 = node_bounds0[i];
+			AABB const& box1 = node_bounds1[i];
+			float bounds0[6] = { box0.mX0, box0.mX1, box0.mY0, box0.mY1, box0.mZ0, box0.mZ1 };
+			float bounds1[6] = { box1.mX0, box1.mX1, box1.mY0, box1.mY1, box1.mZ0, box1.mZ1 };
+			for (int k = 0; k < 6; ++k) {
+				mvecMotionBounds[i].mBounds0[k] = bounds0[k];
+				mvecMotionBounds[i].mBounds1[k] = bounds1[k];
+			}
+		}
+
+		mfMotionTime0 = time0;
+		mfMotionInvDuration = 1.0f / (time1 - time0);
+	}
+
+	bool BVHTree::fit_node_bounds(vector<AABB> const& primBounds, vector<AABB>& nodeBounds) const {
+		if (mvecNodes.empty()) {
+			return false;
+		}
+
+		// the last node in the depth-first order is the last leaf, it ends the leaf slots.
+		bool has_indices = !mvecPrimIndices.empty();
+		int prim_count = has_indices ? (int)mvecPrimIndices.size() : (mvecNodes.back().mnOffset + mvecNodes.back().mnCount);
+		if ((int)primBounds.size() < prim_count) {
+			return false;
+		}
+
+		// the children are always after their parent in the depth-first array, so walking it backward
+		// visits the children first.
+		nodeBounds.resize(mvecNodes.size());
+		for (int i = (int)mvecNodes.size() - 1; i >= 0; --i) {
+			BVHNode const& node = mvecNodes[i];
+
+			AABB box = empty_box();
+			if (node.IsLeaf()) {
+				for (int k = node.mnOffset; k < node.mnOffset + node.mnCount; ++k) {
+					grow_box(box, primBounds[has_indices ? mvecPrimIndices[k] : k]);
+				}
+			}
+			else {
+				grow_box(box, nodeBounds[i + 1]);
+				grow_box(box, nodeBounds[node.mnOffset]);
+			}
+
+			nodeBounds[i] = box;
+		}
+
+		return true;
+	}
+
+	void BVHTree::SetBuildMode(EBVHBuildMode mode, int threadCount) {
+		mBuildMode = mode;
+		mnBuildThreads = std::max<int>(threadCount, 0);
+	}
+
+	int BVHTree::thread_count() const {
+		int thread_count = (mnBuildThreads > 0) ? mnBuildThreads : (int)std::thread::hardware_concurrency();
+		return std::max<int>(thread_count, 1);
+	}
+
+	void BVHTree::Clear() {
+		mvecNodes.clear();
+		mvecPrimIndices.clear();
+		mvecMotionBounds.clear();
+	}
+
+	float BVHTree::SAHCost() const {
+		if (mvecNodes.empty()) {
+			return 0.0f;
+		}
+
+		float root_area = BVHTree::SurfaceArea(this->RootBounds());
+		if (root_area <= 0.0f) {
+			return 0.0f;
+		}
+
+		float cost = 0.0f;
+		int node_count = (int)mvecNodes.size();
+		for (int i = 0; i < node_count; ++i) {
+			BVHNode const& node = mvecNodes[i];
+			float area_ratio = BVHTree::SurfaceArea(node_box(node)) / root_area;
+			if (node.IsLeaf()) {
+				cost += area_ratio * leaf_cost(node.mnCount);
+			}
+			else {
+				cost += area_ratio * BVHTree::TraversalCost();
+			}
+		}
+
+		return cost;
+	}
+
+	AABB BVHTree::RootBounds() const {
+		if (mvecNodes.empty()) {
+			return AABB(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+		}
+
+		BVHNode const& root = mvecNodes[0];
+		return node_box(root);
+	}
+
+	size_t BVHTree::MemoryUsage() const {
+		return sizeof(BVHTree) + mvecNodes.capacity() * sizeof(BVHNode) + mvecPrimIndices.capacity() * sizeof(int) +
+			mvecMotionBounds.capacity() * sizeof(BVHMotionBounds);
+	}
+
+	void BVHTree::ReleasePrimIndices() {
+		vector<int>().swap(mvecPrimIndices);
+	}
+
+	//
+	int BVHTree::build_recursive(vector<BuildPrim>& prims, int begin, int end, int depth) {
+		int node_index = (int)mvecNodes.size();
+		mvecNodes.push_back(BVHNode());
+
+		int count = end - begin;
+
+		// bounds of the node
+		AABB node_box = prims[begin].box;
+		for (int i = begin + 1; i < end; ++i) {
+			node_box = AABB::SurroundingBox(node_box, prims[i].box);
+		}
+		fill_node_bounds(mvecNodes[node_index], node_box);
+
+		// sweep along each axis to find the split with the minimum SAH cost.
+		int best_axis = -1;
+		int best_split = -1;
+		float best_cost = FLT_MAX;
+
+		if (count > 1 && depth < BVHTree::MAX_DEPTH - 1) {
+			vector<float> right_areas(count);
+
+			for (int axis = 0; axis < 3; ++axis) {
+				std::sort(prims.begin() + begin, prims.begin() + end,
+					[axis](BuildPrim const& a, BuildPrim const& b) { return a.centroid[axis] < b.centroid[axis]; });
+
+				AABB right_box = prims[end - 1].box;
+				right_areas[count - 1] = BVHTree::SurfaceArea(right_box);
+				for (int i = count - 2; i >= 1; --i) {
+					right_box = AABB::SurroundingBox(right_box, prims[begin + i].box);
+					right_areas[i] = BVHTree::SurfaceArea(right_box);
+				}
+
+				AABB left_box = prims[begin].box;
+				for (int i = 1; i < count; ++i) {
+					float cost = BVHTree::SurfaceArea(left_box) * leaf_cost(i) + right_areas[i] * leaf_cost(count - i);
+					if (cost < best_cost) {
+						best_cost = cost;
+						best_axis = axis;
+						best_split = i;
+					}
+					left_box = AABB::SurroundingBox(left_box, prims[begin + i].box);
+				}
+			}
+
+			float node_area = BVHTree::SurfaceArea(node_box);
+			best_cost = BVHTree::TraversalCost() + (node_area > 0.0f ? best_cost / node_area : leaf_cost(count));
+		}
+
+		// make a leaf if splitting won't pay off, but never let a leaf grow beyond the limit.
+		bool make_leaf = (best_axis < 0) || (count <= mnMaxLeafPrims && best_cost >= leaf_cost(count));
+		if (make_leaf) {
+			BVHNode& node = mvecNodes[node_index];
+			node.mnOffset = (int)mvecPrimIndices.size();
+			node.mnCount = (unsigned short)count;
+			node.mnAxis = 0;
+			for (int i = begin; i < end; ++i) {
+				mvecPrimIndices.push_back(prims[i].index);
+			}
+
+			return node_index;
+		}
+
+		if (best_axis != 2) {
+			std::sort(prims.begin() + begin, prims.begin() + end,
+				[best_axis](BuildPrim const& a, BuildPrim const& b) { return a.centroid[best_axis] < b.centroid[best_axis]; });
+		}
+
+		int mid = begin + best_split;
+		build_recursive(prims, begin, mid, depth + 1);
+		int second_child = build_recursive(prims, mid, end, depth + 1);
+
+		BVHNode& node = mvecNodes[node_index];
+		node.mnOffset = second_child;
+		node.mnCount = 0;
+		node.mnAxis = (unsigned char)best_axis;
+
+		return node_index;
+	}
+
+	void BVHTree::fill_node_bounds(BVHNode& node, AABB const& box) {
+		node.mBounds[0] = box.mX0;
+		node.mBounds[1] = box.mX1;
+		node.mBounds[2] = box.mY0;
+		node.mBounds[3] = box.mY1;
+		node.mBounds[4] = box.mZ0;
+		node.mBounds[5] = box.mZ1;
+		node.mnPad = 0;
+	}
+
+	//-----------------------------------------------------------------
+	// The binned SAH build. The primitives are put into BIN_COUNT bins by their centroids along each axis,
+	// the SAH is only evaluated at the bin boundaries, so a node costs two linear passes instead of sorts.
+	// The nodes are built as a pointer tree first, then flattened into the depth-first array: the subtrees
+	// work on disjoint ranges of the primitives, so they are built on their own threads, and the bounds
+	// and the bins of the big nodes near the root are reduced on several threads as well.
+	//-----------------------------------------------------------------
+	struct BVHTree::BinnedNode
+	{
+		AABB		box;
+		int			begin;
+		int			end;
+		int			axis;
+		BinnedNode *children[2];
+
+		BinnedNode() : begin(0), end(0), axis(0) { children[0] = children[1] = nullptr; }
+		~BinnedNode() { delete children[0]; delete children[1]; }
+	};
+
+	static const int BIN_COUNT = 16;
+
+	struct BVHTree::BinnedBins
+	{
+		struct Bin {
+			AABB	box;
+			int		count;
+		};
+
+		Bin		bins[3][BIN_COUNT];
+		AABB	box;
+		AABB	centroid_box;
+	};
+
+	struct BVHTree::BinnedContext
+	{
+		static const int PARALLEL_SUBTREE_PRIMS = 4096;	// smaller subtrees are not worth a thread
+		static const int PARALLEL_REDUCE_PRIMS = 65536;	// smaller nodes are reduced on the current thread
+
+		int					thread_count;
+		std::atomic<int>	free_threads;
+
+		inline bool TakeThread() {
+			int free_count = free_threads.load();
+			while (free_count > 0) {
+				if (free_threads.compare_exchange_weak(free_count, free_count - 1)) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		inline void ReturnThread() { free_threads.fetch_add(1); }
+	};
+
+	inline static int bin_index(float centroid, float cmin, float binScale) {
+		int bin = (int)((centroid - cmin) * binScale);
+		return RTMath::Clamp(bin, 0, BIN_COUNT - 1);
+	}
+
+	// The bounds, the centroid bounds of [begin, end), and the bins upon the centroid bounds if it is given.
+	void BVHTree::reduce_range(vector<BuildPrim> const& prims, int begin, int end,
+		AABB const *centroidBox, BinnedBins& result) {
+		result.box = empty_box();
+		result.centroid_box = empty_box();
+
+		float cmin[3], scale[3];
+		if (centroidBox != nullptr) {
+			for (int axis = 0; axis < 3; ++axis) {
+				for (int b = 0; b < BIN_COUNT; ++b) {
+					result.bins[axis][b].box = empty_box();
+					result.bins[axis][b].count = 0;
+				}
+
+				float extent = box_max(*centroidBox, axis) - box_min(*centroidBox, axis);
+				cmin[axis] = box_min(*centroidBox, axis);
+				scale[axis] = (extent > 0.0f) ? (BIN_COUNT / extent) : 0.0f;
+			}
+		}
+
+		for (int i = begin; i < end; ++i) {
+			grow_box(result.box, prims[i].box);
+			grow_box(result.centroid_box, prims[i].centroid);
+
+			if (centroidBox != nullptr) {
+				for (int axis = 0; axis < 3; ++axis) {
+					BinnedBins::Bin& bin = result.bins[axis][bin_index(prims[i].centroid[axis], cmin[axis], scale[axis])];
+					grow_box(bin.box, prims[i].box);
+					bin.count += 1;
+				}
+			}
+		}
+	}
+
+	// reduce_range split into chunks on several threads for the big nodes.
+	void BVHTree::parallel_reduce_range(BinnedContext& ctx, vector<BuildPrim> const& prims, int begin, int end,
+		AABB const *centroidBox, BinnedBins& result) {
+		int count = end - begin;
+		int chunk_count = std::min<int>(ctx.thread_count, count / (BinnedContext::PARALLEL_REDUCE_PRIMS / 4));
+		if (count < BinnedContext::PARALLEL_REDUCE_PRIMS || chunk_count <= 1) {
+			reduce_range(prims, begin, end, centroidBox, result);
+			return;
+		}
+
+		vector<BinnedBins> partial(chunk_count);
+		vector<std::thread> workers;
+		int chunk_size = (count + chunk_count - 1) / chunk_count;
+		for (int c = 1; c < chunk_count; ++c) {
+			int chunk_begin = begin + c * chunk_size;
+			int chunk_end = std::min<int>(chunk_begin + chunk_size, end);
+			workers.push_back(std::thread(reduce_range, std::cref(prims), chunk_begin, chunk_end, centroidBox, std::ref(partial[c])));
+		}
+		reduce_range(prims, begin, std::min<int>(begin + chunk_size, end), centroidBox, partial[0]);
+
+		for (int c = 0; c < (int)workers.size(); ++c) {
+			workers[c].join();
+		}
+
+		result = partial[0];
+		for (int c = 1; c < chunk_count; ++c) {
+			grow_box(result.box, partial[c].box);
+			grow_box(result.centroid_box, partial[c].centroid_box);
+			for (int axis = 0; axis < 3; ++axis) {
+				for (int b = 0; b < BIN_COUNT; ++b) {
+					grow_box(result.bins[axis][b].box, partial[c].bins[axis][b].box);
+					result.bins[axis][b].count += partial[c].bins[axis][b].count;
+				}
+			}
+		}
+	}
+
+	void BVHTree::build_binned(vector<BuildPrim>& prims) {
+		BinnedContext ctx;
+		ctx.thread_count = thread_count();
+		ctx.free_threads = ctx.thread_count - 1;
+
+		BinnedNode *root = binned_recursive(ctx, prims, 0, (int)prims.size(), 0);
+		flatten_binned(root, prims);
+		delete root;
+	}
+
+	BVHTree::BinnedNode *BVHTree::binned_recursive(BinnedContext& ctx, vector<BuildPrim>& prims, int begin, int end, int depth) const {
+		BinnedNode *node = new BinnedNode;
+		node->begin = begin;
+		node->end = end;
+
+		int count = end - begin;
+
+		// the bounds and the centroid bounds first, the bins are laid upon the centroid bounds.
+		BinnedBins bins;
+		parallel_reduce_range(ctx, prims, begin, end, nullptr, bins);
+		node->box = bins.box;
+		AABB centroid_box = bins.centroid_box;
+
+		if (count == 1 || depth >= BVHTree::MAX_DEPTH - 1) {
+			return node;
+		}
+
+		parallel_reduce_range(ctx, prims, begin, end, &centroid_box, bins);
+
+		int best_axis = -1;
+		int best_split = -1;
+		float best_cost = FLT_MAX;
+
+		for (int axis = 0; axis < 3; ++axis) {
+			if (box_max(centroid_box, axis) <= box_min(centroid_box, axis)) {
+				continue;
+			}
+
+			const BinnedBins::Bin *axis_bins = bins.bins[axis];
+			float right_areas[BIN_COUNT];
+			int right_counts[BIN_COUNT];
+
+			AABB right_box = empty_box();
+			int right_count = 0;
+			for (int b = BIN_COUNT - 1; b >= 1; --b) {
+				if (axis_bins[b].count > 0) { grow_box(right_box, axis_bins[b].box); }
+				right_count += axis_bins[b].count;
+				right_areas[b] = (right_count > 0) ? BVHTree::SurfaceArea(right_box) : 0.0f;
+				right_counts[b] = right_count;
+			}
+
+			AABB left_box = empty_box();
+			int left_count = 0;
+			for (int b = 1; b < BIN_COUNT; ++b) {
+				if (axis_bins[b - 1].count > 0) { grow_box(left_box, axis_bins[b - 1].box); }
+				left_count += axis_bins[b - 1].count;
+				if (left_count == 0 || right_counts[b] == 0) {
+					continue;
+				}
+
+				float cost = BVHTree::SurfaceArea(left_box) * leaf_cost(left_count) + right_areas[b] * leaf_cost(right_counts[b]);
+				if (cost < best_cost) {
+					best_cost = cost;
+					best_axis = axis;
+					best_split = b;
+				}
+			}
+		}
+
+		int mid = -1;
+		if (best_axis >= 0) {
+			float node_area = BVHTree::SurfaceArea(node->box);
+			best_cost = BVHTree::TraversalCost() + (node_area > 0.0f ? best_cost / node_area : leaf_cost(count));
+
+			// make a leaf if splitting won't pay off, but never let a leaf grow beyond the limit.
+			if (count <= mnMaxLeafPrims && best_cost >= leaf_cost(count)) {
+				return node;
+			}
+
+			float cmin = box_min(centroid_box, best_axis);
+			float scale = BIN_COUNT / (box_max(centroid_box, best_axis) - cmin);
+			int axis = best_axis, split = best_split;
+			mid = (int)(std::partition(prims.begin() + begin, prims.begin() + end,
+				[axis, split, cmin, scale](BuildPrim const& prim) { return bin_index(prim.centroid[axis], cmin, scale) < split; }) - prims.begin());
+		}
+		else {
+			// all the centroids fall into one bin (or one point), split in the middle if the leaf would be too big.
+			if (count <= mnMaxLeafPrims) {
+				return node;
+			}
+
+			best_axis = 0;
+			for (int axis = 1; axis < 3; ++axis) {
+				if (box_max(centroid_box, axis) - box_min(centroid_box, axis) > box_max(centroid_box, best_axis) - box_min(centroid_box, best_axis)) {
+					best_axis = axis;
+				}
+			}
+
+			mid = begin + count / 2;
+			int axis = best_axis;
+			std::nth_element(prims.begin() + begin, prims.begin() + mid, prims.begin() + end,
+				[axis](BuildPrim const& a, BuildPrim const& b) { return a.centroid[axis] < b.centroid[axis]; });
+		}
+
+		node->axis = best_axis;
+
+		// the two halves are disjoint ranges of the primitives, the left one goes to another thread if it is big.
+		if (count >= BinnedContext::PARALLEL_SUBTREE_PRIMS && ctx.TakeThread()) {
+			std::thread worker([&]() { node->children[0] = binned_recursive(ctx, prims, begin, mid, depth + 1); });
+			node->children[1] = binned_recursive(ctx, prims, mid, end, depth + 1);
+			worker.join();
+			ctx.ReturnThread();
+		}
+		else {
+			node->children[0] = binned_recursive(ctx, prims, begin, mid, depth + 1);
+			node->children[1] = binned_recursive(ctx, prims, mid, end, depth + 1);
+		}
+
+		return node;
+	}
+
+	int BVHTree::flatten_binned(BinnedNode *node, vector<BuildPrim> const& prims) {
+		int node_index = (int)mvecNodes.size();
+		mvecNodes.push_back(BVHNode());
+		fill_node_bounds(mvecNodes[node_index], node->box);
+
+		if (node->children[0] == nullptr) {
+			BVHNode& leaf = mvecNodes[node_index];
+			leaf.mnOffset = (int)mvecPrimIndices.size();
+			leaf.mnCount = (unsigned short)(node->end - node->begin);
+			leaf.mnAxis = 0;
+			for (int i = node->begin; i < node->end; ++i) {
+				mvecPrimIndices.push_back(prims[i].index);
+			}
+
+			return node_index;
+		}
+
+		flatten_binned(node->children[0], prims);
+		int second_child = flatten_binned(node->children[1], prims);
+
+		BVHNode& interior = mvecNodes[node_index];
+		interior.mnOffset = second_child;
+		interior.mnCount = 0;
+		interior.mnAxis = (unsigned char)node->axis;
+
+		return node_index;
+	}
+
+	//-----------------------------------------------------------------
+	// The linear BVH build (LBVH). Each primitive gets the Morton code of its centroid quantized in the
+	// centroid bounds, the codes are sorted with a radix sort, then a node is simply split where the
+	// highest bit differing within its range flips, which is a binary search in the sorted codes.
+	// No SAH is evaluated anywhere, so the tree is worse than the SAH ones but the build is several times faster,
+	// which pays off when the geometry changes every frame. The leaves are the consecutive runs of the sorted
+	// primitives, so the primitive index list is just the sorted order.
+	//-----------------------------------------------------------------
+	static const int LBVH_SHORT_CODE_PRIMS = 1 << 20;	// up to this count 10 bits per axis are enough, 21 bits beyond
+	static const int LBVH_PARALLEL_PRIMS = 16384;		// the least primitives of a chunk on a thread of its own
+	static const int RADIX_BITS = 11;
+	static const int RADIX_SIZE = 1 << RADIX_BITS;
+
+	inline static int chunk_count_for(int threadCount, int count, int minChunk) {
+		return RTMath::Clamp(count / minChunk, 1, threadCount);
+	}
+
+	// Calls fn(chunk, begin, end) for the chunkCount ranges of [0, count), the first one on the calling thread.
+	template <typename Fn>
+	static void run_chunks(int chunkCount, int count, Fn fn) {
+		int chunk_size = (count + chunkCount - 1) / chunkCount;
+
+		vector<std::thread> workers;
+		for (int c = 1; c < chunkCount; ++c) {
+			int chunk_begin = std::min<int>(c * chunk_size, count);
+			int chunk_end = std::min<int>(chunk_begin + chunk_size, count);
+			workers.push_back(std::thread(fn, c, chunk_begin, chunk_end));
+		}
+		fn(0, 0, std::min<int>(chunk_size, count));
+
+		for (int c = 0; c < (int)workers.size(); ++c) {
+			workers[c].join();
+		}
+	}
+
+	// Spreads the low 10 bits of v to every third bit.
+	inline static unsigned long long expand_bits_10(unsigned long long v) {
+		v &= 0x3ffull;
+		v = (v | (v << 16)) & 0x30000ffull;
+		v = (v | (v << 8)) & 0x300f00full;
+		v = (v | (v << 4)) & 0x30c30c3ull;
+		v = (v | (v << 2)) & 0x9249249ull;
+		return v;
+	}
+
+	// Spreads the low 21 bits of v to every third bit.
+	inline static unsigned long long expand_bits_21(unsigned long long v) {
+		v &= 0x1fffffull;
+		v = (v | (v << 32)) & 0x1f00000000ffffull;
+		v = (v | (v << 16)) & 0x1f0000ff0000ffull;
+		v = (v | (v << 8)) & 0x100f00f00f00f00full;
+		v = (v | (v << 4)) & 0x10c30c30c30c30c3ull;
+		v = (v | (v << 2)) & 0x1249249249249249ull;
+		return v;
+	}
+
+	inline static int highest_bit(unsigned long long v) {
+		int bit = 0;
+		while ((v >> 1) != 0) { v >>= 1; ++bit; }
+		return bit;
+	}
+
+	// Stable LSD radix sort by the low keyBits bits of the codes, each pass counts and scatters the chunks on their own threads.
+	void BVHTree::radix_sort_morton(vector<MortonPrim>& keys, int keyBits, int threadCount) {
+		int count = (int)keys.size();
+		int chunk_count = chunk_count_for(threadCount, count, LBVH_PARALLEL_PRIMS);
+
+		vector<MortonPrim> sorted(count);
+		vector<int> offsets(chunk_count * RADIX_SIZE);
+
+		for (int shift = 0; shift < keyBits; shift += RADIX_BITS) {
+			std::fill(offsets.begin(), offsets.end(), 0);
+
+			run_chunks(chunk_count, count, [&keys, &offsets, shift](int chunk, int begin, int end) {
+				int *histogram = &offsets[chunk * RADIX_SIZE];
+				for (int i = begin; i < end; ++i) {
+					histogram[(keys[i].code >> shift) & (RADIX_SIZE - 1)] += 1;
+				}
+			});
+
+			// digit major, chunk minor, so the chunks scatter their own keys in order and the sort stays stable.
+			int offset = 0;
+			for (int digit = 0; digit < RADIX_SIZE; ++digit) {
+				for (int c = 0; c < chunk_count; ++c) {
+					int digit_count = offsets[c * RADIX_SIZE + digit];
+					offsets[c * RADIX_SIZE + digit] = offset;
+					offset += digit_count;
+				}
+			}
+
+			run_chunks(chunk_count, count, [&keys, &sorted, &offsets, shift](int chunk, int begin, int end) {
+				int *next = &offsets[chunk * RADIX_SIZE];
+				for (int i = begin; i < end; ++i) {
+					sorted[next[(keys[i].code >> shift) & (RADIX_SIZE - 1)]++] = keys[i];
+				}
+			});
+
+			keys.swap(sorted);
+		}
+	}
+
+	void BVHTree::build_lbvh(vector<BuildPrim> const& prims) {
+		int count = (int)prims.size();
+
+		AABB centroid_box = empty_box();
+		for (int i = 0; i < count; ++i) {
+			grow_box(centroid_box, prims[i].centroid);
+		}
+
+		int key_bits = (count <= LBVH_SHORT_CODE_PRIMS) ? 30 : 63;
+		int cell_count = 1 << (key_bits / 3);
+
+		float cmin[3], scale[3];
+		for (int axis = 0; axis < 3; ++axis) {
+			float extent = box_max(centroid_box, axis) - box_min(centroid_box, axis);
+			cmin[axis] = box_min(centroid_box, axis);
+			scale[axis] = (extent > 0.0f) ? (cell_count / extent) : 0.0f;
+		}
+
+		int threads = thread_count();
+		vector<MortonPrim> keys(count);
+		run_chunks(chunk_count_for(threads, count, LBVH_PARALLEL_PRIMS), count,
+			[&prims, &keys, &cmin, &scale, cell_count, key_bits](int, int begin, int end) {
+			for (int i = begin; i < end; ++i) {
+				unsigned long long cell[3];
+				for (int axis = 0; axis < 3; ++axis) {
+					int c = (int)((prims[i].centroid[axis] - cmin[axis]) * scale[axis]);
+					cell[axis] = (unsigned long long)RTMath::Clamp(c, 0, cell_count - 1);
+				}
+
+				if (key_bits == 30) {
+					keys[i].code = (expand_bits_10(cell[0]) << 2) | (expand_bits_10(cell[1]) << 1) | expand_bits_10(cell[2]);
+				}
+				else {
+					keys[i].code = (expand_bits_21(cell[0]) << 2) | (expand_bits_21(cell[1]) << 1) | expand_bits_21(cell[2]);
+				}
+				keys[i].index = prims[i].index;
+			}
+		});
+
+		radix_sort_morton(keys, key_bits, threads);
+
+		mvecPrimIndices.resize(count);
+		for (int i = 0; i < count; ++i) {
+			mvecPrimIndices[i] = keys[i].index;
+		}
+
+		AABB root_box;
+		lbvh_recursive(keys, prims, 0, count, 0, root_box);
+	}
+
+	int BVHTree::lbvh_recursive(vector<MortonPrim> const& keys, vector<BuildPrim> const& prims, int begin, int end, int depth, AABB& box) {
+		int node_index = (int)mvecNodes.size();
+		mvecNodes.push_back(BVHNode());
+
+		int count = end - begin;
+		if (count <= mnMaxLeafPrims || depth >= BVHTree::MAX_DEPTH - 1) {
+			// the BuildPrims are in the input order, the MortonPrim index is the same as their position.
+			box = empty_box();
+			for (int i = begin; i < end; ++i) {
+				grow_box(box, prims[keys[i].index].box);
+			}
+
+			BVHNode& leaf = mvecNodes[node_index];
+			fill_node_bounds(leaf, box);
+			leaf.mnOffset = begin;
+			leaf.mnCount = (unsigned short)count;
+			leaf.mnAxis = 0;
+
+			return node_index;
+		}
+
+		int mid = begin + count / 2;
+		int axis = 0;
+
+		// the codes of the range share all the bits above the highest differing one, so it is a partition point.
+		// The same code all over the range means the centroids are in one cell, the middle is as good as anywhere.
+		unsigned long long diff = keys[begin].code ^ keys[end - 1].code;
+		if (diff != 0) {
+			int bit = highest_bit(diff);
+			mid = (int)(std::partition_point(keys.begin() + begin, keys.begin() + end,
+				[bit](MortonPrim const& key) { return ((key.code >> bit) & 1) == 0; }) - keys.begin());
+			// x y z from the high bit to the low one in each triple.
+			axis = 2 - (bit % 3);
+		}
+
+		AABB left_box, right_box;
+		lbvh_recursive(keys, prims, begin, mid, depth + 1, left_box);
+		int second_child = lbvh_recursive(keys, prims, mid, end, depth + 1, right_box);
+
+		box = left_box;
+		grow_box(box, right_box);
+
+		BVHNode& interior = mvecNodes[node_index];
+		fill_node_bounds(interior, box);
+		interior.mnOffset = second_child;
+		interior.mnCount = 0;
+		interior.mnAxis = (unsigned char)axis;
+
+		return node_index;
+	}
+}
@@ -0,0 +1,321 @@
+#pragma once
+
+#include <new>
+
+#include "Common.h"
+#include "Vec3.h"
+#include "Ray.h"
+#include "AABB.h"
+
+namespace LaplataRayTracer
+{
+	//-----------------------------------------------------------------
+	// Allocator for the arrays whose elements have to start at an aligned address,
+	// the default allocator only guarantees the alignment of the fundamental types before C++17.
+	//-----------------------------------------------------------------
+	template <typename T, int ALIGNMENT>
+	class AlignedAllocator
+	{
+	public:
+		typedef T value_type;
+
+		template <typename U>
+		struct rebind { typedef AlignedAllocator<U, ALIGNMENT> other; };
+
+	public:
+		AlignedAllocator() { }
+		template <typename U>
+		AlignedAllocator(AlignedAllocator<U, ALIGNMENT> const& other) { }
+
+	public:
+		T *allocate(std::size_t n) {
+			void *ptr = nullptr;
+#ifdef PLATFORM_WIN
+			ptr = _aligned_malloc(n * sizeof(T), ALIGNMENT);
+#else
+			if (posix_memalign(&ptr, ALIGNMENT, n * sizeof(T)) != 0) {
+				ptr = nullptr;
+			}
+#endif // PLATFORM_WIN
+			if (ptr == nullptr) {
+				throw std::bad_alloc();
+			}
+			return (T *)ptr;
+		}
+
+		void deallocate(T *ptr, std::size_t) {
+#ifdef PLATFORM_WIN
+			_aligned_free(ptr);
+#else
+			free(ptr);
+#endif // PLATFORM_WIN
+		}
+
+		template <typename U>
+		bool operator==(AlignedAllocator<U, ALIGNMENT> const&) const { return true; }
+		template <typename U>
+		bool operator!=(AlignedAllocator<U, ALIGNMENT> const&) const { return false; }
+	};
+
+	//-----------------------------------------------------------------
+	// BVHNode is the flattened node, 32 bytes and 32-byte aligned, so a node never straddles
+	// two cache lines. The nodes are stored in depth-first order,
+	// so the first child of an interior node is always the next one in the array,
+	// only the index of the second child has to be stored.
+	//-----------------------------------------------------------------
+	struct alignas(32) BVHNode
+	{
+		float			mBounds[6];	// x0, x1, y0, y1, z0, z1, the same order as AABB
+		int				mnOffset;	// leaf: the first slot in the primitive index list, interior: the second child
+		unsigned short	mnCount;	// primitive count of a leaf, 0 for the interior nodes
+		unsigned char	mnAxis;		// split axis of the interior nodes
+		unsigned char	mnPad;
+
+		inline bool IsLeaf() const { return mnCount > 0; }
+	};
+
+	typedef vector<BVHNode, AlignedAllocator<BVHNode, 32> > BVHNodeArray;
+
+	//
+	// The bounds of a node at the start and the end of the motion interval, in the BVHNode bounds layout,
+	// kept aside of the nodes so the trees without motion don't pay for them.
+	struct BVHMotionBounds
+	{
+		float	mBounds0[6];
+		float	mBounds1[6];
+	};
+
+	//
+	// A simulated cache of the nodes fetched by the traversals, to measure how coherent a stream of rays is:
+	// LINE_COUNT lines of 64 bytes (32KB, an L1 data cache), direct mapped by the node's address.
+	// A fetch hits when the line of the node is still the one in its slot.
+	class NodeCacheCounter
+	{
+	public:
+		static const int LINE_BITS = 6;
+		static const int LINE_COUNT = 512;
+
+	public:
+		NodeCacheCounter() { Reset(); }
+
+		inline void Reset() {
+			for (int i = 0; i < LINE_COUNT; ++i) {
+				mnTags[i] = ~(size_t)0;
+			}
+			mnFetches = 0;
+			mnHits = 0;
+		}
+
+		inline void Touch(const void *node) {
+			size_t line = (size_t)node >> LINE_BITS;
+			size_t& tag = mnTags[line & (LINE_COUNT - 1)];
+			++mnFetches;
+			if (tag == line) {
+				++mnHits;
+			}
+			else {
+				tag = line;
+			}
+		}
+
+		// Adds the fetches and the hits counted by another counter (a worker thread's), the lines stay as they are.
+		inline void Merge(NodeCacheCounter const& other) {
+			mnFetches += other.mnFetches;
+			mnHits += other.mnHits;
+		}
+
+		inline long long Fetches() const { return mnFetches; }
+		inline long long Hits() const { return mnHits; }
+		inline float HitRate() const { return (mnFetches > 0) ? (float)((double)mnHits / (double)mnFetches) : 0.0f; }
+
+	private:
+		size_t		mnTags[LINE_COUNT];
+		long long	mnFetches;
+		long long	mnHits;
+
+	};
+
+	enum EBVHBuildMode {
+		BVH_BUILD_SWEEP_SAH = 0,	// sorts the primitives along each axis at each node, the best tree but the slowest build
+		BVH_BUILD_BINNED_SAH,		// evaluates the SAH at a few bin boundaries, the subtrees are built on several threads
+		BVH_BUILD_LBVH,				// sorts the primitives along a Morton curve, no SAH at all, for the per-frame rebuilds
+	};
+
+	//
+	// The acceleration-agnostic part of a BVH: it only knows the bounding-box of each primitive,
+	// the user (scene objects, meshes...) maps the leaf ranges back to its own primitives via GetPrimIndices.
+	class BVHTree
+	{
+	public:
+		BVHTree();
+		~BVHTree();
+
+	public:
+		// Build over the primitive bounding-boxes, the way is picked by SetBuildMode. The primitives of a leaf
+		// are tested primBlockWidth at a time (the SIMD kernels), so the SAH counts the blocks instead of the primitives.
+		void Build(vector<AABB> const& primBounds, int maxLeafPrims = 4, int primBlockWidth = 1);
+		void Clear();
+
+		// Refit after the primitives moved but the topology didn't (a frame of a deforming mesh): the node bounds
+		// are recomputed bottom-up in one linear pass, the tree itself is kept. primBounds is indexed the way the
+		// leaf ranges map to the primitives: through the index list, or by the leaf slots after ReleasePrimIndices.
+		// Returns the SAH cost against the one of the last Build, the user rebuilds once it has grown too much.
+		float Refit(vector<AABB> const& primBounds);
+
+		// Motion blur: the tree is built upon the bounds swept over [time0, time1], then each node gets its bounds at
+		// time0 and time1 from the primitive bounds at those times, HitNodeAt interpolates them by the ray's time.
+		// It holds for the primitives moving linearly, the rays out of the interval see the bounds at its ends.
+		// Refit and Build drop the motion bounds.
+		void SetMotionBounds(vector<AABB> const& primBounds0, vector<AABB> const& primBounds1, float time0, float time1);
+		inline bool HasMotion() const { return !mvecMotionBounds.empty(); }
+
+		// threadCount 0 means all the hardware threads, it's used by the binned and the LBVH builds.
+		// The mode can be switched between two Builds, e.g. LBVH for the frames of an animation.
+		void SetBuildMode(EBVHBuildMode mode, int threadCount = 0);
+		inline EBVHBuildMode GetBuildMode() const { return mBuildMode; }
+
+		// The build speed against the traversal speed: the seconds of the last Build, and the SAH cost of its tree.
+		inline float BuildTime() const { return mfBuildTime; }
+		inline float BuildSAHCost() const { return mfBuildSAHCost; }
+		float SAHCost() const;
+		AABB RootBounds() const;
+		size_t MemoryUsage() const;
+
+		// The user who has reordered its primitives in the leaf order doesn't need the index list any more,
+		// the leaf ranges index its primitives directly then.
+		void ReleasePrimIndices();
+
+	public:
+		inline bool IsEmpty() const { return mvecNodes.empty(); }
+		inline int NodeCount() const { return (int)mvecNodes.size(); }
+		inline const BVHNodeArray& GetNodes() const { return mvecNodes; }
+		inline const vector<int>& GetPrimIndices() const { return mvecPrimIndices; }
+
+	public:
+		// Slab test of a node with the ray's cached reciprocal direction, the sign bits pick the near
+		// and the far plane of each axis so there is no min/max pair per axis.
+		inline static bool HitNode(BVHNode const& node, Ray const& ray, float tmin, float tmax, float& tnear) {
+			return HitBounds(node.mBounds, ray, tmin, tmax, tnear);
+		}
+
+		inline static bool HitBounds(const float bounds[6], Ray const& ray, float tmin, float tmax, float& tnear) {
+			Vec3f const& o = ray.O();
+			Vec3f const& inv_d = ray.InvD();
+
+			float tx0 = (bounds[ray.Sign(0)] - o.X()) * inv_d.X();
+			float tx1 = (bounds[1 - ray.Sign(0)] - o.X()) * inv_d.X();
+			float ty0 = (bounds[2 + ray.Sign(1)] - o.Y()) * inv_d.Y();
+			float ty1 = (bounds[3 - ray.Sign(1)] - o.Y()) * inv_d.Y();
+			float tz0 = (bounds[4 + ray.Sign(2)] - o.Z()) * inv_d.Z();
+			float tz1 = (bounds[5 - ray.Sign(2)] - o.Z()) * inv_d.Z();
+
+			float t0 = std::max<float>(std::max<float>(tx0, ty0), std::max<float>(tz0, tmin));
+			float t1 = std::min<float>(std::min<float>(tx1, ty1), std::min<float>(tz1, tmax));
+
+			tnear = t0;
+			return (t0 <= t1);
+		}
+
+		// HitNode at the ray's time, upon the interpolated motion bounds if there are any.
+		inline bool HitNodeAt(int nodeIndex, Ray const& ray, float tmin, float tmax, float& tnear) const {
+			if (mvecMotionBounds.empty()) {
+				return HitNode(mvecNodes[nodeIndex], ray, tmin, tmax, tnear);
+			}
+
+			BVHMotionBounds const& motion = mvecMotionBounds[nodeIndex];
+			float s = std::min<float>(std::max<float>((ray.T() - mfMotionTime0) * mfMotionInvDuration, 0.0f), 1.0f);
+
+			float bounds[6];
+			for (int k = 0; k < 6; ++k) {
+				bounds[k] = motion.mBounds0[k] + s * (motion.mBounds1[k] - motion.mBounds0[k]);
+			}
+
+			return HitBounds(bounds, ray, tmin, tmax, tnear);
+		}
+
+		// The node fetches of the traversals on the calling thread (the scene BVH and the mesh accelerators)
+		// go to counter while it's bound, nullptr unbinds it. They are only counted when NODE_CACHE_STATS is
+		// defined (Common.h), otherwise CountNodeFetch is empty and the traversals don't pay for it.
+		inline static void BindNodeCacheCounter(NodeCacheCounter *counter) { mpNodeCacheCounter = counter; }
+		inline static NodeCacheCounter *BoundNodeCacheCounter() { return mpNodeCacheCounter; }
+		inline static void CountNodeFetch(const void *node) {
+#ifdef NODE_CACHE_STATS
+			if (mpNodeCacheCounter != nullptr) {
+				mpNodeCacheCounter->Touch(node);
+			}
+#else
+			(void)node;
+#endif // NODE_CACHE_STATS
+		}
+
+		inline static float SurfaceArea(AABB const& box) {
+			float dx = box.mX1 - box.mX0;
+			float dy = box.mY1 - box.mY0;
+			float dz = box.mZ1 - box.mZ0;
+			return 2.0f * (dx * dy + dy * dz + dz * dx);
+		}
+
+	public:
+		static const int MAX_DEPTH = 64;
+		static const int MAX_LEAF_PRIMS = 16;
+
+		inline static float TraversalCost() { return 0.125f; }
+
+	private:
+		struct BuildPrim {
+			AABB	box;
+			Vec3f	centroid;
+			int		index;
+		};
+
+		struct BinnedNode;
+		struct BinnedBins;
+		struct BinnedContext;
+
+		struct MortonPrim {
+			unsigned long long	code;
+			int					index;
+		};
+
+	private:
+		int build_recursive(vector<BuildPrim>& prims, int begin, int end, int depth);
+
+		void build_binned(vector<BuildPrim>& prims);
+		BinnedNode *binned_recursive(BinnedContext& ctx, vector<BuildPrim>& prims, int begin, int end, int depth) const;
+		int flatten_binned(BinnedNode *node, vector<BuildPrim> const& prims);
+
+		static void reduce_range(vector<BuildPrim> const& prims, int begin, int end, AABB const *centroidBox, BinnedBins& result);
+		static void parallel_reduce_range(BinnedContext& ctx, vector<BuildPrim> const& prims, int begin, int end,
+			AABB const *centroidBox, BinnedBins& result);
+
+		void build_lbvh(vector<BuildPrim> const& prims);
+		int lbvh_recursive(vector<MortonPrim> const& keys, vector<BuildPrim> const& prims, int begin, int end, int depth, AABB& box);
+		int thread_count() const;
+
+		static void radix_sort_morton(vector<MortonPrim>& keys, int keyBits, int threadCount);
+
+		inline float leaf_cost(int primCount) const {
+			return (float)((primCount + mnPrimBlockWidth - 1) / mnPrimBlockWidth);
+		}
+		void fill_node_bounds(BVHNode& node, AABB const& box);
+		// The bounds of each node over the given primitive bounds, bottom-up. False if they are not the tree's primitives.
+		bool fit_node_bounds(vector<AABB> const& primBounds, vector<AABB>& nodeBounds) const;
+
+	private:
+		BVHNodeArray	mvecNodes;
+		vector<int>		mvecPrimIndices;
+		int				mnMaxLeafPrims;
+		int				mnPrimBlockWidth;
+		EBVHBuildMode	mBuildMode;
+		int				mnBuildThreads;
+		float			mfBuildTime;
+		float			mfBuildSAHCost;
+
+		vector<BVHMotionBounds>	mvecMotionBounds; // empty, or one per node
+		float					mfMotionTime0;
+		float					mfMotionInvDuration;
+
+		static thread_local NodeCacheCounter *mpNodeCacheCounter;
+
+	};
+}
@@ -44,6 +44,9 @@ namespace LaplataRayTracer
 	public:
 		virtual void Update() = 0;
 		virtual bool GenerateRay(float x, float y, Ray& ray) = 0;
+		// true: the rays of neighbouring samples are close to each other (one origin, nearby directions),
+		// so they can be traced as packets, see Scene::RenderScene.
+		virtual bool IsCoherent() const { return false; }
 
 	public:
 	    inline void EnableZoomFactor(bool enable) { mEnableZoom = enable; }
@@ -141,6 +144,8 @@ namespace LaplataRayTracer
 			ray.Set(mEye, vDirInUVW, genRayTime());
 			return true;
 		}
+
+		virtual bool IsCoherent() const { return true; }
 	};
 
 	//
@@ -166,6 +171,8 @@ namespace LaplataRayTracer
 			return true;
 		}
 
+		virtual bool IsCoherent() const { return true; }
+
 	protected:
 		virtual void UpdateUVW()
 		{
@@ -209,6 +216,8 @@ namespace LaplataRayTracer
 		}
 
 	public:
+		virtual bool IsCoherent() const { return false; }
+
 		virtual bool GenerateRay(float x, float y, Ray& ray) {
 			Point2f pt_on_dev;
 			pt_on_dev.x = 2.0f / mWidth * x;
@@ -262,6 +271,8 @@ namespace LaplataRayTracer
 		}
 
 	public:
+		virtual bool IsCoherent() const { return false; }
+
 		virtual bool GenerateRay(float x, float y, Ray& ray) {
 		//	Point2f pt_sp;
 		//	Point2f pt_pp;
@@ -332,6 +343,8 @@ namespace LaplataRayTracer
         }
 
 	public:
+        virtual bool IsCoherent() const { return false; }
+
         virtual bool GenerateRay(float x, float y, Ray& ray) {
             Point2f ndc;
             ndc.x = 2.0f / (mZoomFactor * mWidth) * x;
@@ -17,6 +17,9 @@
 //#define MICROFACET_SMITH_GGX
 #define MICROFACET_COOK
 
+// the traversals count their node fetches in the bound NodeCacheCounter, see BVHTree::CountNodeFetch
+//#define NODE_CACHE_STATS
+
 #define PI_CONST		3.14159265f
 #define INV_PI_CONST	0.31830989f
 #define TWO_PI_CONST	6.2831853f
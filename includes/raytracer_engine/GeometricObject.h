@@ -25,7 +25,7 @@ namespace LaplataRayTracer
 		virtual void *Clone() = 0;
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) = 0;
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const = 0;
 		virtual bool IntersectP(Ray const& inRay, float& tvalue) const = 0;
 
 	};
@@ -41,7 +41,7 @@ namespace LaplataRayTracer
 		virtual void *Clone() = 0;
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) = 0;
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const = 0;
 		virtual bool IntersectP(Ray const& inRay, float& tvalue) const = 0;
 
 	public:
@@ -54,6 +54,25 @@ namespace LaplataRayTracer
 		virtual float PDFValue(Vec3f const& o, Vec3f const& v) const = 0;
         virtual Vec3f SampleRandomDirection(Vec3f const& v) const = 0;
 
+	public:
+		// The moving objects tell their motion interval, and their bounds at any time of it (linear in time),
+		// so the acceleration structures bound them per time instead of over the whole motion.
+		// GetBoundingBox stays the bounds over all the motion.
+		virtual bool GetMotionInterval(float& /*time0*/, float& /*time1*/) const { return false; }
+		virtual bool GetBoundingBoxAt(float time, AABB& bounding) { return GetBoundingBox(time, time, bounding); }
+
+		// The bounds under xform, the transformed corners of the bounding-box by default. The objects made of
+		// vertices (the meshes) transform those instead, which bounds the rotated instances of them much tighter.
+		virtual bool GetTransformedBoundingBox(Transform const& xform, float t0, float t1, AABB& bounding) {
+			AABB local_bounding;
+			if (!GetBoundingBox(t0, t1, local_bounding)) {
+				return false;
+			}
+
+			bounding = xform.ApplyBox(local_bounding);
+			return true;
+		}
+
 	};
 
 	//
@@ -74,7 +93,7 @@ namespace LaplataRayTracer
 		virtual void *Clone() { return (GeometricObject *)(new SimplePlane(*this)); }
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec)
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const
 		{
 			Vec3f OA = inRay.O() - mPos;
 			float A = -Dot(OA, mNormal);
@@ -188,7 +207,7 @@ namespace LaplataRayTracer
 		virtual void *Clone() { return (GeometricObject *)(new SimpleSphere(*this)); }
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec)
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const
 		{
 		//	Vec3f vOC = inRay.O() - mPos;
 			Vec3f vOC = inRay.O() - getPos(inRay.T());
@@ -615,7 +634,7 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec)
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const
 		{
 			Vec3f vpos = inRay.O() - mCenter;
 			float x0 = vpos.X();
@@ -809,7 +828,7 @@ namespace LaplataRayTracer
 		virtual void *Clone() { return (GeometricObject *)(new SimpleDisk(*this)); }
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec)
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const
 		{
 			Vec3f OP = inRay.O() - mPos;
 			float A = -Dot(OP, mNormal);
@@ -925,7 +944,7 @@ namespace LaplataRayTracer
 			mBase.BuildFromW(mNormal);
 		}
 
-		inline void calc_uv(const Vec3f& pt,  float& u, float& v)
+		inline void calc_uv(const Vec3f& pt,  float& u, float& v) const
 		{
 			Vec3f vOP_ = pt - mPos;
 			Vec3f vRef_;
@@ -1000,7 +1019,7 @@ namespace LaplataRayTracer
 		virtual void *Clone() { return (GeometricObject *)(new SimpleRing(*this)); }
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec)
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const
 		{
 			Vec3f OP = inRay.O() - mPos;
 			float A = -Dot(OP, mNormal);
@@ -1115,7 +1134,7 @@ namespace LaplataRayTracer
 			mSquareInnerRadius = mInnerRadius * mInnerRadius;
 		}
 
-		inline void calc_uv(const Vec3f& pt, float& u, float& v)
+		inline void calc_uv(const Vec3f& pt, float& u, float& v) const
 		{
 			Vec3f vOP_ = pt - mPos;
 			Vec3f vRef_;
@@ -1190,7 +1209,7 @@ namespace LaplataRayTracer
         virtual void *Clone() { return (GeometricObject *)(new SimpleRectangle(*this)); }
 
     public:
-        virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec)
+        virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const
         {
         /*    Vec3f OA = inRay.O() - mPos;
             float A = -Dot(OA, mNormal);
@@ -1445,7 +1464,7 @@ namespace LaplataRayTracer
         virtual void *Clone() { return (GeometricObject *)(new XYRect(*this)); }
 
     public:
-        virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec)
+        virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const
         {
             if (SimpleRectangle::HitTest(inRay, tmin, tmax, rec))
             {
@@ -1495,7 +1514,7 @@ namespace LaplataRayTracer
         virtual void *Clone() { return (GeometricObject *)(new XZRect(*this)); }
 
     public:
-        virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec)
+        virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const
         {
             if (SimpleRectangle::HitTest(inRay, tmin, tmax, rec))
             {
@@ -1545,7 +1564,7 @@ namespace LaplataRayTracer
         virtual void *Clone() { return (GeometricObject *)(new YZRect(*this)); }
 
     public:
-        virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec)
+        virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const
         {
             if (SimpleRectangle::HitTest(inRay, tmin, tmax, rec))
             {
@@ -1596,7 +1615,7 @@ namespace LaplataRayTracer
 		virtual void *Clone() { return (GeometricObject *)(new SimpleTriangle(*this)); }
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec)
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const
 		{
 			float beta, gamma;
 			bool is_hit = SimpleTriangle::HitTestImpl(v0, v1, v2, vNormal, mColor, beta, gamma, inRay, tmin, tmax, rec);
@@ -1835,7 +1854,7 @@ namespace LaplataRayTracer
 		virtual void *Clone() { return (GeometricObject *)(new SimpleBox(*this)); }
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec)
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const
 		{
 			float ox = inRay.O().X(); float oy = inRay.O().Y(); float oz = inRay.O().Z();
 			float dx = inRay.D().X(); float dy = inRay.D().Y(); float dz = inRay.D().Z();
@@ -2088,7 +2107,7 @@ namespace LaplataRayTracer
 			return ((p.X() > x0 && p.X() < x1) && (p.Y() > y0 && p.Y() < y1) && (p.Z() > z0 && p.Z() < z1));
 		}
 
-		inline void get_normal(const int face_hit, Vec3f& vNormal)
+		inline void get_normal(const int face_hit, Vec3f& vNormal) const
 		{
 			switch (face_hit)
 			{
@@ -2138,7 +2157,7 @@ namespace LaplataRayTracer
 		virtual void *Clone() { return (SimpleCylinder *)(new SimpleCylinder(*this)); }
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec)
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const
 		{
 			Vec3f OC = inRay.O() - mCenter;
             float x0 = OC.X();
@@ -2373,7 +2392,7 @@ namespace LaplataRayTracer
 		inline static float KEpsilon() { return 0.001f; }
 
 	private:
-		inline void calc_uv(const Vec3f& pt, float& u, float& v)
+		inline void calc_uv(const Vec3f& pt, float& u, float& v) const
 		{
 //			v = (pt.Y() - mY0) / (mY1 - mY0);
 //
@@ -2459,7 +2478,7 @@ namespace LaplataRayTracer
 		virtual void *Clone() { return (SimpleCone *)(new SimpleCone(*this)); }
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec)
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const
 		{
 			Vec3f OC = inRay.O() - mCenter;
 
@@ -2698,7 +2717,7 @@ namespace LaplataRayTracer
 
 	private:
 		inline void calc_H() { mH = mY1 - mY0; }
-		inline void calc_uv(const Vec3f& pt, float& u, float& v)
+		inline void calc_uv(const Vec3f& pt, float& u, float& v) const
 		{
 //			v = (pt.Y() - mY0) / (mY1 - mY0);
 //
@@ -2799,7 +2818,7 @@ namespace LaplataRayTracer
 		virtual void *Clone() { return (SimpleTorus *)(new SimpleTorus(*this)); }
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec)
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const
 		{
 // 			float x0 = inRay.O().X();
 // 			float y0 = inRay.O().Y();
@@ -3190,7 +3209,7 @@ namespace LaplataRayTracer
 		virtual void *Clone() { return (SimpleEllipsoid *)(new SimpleEllipsoid(*this)); }
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec)
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const
 		{
 			float x0 = inRay.O().X();
 			float y0 = inRay.O().Y();
@@ -3401,7 +3420,7 @@ namespace LaplataRayTracer
 		virtual void *Clone() { return (SimpleQuadratic *)(new SimpleQuadratic(*this)); }
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec)
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const
 		{
 			float x0 = inRay.O().X();
 			float y0 = inRay.O().Y();
@@ -3652,7 +3671,7 @@ namespace LaplataRayTracer
 		virtual void *Clone() { return (SimpleParaboloid *)(new SimpleParaboloid(*this)); }
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec)
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const
 		{
 			float x0 = inRay.O().X();
 			float y0 = inRay.O().Y();
@@ -3890,7 +3909,7 @@ namespace LaplataRayTracer
 		virtual void *Clone() { return (SimpleHyperboloid *)(new SimpleHyperboloid(*this)); }
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec)
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const
 		{
 			float x0 = inRay.O().X();
 			float y0 = inRay.O().Y();
@@ -4121,7 +4140,7 @@ namespace LaplataRayTracer
 	{
 	public:
 		CompoundObject()
-			: mnLastHitIdx(-1), mbAutoDelete(true)
+			: mbAutoDelete(true)
 		{
 
 		}
@@ -4149,7 +4168,7 @@ namespace LaplataRayTracer
 		virtual void *Clone() { return (CompoundObject *)(new CompoundObject(*this)); }
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec)
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const
 		{
 			Vec3f n;
 			Vec3f pt;
@@ -4158,14 +4177,14 @@ namespace LaplataRayTracer
 			bool bHitAnything = false;
 			Material *material = nullptr;
 			Color3f albedo;
+			int hitIdx = -1;
 
 			int numObject = GetCount();
-			mnLastHitIdx = 0;
 			for (int i = 0; i < numObject; ++i)
 			{
 				if (At(i)->HitTest(inRay, tmin, t, rec) && (t < tmax_copy))
 				{
-					mnLastHitIdx = i;
+					hitIdx = i;
 
 					bHitAnything = true;
 					tmax_copy = t;
@@ -4187,6 +4206,7 @@ namespace LaplataRayTracer
 			//	rec.pMaterial = nullptr;
 				rec.pMaterial = material;
 				rec.albedo = albedo;
+				rec.subIndex = hitIdx;
 			}
 
 			return bHitAnything;
@@ -4340,13 +4360,11 @@ namespace LaplataRayTracer
 		inline void SetObject(int idx, GeometricObject *obj) {
 			mvecObjects[idx] = obj;
 		}
-		inline int LastHit() const { return mnLastHitIdx; }
 
 		inline void EnableAutoDelete(bool enable) { mbAutoDelete = enable; }
 
 	protected:
 		vector<GeometricObject * >		mvecObjects;
-		int		mnLastHitIdx;
 		bool	mbAutoDelete;
 	};
 }
@@ -31,7 +31,7 @@ namespace LaplataRayTracer
 		virtual void *Clone() { return (Teardrop *)(new Teardrop(*this)); }
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec)
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const
 		{
 			Vec3f OC = inRay.O() - mCenter;
 
@@ -281,7 +281,7 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec)
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const
 		{
 			//
 			Vec3f vpos1 = inRay.O() - mCenter1;
@@ -608,7 +608,7 @@ namespace LaplataRayTracer
         }
 
     public:
-        virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) {
+        virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const {
             if (!mBBox.HitTest(inRay)) {
                 return false;
             }
@@ -918,7 +918,7 @@ namespace LaplataRayTracer
         }
 
     private:
-        inline Vec3f get_normal(const HitRecord& rec, int root_index, float root_s) {
+        inline Vec3f get_normal(const HitRecord& rec, int root_index, float root_s) const {
             float nx = rec.pt.X() - mCenter.X();
             float nz = rec.pt.Z() - mCenter.Z();
             float nu = -(mCV[1][root_index]+2.0*mCV[2][root_index]*root_s+3.0*mCV[3][root_index]*root_s*root_s);
@@ -972,7 +972,7 @@ namespace LaplataRayTracer
         }
 
     public:
-        virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) {
+        virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const {
             return CompoundObject::HitTest(inRay, tmin, tmax, rec);
         }
 
@@ -1080,7 +1080,7 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) {
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const {
 			return CompoundObject::HitTest(inRay, tmin, tmax, rec);
 		}
 
@@ -1192,7 +1192,7 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) {
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const {
 			return CompoundObject::HitTest(inRay, tmin, tmax, rec);
 		}
 
@@ -1303,7 +1303,7 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) {
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const {
 			return CompoundObject::HitTest(inRay, tmin, tmax, rec);
 		}
 
@@ -1402,7 +1402,7 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) {
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const {
 			return CompoundObject::HitTest(inRay, tmin, tmax, rec);
 		}
 
@@ -1513,7 +1513,7 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) {
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const {
 			return CompoundObject::HitTest(inRay, tmin, tmax, rec);
 		}
 
@@ -23,6 +23,7 @@ namespace LaplataRayTracer
 		float	v;
 		Color3f albedo;
 		Material *pMaterial;
+		int		subIndex; // the object hit within a CompoundObject, -1 otherwise
 
 		//
 		// ... ...
@@ -34,7 +35,7 @@ namespace LaplataRayTracer
 			u = 0.0f;
 			v = 0.0f;
 			pMaterial = nullptr;
-
+			subIndex = -1;
 		}
 
 	};
@@ -46,6 +47,7 @@ namespace LaplataRayTracer
 		bool is_specular;
 		Color3f albedo;
 		PDF *pPDF;
+		CosinePDF cosine_pdf; // the pdf of the diffuse hits lives here, the shared material isn't written.
 
 	};
 
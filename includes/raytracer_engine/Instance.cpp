@@ -11,6 +11,8 @@ namespace LaplataRayTracer {
 		mbAutoDelete = false;
 
         mbTransformTexture = true;
+
+		init_bounds_cache();
 	}
 
 	Instance::Instance(GeometricObject *ptrObj, bool autoDelete) {
@@ -18,6 +20,10 @@ namespace LaplataRayTracer {
 		mbAutoDelete = autoDelete;
 
 		mTransform.SetIdentity();
+
+		mbTransformTexture = true;
+
+		init_bounds_cache();
 	}
 
 	Instance::Instance(const Instance& rhs) {
@@ -46,7 +52,7 @@ namespace LaplataRayTracer {
 	}
 
 	//
-	bool Instance::HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) {
+	bool Instance::HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const {
 		Ray invRay = mTransform.InverseApplyRay(inRay);
 
 		if (mpProxyObject->HitTest(invRay, tmin, tmax, rec)) {
@@ -80,17 +86,28 @@ namespace LaplataRayTracer {
 	}
 
 	bool Instance::GetBoundingBox(float t0, float t1, AABB& bounding) {
-	//	if (!mpProxyObject->GetBoundingBox(t0, t1, bounding)) {
-	//		return false;
-	//	}
+		if (mbBoundsDirty || t0 != mfBoundsTime0 || t1 != mfBoundsTime1) {
+			update_bounding_box(t0, t1);
+		}
 
-	//	bounding = mBoundingBox;
-		this->ComputeBoundingBox();
-		bounding = mBoundingBox;
+		// an unbounded proxy (plane...) can't be culled by the scene BVH.
+		if (!mbBounded) {
+			return false;
+		}
 
+		bounding = mBoundingBox;
 		return true;
 	}
 
+	bool Instance::GetTransformedBoundingBox(Transform const& xform, float t0, float t1, AABB& bounding) {
+		// the nested instance: the proxy's vertices go through this transform first, then the outer one.
+		if (mbTightBounds) {
+			return mpProxyObject->GetTransformedBoundingBox(mTransform * xform, t0, t1, bounding);
+		}
+
+		return GeometricObject::GetTransformedBoundingBox(xform, t0, t1, bounding);
+	}
+
 	Vec3f Instance::GetNormal(const HitRecord& rec) const {
 		Vec3f n = mTransform.ApplyNormal(mpProxyObject->GetNormal(rec));
 		return n;
@@ -103,6 +120,9 @@ namespace LaplataRayTracer {
 
 	void Instance::Update(float t) {
 		mpProxyObject->Update(t);
+
+		// the proxy may have moved its vertices.
+		mbBoundsDirty = true;
 	}
 
 	bool Instance::IsCompound() const {
@@ -120,131 +140,80 @@ namespace LaplataRayTracer {
 	}
 
 	//
-	void Instance::ComputeBoundingBox() {
-		// Get the proxy object's bounding-box
-		AABB bounding_box;
-		mpProxyObject->GetBoundingBox(0.0f, 0.0f, bounding_box);
-
-		// Generate 8 points that are upon the bounding-box as its corners
-		Vec3f point_set[8] = { 0 };
-		point_set[0][0] = bounding_box.mX0; point_set[0][1] = bounding_box.mY0; point_set[0][2] = bounding_box.mZ0;
-		point_set[1][0] = bounding_box.mX1; point_set[1][1] = bounding_box.mY0; point_set[1][2] = bounding_box.mZ0;
-		point_set[2][0] = bounding_box.mX1; point_set[2][1] = bounding_box.mY1; point_set[2][2] = bounding_box.mZ0;
-		point_set[3][0] = bounding_box.mX0; point_set[3][1] = bounding_box.mY1; point_set[3][2] = bounding_box.mZ0;
-
-		point_set[4][0] = bounding_box.mX0; point_set[4][1] = bounding_box.mY0; point_set[4][2] = bounding_box.mZ1;
-		point_set[5][0] = bounding_box.mX1; point_set[5][1] = bounding_box.mY0; point_set[5][2] = bounding_box.mZ1;
-		point_set[6][0] = bounding_box.mX1; point_set[6][1] = bounding_box.mY1; point_set[6][2] = bounding_box.mZ1;
-		point_set[7][0] = bounding_box.mX0; point_set[7][1] = bounding_box.mY1; point_set[7][2] = bounding_box.mZ1;
-
-		// Transform on those 8 points to get the transformed point set
-		point_set[0] = mTransform.ApplyPoint(point_set[0]);
-		point_set[1] = mTransform.ApplyPoint(point_set[1]);
-		point_set[2] = mTransform.ApplyPoint(point_set[2]);
-		point_set[3] = mTransform.ApplyPoint(point_set[3]);
-		point_set[4] = mTransform.ApplyPoint(point_set[4]);
-		point_set[5] = mTransform.ApplyPoint(point_set[5]);
-		point_set[6] = mTransform.ApplyPoint(point_set[6]);
-		point_set[7] = mTransform.ApplyPoint(point_set[7]);
-
-		// Find the maximum and minimum points among those transformed point set
-		// Deal with the maximum point
-		float x0 = FLT_MAX;
-		float y0 = FLT_MAX;
-		float z0 = FLT_MAX;
-
-		for (int i = 0; i <= 7; ++i) {
-			if (point_set[i].X() < x0) {
-				x0 = point_set[i].X();
-			}
-		}
+	GeometricObject *Instance::GetBottomLevelObject() {
+		GeometricObject *object = mpProxyObject;
 
-		for (int i = 0; i <= 7; ++i) {
-			if (point_set[i].Y() < y0) {
-				y0 = point_set[i].Y();
-			}
+		Instance *nested = dynamic_cast<Instance *>(object);
+		while (nested != nullptr) {
+			object = nested->GetObject();
+			nested = dynamic_cast<Instance *>(object);
 		}
 
-		for (int i = 0; i <= 7; ++i) {
-			if (point_set[i].Z() < z0) {
-				z0 = point_set[i].Z();
-			}
-		}
+		return object;
+	}
 
-		// Deal with the minimum value
-		float x1 = -FLT_MAX;
-		float y1 = -FLT_MAX;
-		float z1 = -FLT_MAX;
+	//
+	void Instance::ComputeBoundingBox() {
+		update_bounding_box(0.0f, 0.0f);
+	}
 
-		for (int i = 0; i <= 7; ++i) {
-			if (point_set[i].X() > x1) {
-				x1 = point_set[i].X();
-			}
-		}
+	void Instance::InvalidateBoundingBox() {
+		mbBoundsDirty = true;
 
-		for (int i = 0; i <= 7; ++i) {
-			if (point_set[i].Y() > y1) {
-				y1 = point_set[i].Y();
-			}
+		Instance *nested = dynamic_cast<Instance *>(mpProxyObject);
+		if (nested != nullptr) {
+			nested->InvalidateBoundingBox();
 		}
+	}
 
-		for (int i = 0; i <= 7; ++i) {
-			if (point_set[i].Z() > z1) {
-				z1 = point_set[i].Z();
-			}
+	void Instance::EnableTightBounds(bool enable) {
+		if (mbTightBounds != enable) {
+			mbTightBounds = enable;
+			mbBoundsDirty = true;
 		}
-
-		// Since we get the maximum and minimum points, then generate the new Bounding-box which is transformed according to them.
-// 		bounding_box.mX0 = x0;
-// 		bounding_box.mY0 = y0;
-// 		bounding_box.mZ0 = z0;
-// 		bounding_box.mX1 = x1;
-// 		bounding_box.mY1 = y1;
-// 		bounding_box.mZ1 = z1;
-
-		mBoundingBox.mX0 = x0;
-		mBoundingBox.mY0 = y0;
-		mBoundingBox.mZ0 = z0;
-		mBoundingBox.mX1 = x1;
-		mBoundingBox.mY1 = y1;
-		mBoundingBox.mZ1 = z1;
-
 	}
 
 	//
 	void Instance::Translate(const Vec3f& p) {
 		Transform transTranslate = Transform::Translate(p);
 		mTransform = mTransform * transTranslate;
+		mbBoundsDirty = true;
 	}
 
 	void Instance::Translate(float x, float y, float z) {
 		Transform transTranslate = Transform::Translate(x, y, z);
 		mTransform = mTransform * transTranslate;
+		mbBoundsDirty = true;
 	}
 
     void Instance::Scale(float a, float b, float c) {
 	    Transform scale = Transform::Scale(a, b, c);
 	    mTransform = mTransform * scale;
+		mbBoundsDirty = true;
 	}
 
 	void Instance::RotateX(float angleX) {
 		Transform transRotateX = Transform::RotateX(angleX);
 		mTransform = mTransform * transRotateX;
+		mbBoundsDirty = true;
 	}
 
 	void Instance::RotateY(float angleY) {
 		Transform transRotateY = Transform::RotateY(angleY);
 		mTransform = mTransform * transRotateY;
+		mbBoundsDirty = true;
 	}
 
 	void Instance::RotateZ(float angleZ) {
 		Transform transRotateZ = Transform::RotateZ(angleZ);
 		mTransform = mTransform * transRotateZ;
+		mbBoundsDirty = true;
 	}
 
 	void Instance::Rotate(float angle, Vec3f& dir) {
 		Transform transRotate = Transform::Rotate(angle, dir);
 		mTransform = mTransform * transRotate;
+		mbBoundsDirty = true;
 	}
 
     void Instance::EnableTextureTransform(bool enable) {
@@ -254,8 +223,9 @@ namespace LaplataRayTracer {
 	//
 	void Instance::copy_constructor(Instance const& rhs)
 	{
-		if (rhs.mpProxyObject) {
-			mpProxyObject = (Instance *)rhs.mpProxyObject->Clone();
+		// only the owned proxy is cloned, the shared one is referred by the copy as well.
+		if (rhs.mpProxyObject && rhs.mbAutoDelete) {
+			mpProxyObject = (GeometricObject *)rhs.mpProxyObject->Clone();
 		}
 		else {
 			mpProxyObject = rhs.mpProxyObject;
@@ -263,10 +233,43 @@ namespace LaplataRayTracer {
 
 		mbAutoDelete = rhs.mbAutoDelete;
 		mBoundingBox = rhs.mBoundingBox;
+		mfBoundsTime0 = rhs.mfBoundsTime0;
+		mfBoundsTime1 = rhs.mfBoundsTime1;
+		mbBounded = rhs.mbBounded;
+		mbBoundsDirty = rhs.mbBoundsDirty;
+		mbTightBounds = rhs.mbTightBounds;
 		mTransform = rhs.mTransform;
+		mbTransformTexture = rhs.mbTransformTexture;
 
 	}
 
+	void Instance::init_bounds_cache()
+	{
+		mfBoundsTime0 = 0.0f;
+		mfBoundsTime1 = 0.0f;
+		mbBounded = false;
+		mbBoundsDirty = true;
+		mbTightBounds = false;
+	}
+
+	void Instance::update_bounding_box(float t0, float t1)
+	{
+		mfBoundsTime0 = t0;
+		mfBoundsTime1 = t1;
+		mbBoundsDirty = false;
+
+		if (mbTightBounds) {
+			mbBounded = mpProxyObject->GetTransformedBoundingBox(mTransform, t0, t1, mBoundingBox);
+			return;
+		}
+
+		AABB proxy_bounding;
+		mbBounded = mpProxyObject->GetBoundingBox(t0, t1, proxy_bounding);
+		if (mbBounded) {
+			mBoundingBox = mTransform.ApplyBox(proxy_bounding);
+		}
+	}
+
 	void Instance::release()
 	{
 		if (mbAutoDelete) {
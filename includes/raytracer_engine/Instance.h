@@ -19,13 +19,14 @@ namespace LaplataRayTracer {
 
 	public:
 		// From Hitable
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec);
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const;
 		virtual bool IntersectP(Ray const& inRay, float& tvalue) const;
 
 	public:
 		// From GeometricObject
 		virtual float Area() const;
 		virtual bool GetBoundingBox(float t0, float t1, AABB& bounding);
+		virtual bool GetTransformedBoundingBox(Transform const& xform, float t0, float t1, AABB& bounding);
 		virtual Vec3f GetNormal(const HitRecord& rec) const;
         virtual Vec3f SampleRandomPoint() const;
 		virtual void Update(float t);
@@ -38,6 +39,7 @@ namespace LaplataRayTracer {
 		{
 			mpProxyObject = ptrObj;
 			mbAutoDelete = autoDelete;
+			mbBoundsDirty = true;
 		}
 
 		inline GeometricObject *GetObject()
@@ -45,8 +47,25 @@ namespace LaplataRayTracer {
 			return mpProxyObject;
 		}
 
+		// false: the proxy object is shared with other instances (a mesh reused under different XForms),
+		// so the copies of this instance refer to the same proxy instead of cloning it.
+		inline bool OwnsObject() const
+		{
+			return mbAutoDelete;
+		}
+
+		// The innermost proxy object, through the nested instances.
+		GeometricObject *GetBottomLevelObject();
+
 	public:
+		// The world bounds are cached, changing the transform, the proxy (SetObject) or Update recompute them,
+		// InvalidateBoundingBox does it (for the nested instances too) after the proxy object has been changed by other means.
 		void ComputeBoundingBox();
+		void InvalidateBoundingBox();
+
+		// The tight bounds transform the proxy's vertices instead of the corners of its box, which fits the
+		// rotated meshes much better in the scene BVH, at a build-time cost of one pass over the vertices.
+		void EnableTightBounds(bool enable);
 
 		void Translate(const Vec3f& p);
 		void Translate(float x, float y, float z);
@@ -62,12 +81,19 @@ namespace LaplataRayTracer {
 
 	private:
 		void copy_constructor(Instance const& rhs);
+		void init_bounds_cache();
+		void update_bounding_box(float t0, float t1);
 		void release();
 
 	private:
 		GeometricObject *mpProxyObject;
 
 		AABB	mBoundingBox;
+		float	mfBoundsTime0;
+		float	mfBoundsTime1;
+		bool	mbBounded;
+		bool	mbBoundsDirty;
+		bool	mbTightBounds;
 
 	//	Matrix4x4 mInverseMatrix;
 	//	Matrix4x4 mForwardMatrix;
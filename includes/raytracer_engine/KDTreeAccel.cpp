@@ -0,0 +1,202 @@
+#include <chrono>
+#include <cmath>
+
+#include "Utility.h"
+#include "KDTreeAccel.h"
+
+namespace LaplataRayTracer
+{
+	//
+	inline static float box_min(AABB const& box, int axis) { return (axis == 0) ? box.mX0 : ((axis == 1) ? box.mY0 : box.mZ0); }
+	inline static float box_max(AABB const& box, int axis) { return (axis == 0) ? box.mX1 : ((axis == 1) ? box.mY1 : box.mZ1); }
+
+	inline static void set_box_min(AABB& box, int axis, float v) { if (axis == 0) { box.mX0 = v; } else if (axis == 1) { box.mY0 = v; } else { box.mZ0 = v; } }
+	inline static void set_box_max(AABB& box, int axis, float v) { if (axis == 0) { box.mX1 = v; } else if (axis == 1) { box.mY1 = v; } else { box.mZ1 = v; } }
+
+	//
+	KDTree::KDTree() {
+		mnMaxLeafPrims = 1;
+		mnMaxDepth = 0;
+		mfIntersectCost = 80.0f;
+		mfTraversalCost = 1.0f;
+		mfEmptyBonus = 0.5f;
+		mfBuildTime = 0.0f;
+	}
+
+	KDTree::~KDTree() {
+		Clear();
+	}
+
+	//
+	void KDTree::Build(vector<AABB> const& primBounds, int maxLeafPrims, int maxDepth) {
+		Clear();
+
+		int prim_count = (int)primBounds.size();
+		if (prim_count == 0) {
+			return;
+		}
+
+		std::chrono::high_resolution_clock::time_point start_time = std::chrono::high_resolution_clock::now();
+
+		mnMaxLeafPrims = std::max<int>(maxLeafPrims, 1);
+		mnMaxDepth = (maxDepth > 0) ? maxDepth : (int)std::round(8.0f + 1.3f * std::log2((float)prim_count));
+		mnMaxDepth = RTMath::Clamp(mnMaxDepth, 1, KDTree::MAX_DEPTH - 1);
+
+		mBounds = primBounds[0];
+		for (int i = 1; i < prim_count; ++i) {
+			mBounds = AABB::SurroundingBox(mBounds, primBounds[i]);
+		}
+
+		// the edges of all the primitives along the 3 axes, the primitive lists of the below children
+		// are rewritten in place level by level, the above ones need a slice per level.
+		BuildContext ctx;
+		ctx.prim_bounds = &primBounds;
+		ctx.prim_count = prim_count;
+		for (int axis = 0; axis < 3; ++axis) {
+			ctx.edges[axis].resize(2 * prim_count);
+		}
+		ctx.below_prims.resize(prim_count);
+		ctx.above_prims.resize((mnMaxDepth + 1) * prim_count);
+
+		for (int i = 0; i < prim_count; ++i) {
+			ctx.below_prims[i] = i;
+		}
+
+		build_recursive(ctx, mBounds, &ctx.below_prims[0], prim_count, mnMaxDepth, &ctx.above_prims[0], 0);
+
+		std::chrono::duration<float> build_time = std::chrono::high_resolution_clock::now() - start_time;
+		mfBuildTime = build_time.count();
+	}
+
+	void KDTree::Clear() {
+		mvecNodes.clear();
+		mvecPrimIndices.clear();
+	}
+
+	void KDTree::SetCosts(float intersectCost, float traversalCost, float emptyBonus) {
+		mfIntersectCost = intersectCost;
+		mfTraversalCost = traversalCost;
+		mfEmptyBonus = RTMath::Clamp(emptyBonus, 0.0f, 1.0f);
+	}
+
+	size_t KDTree::MemoryUsage() const {
+		return sizeof(KDTree) + mvecNodes.capacity() * sizeof(KDNode) + mvecPrimIndices.capacity() * sizeof(int);
+	}
+
+	//
+	// prims may point into the slice of the parent's above primitives, so the below list of the children
+	// overwrites the below list at the front of ctx.below_prims only after the above list has been copied away.
+	void KDTree::build_recursive(BuildContext& ctx, AABB const& nodeBounds, const int *prims, int primCount,
+		int depth, int *aboveSlice, int badRefines) {
+		if (primCount <= mnMaxLeafPrims || depth == 0) {
+			make_leaf(prims, primCount);
+			return;
+		}
+
+		vector<AABB> const& prim_bounds = *ctx.prim_bounds;
+
+		// the SAH upon the box edges, along the longest axis first, the others if it finds no split.
+		float extent[3] = { nodeBounds.mX1 - nodeBounds.mX0, nodeBounds.mY1 - nodeBounds.mY0, nodeBounds.mZ1 - nodeBounds.mZ0 };
+		float total_area = 2.0f * (extent[0] * extent[1] + extent[1] * extent[2] + extent[2] * extent[0]);
+		float inv_total_area = (total_area > 0.0f) ? (1.0f / total_area) : 0.0f;
+		float old_cost = mfIntersectCost * primCount;
+
+		int best_axis = -1;
+		int best_offset = -1;
+		float best_cost = FLT_MAX;
+
+		int axis = (extent[0] > extent[1] && extent[0] > extent[2]) ? 0 : ((extent[1] > extent[2]) ? 1 : 2);
+		for (int retries = 0; retries < 3 && best_axis < 0; ++retries, axis = (axis + 1) % 3) {
+			vector<BoundEdge>& edges = ctx.edges[axis];
+			for (int i = 0; i < primCount; ++i) {
+				AABB const& box = prim_bounds[prims[i]];
+				edges[2 * i].t = box_min(box, axis);
+				edges[2 * i].prim = prims[i];
+				edges[2 * i].starting = true;
+				edges[2 * i + 1].t = box_max(box, axis);
+				edges[2 * i + 1].prim = prims[i];
+				edges[2 * i + 1].starting = false;
+			}
+			std::sort(edges.begin(), edges.begin() + 2 * primCount);
+
+			int other0 = (axis + 1) % 3, other1 = (axis + 2) % 3;
+			float node_min = box_min(nodeBounds, axis), node_max = box_max(nodeBounds, axis);
+
+			int below_count = 0, above_count = primCount;
+			for (int i = 0; i < 2 * primCount; ++i) {
+				if (!edges[i].starting) { --above_count; }
+
+				float t = edges[i].t;
+				if (t > node_min && t < node_max) {
+					float below_area = 2.0f * (extent[other0] * extent[other1] + (t - node_min) * (extent[other0] + extent[other1]));
+					float above_area = 2.0f * (extent[other0] * extent[other1] + (node_max - t) * (extent[other0] + extent[other1]));
+					float p_below = below_area * inv_total_area;
+					float p_above = above_area * inv_total_area;
+					float bonus = (below_count == 0 || above_count == 0) ? mfEmptyBonus : 0.0f;
+					float cost = mfTraversalCost + mfIntersectCost * (1.0f - bonus) * (p_below * below_count + p_above * above_count);
+
+					if (cost < best_cost) {
+						best_cost = cost;
+						best_axis = axis;
+						best_offset = i;
+					}
+				}
+
+				if (edges[i].starting) { ++below_count; }
+			}
+		}
+
+		// give the poor splits a few chances, the cheaper ones may be found further down.
+		if (best_cost > old_cost) {
+			++badRefines;
+		}
+		if (best_axis < 0 || badRefines == 3 || (best_cost > 4.0f * old_cost && primCount < 16)) {
+			make_leaf(prims, primCount);
+			return;
+		}
+
+		// the axes are tried until one has a split, so the edges of best_axis are the last ones sorted.
+		vector<BoundEdge>& edges = ctx.edges[best_axis];
+
+		int above_count = 0;
+		for (int i = best_offset + 1; i < 2 * primCount; ++i) {
+			if (!edges[i].starting) { aboveSlice[above_count++] = edges[i].prim; }
+		}
+
+		int below_count = 0;
+		for (int i = 0; i < best_offset; ++i) {
+			if (edges[i].starting) { ctx.below_prims[below_count++] = edges[i].prim; }
+		}
+
+		float split = edges[best_offset].t;
+		AABB below_bounds = nodeBounds, above_bounds = nodeBounds;
+		set_box_max(below_bounds, best_axis, split);
+		set_box_min(above_bounds, best_axis, split);
+
+		int node_index = (int)mvecNodes.size();
+		mvecNodes.push_back(KDNode());
+
+		build_recursive(ctx, below_bounds, &ctx.below_prims[0], below_count, depth - 1, aboveSlice + ctx.prim_count, badRefines);
+
+		KDNode& interior = mvecNodes[node_index];
+		interior.mfSplit = split;
+		interior.mnFlags = (unsigned int)best_axis | ((unsigned int)mvecNodes.size() << 2);
+
+		build_recursive(ctx, above_bounds, aboveSlice, above_count, depth - 1, aboveSlice + ctx.prim_count, badRefines);
+	}
+
+	void KDTree::make_leaf(const int *prims, int primCount) {
+		KDNode leaf;
+		leaf.mnFlags = 3 | ((unsigned int)primCount << 2);
+
+		if (primCount <= 1) {
+			leaf.mnOnePrim = (primCount == 1) ? prims[0] : -1;
+		}
+		else {
+			leaf.mnPrimOffset = (int)mvecPrimIndices.size();
+			mvecPrimIndices.insert(mvecPrimIndices.end(), prims, prims + primCount);
+		}
+
+		mvecNodes.push_back(leaf);
+	}
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include "Common.h"
+#include "Vec3.h"
+#include "Ray.h"
+#include "AABB.h"
+#include "BVHAccel.h"
+
+namespace LaplataRayTracer
+{
+	//-----------------------------------------------------------------
+	// KDNode is 8 bytes: the split position of an interior node or the primitives of a leaf, and one word
+	// whose low 2 bits are the split axis (3 for a leaf), the high 30 bits are the primitive count of a leaf
+	// or the above child of an interior node. The below child of an interior node is always the next node.
+	// A leaf with one primitive keeps its index in the node itself, the others point into the index list.
+	//-----------------------------------------------------------------
+	struct KDNode
+	{
+		union {
+			float	mfSplit;		// interior: the split plane
+			int		mnOnePrim;		// leaf of one primitive: its index
+			int		mnPrimOffset;	// leaf of more: the first slot in the primitive index list
+		};
+		unsigned int	mnFlags;
+
+		inline bool IsLeaf() const { return (mnFlags & 3) == 3; }
+		inline int SplitAxis() const { return (int)(mnFlags & 3); }
+		inline int PrimCount() const { return (int)(mnFlags >> 2); }
+		inline int AboveChild() const { return (int)(mnFlags >> 2); }
+	};
+
+	//
+	// The SAH kd-tree upon the primitive bounding-boxes, the split candidates are the box edges along each axis.
+	// Unlike the BVH a primitive may be referenced by several leaves, but the leaves don't overlap, so the
+	// front-to-back traversal stops as soon as a hit lies within the leaf being visited.
+	// The user maps the leaves back to its own primitives via LeafPrims.
+	class KDTree
+	{
+	public:
+		KDTree();
+		~KDTree();
+
+	public:
+		// maxDepth 0 picks 8 + 1.3 log2(n), the usual limit of the kd-trees.
+		void Build(vector<AABB> const& primBounds, int maxLeafPrims = 1, int maxDepth = 0);
+		void Clear();
+
+		// The SAH costs: a primitive test against a traversal step, and the bonus of the splits cutting off empty space.
+		void SetCosts(float intersectCost, float traversalCost, float emptyBonus);
+
+		inline float BuildTime() const { return mfBuildTime; }
+		size_t MemoryUsage() const;
+
+	public:
+		inline bool IsEmpty() const { return mvecNodes.empty(); }
+		inline int NodeCount() const { return (int)mvecNodes.size(); }
+		inline const vector<KDNode>& GetNodes() const { return mvecNodes; }
+		inline AABB const& Bounds() const { return mBounds; }
+
+		inline const int *LeafPrims(KDNode const& leaf) const {
+			return (leaf.PrimCount() <= 1) ? &leaf.mnOnePrim : &mvecPrimIndices[leaf.mnPrimOffset];
+		}
+
+	public:
+		// Walks the leaves pierced by the ray within [tmin, tmax] front to back. leafFn(leaf, tmax) tests the leaf's
+		// primitives and shrinks tmax to its closest hit, returning true ends the walk at once (the any-hit queries).
+		// The walk also ends once tmax is nearer than the next leaf, returns true if leafFn ended it.
+		template <typename LeafFn>
+		bool Traverse(Ray const& ray, float tmin, float& tmax, LeafFn leafFn) const {
+			float t0, t1;
+			if (mvecNodes.empty() || !clip_ray(ray, tmin, tmax, t0, t1)) {
+				return false;
+			}
+
+			Vec3f const& o = ray.O();
+			Vec3f const& inv_d = ray.InvD();
+
+			TodoItem todo[KDTree::MAX_DEPTH];
+			int todo_count = 0;
+			int node_index = 0;
+
+			while (true) {
+				KDNode const& node = mvecNodes[node_index];
+				BVHTree::CountNodeFetch(&node);
+
+				if (!node.IsLeaf()) {
+					int axis = node.SplitAxis();
+					float t_plane = (node.mfSplit - o[axis]) * inv_d[axis];
+
+					// the child on the origin's side comes first, the one upon the plane follows its direction.
+					bool below_first = (o[axis] < node.mfSplit) || (o[axis] == node.mfSplit && ray.Sign(axis) != 0);
+					int first = below_first ? node_index + 1 : node.AboveChild();
+					int second = below_first ? node.AboveChild() : node_index + 1;
+
+					if (!(t_plane <= t1) || t_plane <= 0.0f) {
+						node_index = first;
+					}
+					else if (t_plane < t0) {
+						node_index = second;
+					}
+					else {
+						todo[todo_count].node = second;
+						todo[todo_count].tmin = t_plane;
+						todo[todo_count].tmax = t1;
+						++todo_count;
+
+						node_index = first;
+						t1 = t_plane;
+					}
+				}
+				else {
+					if (leafFn(node, tmax)) {
+						return true;
+					}
+
+					// the rest of the leaves are farther than the hit found so far.
+					if (todo_count == 0 || todo[todo_count - 1].tmin > tmax) { break; }
+					--todo_count;
+					node_index = todo[todo_count].node;
+					t0 = todo[todo_count].tmin;
+					t1 = todo[todo_count].tmax;
+				}
+			}
+
+			return false;
+		}
+
+	public:
+		static const int MAX_DEPTH = 64;
+
+	private:
+		struct TodoItem {
+			int		node;
+			float	tmin;
+			float	tmax;
+		};
+
+		struct BoundEdge {
+			float	t;
+			int		prim;
+			bool	starting;
+
+			inline bool operator<(BoundEdge const& other) const {
+				// at the same position the starting edges go first, so a split there has its primitive above.
+				return (t == other.t) ? (starting && !other.starting) : (t < other.t);
+			}
+		};
+
+		struct BuildContext {
+			vector<AABB> const *	prim_bounds;
+			vector<BoundEdge>		edges[3];
+			vector<int>				below_prims;
+			vector<int>				above_prims;	// maxDepth + 1 slices of the primitive count
+			int						prim_count;
+		};
+
+	private:
+		void build_recursive(BuildContext& ctx, AABB const& nodeBounds, const int *prims, int primCount,
+			int depth, int *aboveSlice, int badRefines);
+		void make_leaf(const int *prims, int primCount);
+
+		inline bool clip_ray(Ray const& ray, float tmin, float tmax, float& t0, float& t1) const {
+			Vec3f const& o = ray.O();
+			Vec3f const& inv_d = ray.InvD();
+			const float bounds[6] = { mBounds.mX0, mBounds.mX1, mBounds.mY0, mBounds.mY1, mBounds.mZ0, mBounds.mZ1 };
+
+			t0 = tmin;
+			t1 = tmax;
+			for (int axis = 0; axis < 3; ++axis) {
+				float near_t = (bounds[2 * axis + ray.Sign(axis)] - o[axis]) * inv_d[axis];
+				float far_t = (bounds[2 * axis + 1 - ray.Sign(axis)] - o[axis]) * inv_d[axis];
+				t0 = std::max<float>(t0, near_t);
+				t1 = std::min<float>(t1, far_t);
+			}
+
+			return (t0 <= t1);
+		}
+
+	private:
+		vector<KDNode>	mvecNodes;
+		vector<int>		mvecPrimIndices;
+		AABB			mBounds;
+		int				mnMaxLeafPrims;
+		int				mnMaxDepth;
+		float			mfIntersectCost;
+		float			mfTraversalCost;
+		float			mfEmptyBonus;
+		float			mfBuildTime;
+
+	};
+}
@@ -12,6 +12,25 @@
 
 namespace LaplataRayTracer
 {
+	//
+	// A light sampled from a shading point: the light keeps nothing of the query, so any number of threads may
+	// shade against it, and the samples of a batch can be kept side by side.
+	struct LightSample {
+		Vec3f	pt;			// upon the light
+		Vec3f	n;			// the light's normal at pt
+		Vec3f	wi;			// unit, from the shading point towards pt
+		float	dist;		// to pt, the shadow rays stop there; FLT_MAX for the lights at infinity
+		float	g;			// the geometry term of the area lights, 1 for the others
+		float	pdf;		// of pt, 1 for the lights of a single point or direction
+		Color3f	L;			// the incident radiance along -wi
+
+		LightSample()
+			: pt(WORLD_ORIGIN), n(WORLD_ORIGIN), wi(WORLD_ORIGIN), dist(FLT_MAX), g(1.0f), pdf(1.0f), L(BLACK) {
+
+		}
+	};
+
+	//
 	class Light : public ICloneable {
 	public:
 		Light() {
@@ -28,28 +47,19 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		virtual Vec3f GetDirection(const HitRecord& hitRec) {
-			return WORLD_ORIGIN;
-		}
-
-		virtual Color3f Li(HitRecord& hitRec, SceneObjects& sceneObjects) const {
-			return Color3f(0.0f, 0.0f, 0.0f);
-		}
-
-		virtual float G(const HitRecord& hitRec) const {
-			return 1.0f;
-		}
-
-		virtual float Pdf(const HitRecord& hitRec) const {
-			return 1.0f;
+		// The light as seen from the hit point, the estimators take L * g / pdf of it.
+		virtual LightSample Sample(const HitRecord& /*hitRec*/, SceneObjects& /*sceneObjects*/) const {
+			return LightSample();
 		}
 
 		virtual bool CastShadow() const {
 			return false;
 		}
 
-		virtual bool ShadowHit(Ray const& shadowRay, SceneObjects const& sceneObjects) const {
-			return false;
+		// Whether the shadow ray towards the sample is blocked before it, up to sample.dist: the blockers behind
+		// the light don't count.
+		virtual bool ShadowHit(Ray const& shadowRay, LightSample const& sample, SceneObjects const& sceneObjects) const {
+			return sceneObjects.Occluded(shadowRay, sample.dist);
 		}
 	};
 
@@ -76,10 +86,7 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		virtual Vec3f GetDirection(const HitRecord& hitRec) {
-			return WORLD_ORIGIN;
-		}
-
+		// The ambient lights are not sampled, the materials take their radiance as is.
 		virtual Color3f Li(HitRecord& hitRec, SceneObjects& sceneObjects) const {
 			return mLs * mLc;
 		}
@@ -159,10 +166,6 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		virtual Vec3f GetDirection(const HitRecord& hitRec){
-			return WORLD_ORIGIN;
-		}
-
 		virtual Color3f Li(HitRecord& hitRec, SceneObjects& sceneObjects) const {
 			Color3f L;
 
@@ -184,7 +187,7 @@ namespace LaplataRayTracer
 			Ray ambient_occ_ray = Ray(hitRec.wpt, ambient_occ_dir, 0.0f);
 
 			// 5. calculate the L according to the fact if the outgoing ray is hit some object
-			bool is_hit = ShadowHit(ambient_occ_ray, sceneObjects);
+			bool is_hit = occluded(ambient_occ_ray, sceneObjects);
 			if (is_hit) {
 				L = mFraction * mLs * mLc;
 			}
@@ -195,21 +198,6 @@ namespace LaplataRayTracer
 			return L;
 		}
 
-		virtual bool ShadowHit(Ray const& shadowRay, SceneObjects const& sceneObjects) const {
-			bool isHit = false;
-
-			int count = (int)sceneObjects.size();
-			for (int i = 0; i < count; ++i) {
-				float tvalue = -FLT_MAX;
-				if (sceneObjects[i]->IntersectP(shadowRay, tvalue)) {
-					isHit = true;
-					break;
-				}
-			}
-
-			return isHit;
-		}
-
 	public:
 		inline void SetFraction(float f) {
 			mFraction = f;
@@ -225,6 +213,12 @@ namespace LaplataRayTracer
 			mpSampler->MapSamplesToHemiShpere(exp);
 		}
 
+	private:
+		// the occlusion rays have no end, unlike the shadow rays of ShadowHit.
+		inline bool occluded(Ray const& occRay, SceneObjects const& sceneObjects) const {
+			return sceneObjects.Occluded(occRay, FLT_MAX);
+		}
+
 	private:
 		float	mFraction;
 		SamplerBase *	mpSampler;
@@ -254,33 +248,17 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		virtual Vec3f GetDirection(const HitRecord& hitRec) {
-			return mDir;
-		}
-
-		virtual Color3f Li(HitRecord& hitRec, SceneObjects& sceneObjects) const {
-			return mLs * mLc;
+		virtual LightSample Sample(const HitRecord& /*hitRec*/, SceneObjects& /*sceneObjects*/) const {
+			LightSample sample;
+			sample.wi = mDir;
+			sample.L = mLs * mLc;
+			return sample;
 		}
 
 		virtual bool CastShadow() const {
 			return mShadow;
 		}
 
-		virtual bool ShadowHit(Ray const& shadowRay, SceneObjects const& sceneObjects) const {
-			bool isHit = false;
-
-			int count = (int)sceneObjects.size();
-			for (int i = 0; i < count; ++i) {
-				float tvalue = -FLT_MAX;
-				if (sceneObjects[i]->IntersectP(shadowRay, tvalue)) {
-					isHit = true;
-					break;
-				}
-			}
-
-			return isHit;
-		}
-
 	public:
 		inline void SetDirection(const Vec3f& dir) {
 			mDir = dir;
@@ -346,43 +324,27 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		virtual Vec3f GetDirection(const HitRecord& hitRec) {
-			Vec3f vecDir = (mLightPos - hitRec.wpt);
-			vecDir.MakeUnit();
-			return vecDir;
-		}
+		virtual LightSample Sample(const HitRecord& hitRec, SceneObjects& /*sceneObjects*/) const {
+			LightSample sample;
+			sample.pt = mLightPos;
+			sample.wi = (mLightPos - hitRec.wpt);
+			sample.dist = sample.wi.Length();
+			sample.wi.MakeUnit();
 
-		virtual Color3f Li(HitRecord& hitRec, SceneObjects& sceneObjects) const {
 			if (mDistAttenu) {
-				Vec3f vecDir = (mLightPos - hitRec.wpt);
-				return ((mLs * mLc) / std::pow(vecDir.Length(), mDistAttenuParam));
+				sample.L = ((mLs * mLc) / std::pow(sample.dist, mDistAttenuParam));
+			}
+			else {
+				sample.L = (mLs * mLc);
 			}
 
-			return (mLs * mLc);
+			return sample;
 		}
 
 		virtual bool CastShadow() const {
 			return mShadow;
 		}
 
-		virtual bool ShadowHit(Ray const& shadowRay, SceneObjects const& sceneObjects) const {
-			bool isHit = false;
-
-			int count = (int)sceneObjects.size();
-			for (int i = 0; i < count; ++i) {
-				float tvalue = -FLT_MAX;
-				if (sceneObjects[i]->IntersectP(shadowRay, tvalue)) {
-					float dist = shadowRay.O().Distance(mLightPos);
-					if (tvalue < dist) {
-						isHit = true;
-						break;
-					}
-				}
-			}
-
-			return isHit;
-		}
-
 	public:
 		inline void SetPosition(const Vec3f& lightPos) {
 			mLightPos = lightPos;
@@ -436,16 +398,12 @@ namespace LaplataRayTracer
 	class AreaLight : public Light {
 	public:
 		AreaLight()
-			: mLightNormal(WORLD_ORIGIN), 
-			mSamplePoint(WORLD_ORIGIN), mWi(WORLD_ORIGIN), 
-			mpLightShape(nullptr), mShadow(true) {
+			: mpLightShape(nullptr), mShadow(true) {
 
 		}
 
 		AreaLight(AreaLight const& rhs)
-			: mLightNormal(rhs.mLightNormal),
-			  mSamplePoint(rhs.mSamplePoint), mWi(rhs.mWi),
-			  mpLightShape(rhs.mpLightShape), mShadow(rhs.mShadow) {
+			: mpLightShape(rhs.mpLightShape), mShadow(rhs.mShadow) {
 
 		}
 
@@ -454,9 +412,6 @@ namespace LaplataRayTracer
 				return *this;
 			}
 
-			this->mLightNormal = rhs.mLightNormal;
-			this->mSamplePoint = rhs.mSamplePoint;
-			this->mWi = rhs.mWi;
 			this->mpLightShape = rhs.mpLightShape;
 			this->mShadow = rhs.mShadow;
 
@@ -473,55 +428,28 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		virtual Vec3f GetDirection(const HitRecord& hitRec) {
-			mLightNormal = mpLightShape->GetNormal(hitRec);
+		virtual LightSample Sample(const HitRecord& hitRec, SceneObjects& /*sceneObjects*/) const {
+			LightSample sample;
+			sample.n = mpLightShape->GetNormal(hitRec);
 
-            mSamplePoint = mpLightShape->SampleRandomPoint();
-			mWi = mSamplePoint - hitRec.wpt;
-			mWi.MakeUnit();
+            sample.pt = mpLightShape->SampleRandomPoint();
+			sample.wi = sample.pt - hitRec.wpt;
+			float d2 = sample.wi.SquareLength();
+			sample.dist = std::sqrt(d2);
+			sample.wi.MakeUnit();
 
-			return mWi;
-		}
+			float ndotd = Dot(-sample.n, sample.wi);
+			sample.g = (ndotd / d2);
+			sample.pdf = 1.0f / mpLightShape->Area();
+			sample.L = emitted_radiance(sample);
 
-		virtual Color3f Li(HitRecord& hitRec, SceneObjects& sceneObjects) const {
-			return BLACK;
-		}
-
-		virtual float G(const HitRecord& hitRec) const {
-			float ndotd = Dot(-mLightNormal, mWi);
-			float d2 = mSamplePoint.SquareDistance(hitRec.wpt);
-			return (ndotd / d2);
-		}
-
-		virtual float Pdf(const HitRecord& hitRec) const {
-			float area = mpLightShape->Area();
-			return 1.0f / area;
+			return sample;
 		}
 
 		virtual bool CastShadow() const {
 			return mShadow;
 		}
 
-		virtual bool ShadowHit(Ray const& shadowRay, SceneObjects const& sceneObjects) const {
-			bool isHit = false;
-
-			int count = (int)sceneObjects.size();
-			for (int i = 0; i < count; ++i) {
-				float tvalue = -FLT_MAX;
-				if (sceneObjects[i]->IntersectP(shadowRay, tvalue)) {
-				//	Vec3f oa = (mSamplePoint - shadowRay.O());
-				//	float dist = Dot(oa, shadowRay.D());
-					float dist = shadowRay.O().Distance(mSamplePoint);
-					if (tvalue < dist) {
-						isHit = true;
-						break;
-					}
-				}
-			}
-
-			return isHit;
-		}
-
 	public:
 		inline void SetLightShapeObject(GeometricObject *lightShapeObject) {
 			mpLightShape = lightShapeObject;
@@ -532,9 +460,12 @@ namespace LaplataRayTracer
 		}
 
 	protected:
-		Vec3f	mLightNormal;
-		Vec3f	mSamplePoint;
-		Vec3f	mWi;
+		// The radiance the light sends from sample.pt along -sample.wi.
+		virtual Color3f emitted_radiance(LightSample const& /*sample*/) const {
+			return BLACK;
+		}
+
+	protected:
 		GeometricObject *mpLightShape;
 		bool	mShadow;
 
@@ -578,9 +509,9 @@ namespace LaplataRayTracer
 			return (new AreaConstLight(*this));
 		}
 
-	public:
-		virtual Color3f Li(HitRecord& hitRec, SceneObjects& sceneObjects) const {
-			float ndotwi = Dot(-mLightNormal, mWi);
+	protected:
+		virtual Color3f emitted_radiance(LightSample const& sample) const {
+			float ndotwi = Dot(-sample.n, sample.wi);
 			if (ndotwi > 0.0f) {
 				return mLAs * mLAc;
 			}
@@ -641,13 +572,13 @@ namespace LaplataRayTracer
 			return (new AreaTextureLight(*this));
 		}
 
-	public:
-		virtual Color3f Li(HitRecord& hitRec, SceneObjects& sceneObjects) const {
-			float widotn = Dot(-mLightNormal, mWi);
+	protected:
+		virtual Color3f emitted_radiance(LightSample const& sample) const {
+			float widotn = Dot(-sample.n, sample.wi);
 			if (widotn > 0.0f) {
 				HitRecord hitRecForSamplePoint;
-				hitRecForSamplePoint.pt = mSamplePoint;
-				hitRecForSamplePoint.n = mLightNormal;
+				hitRecForSamplePoint.pt = sample.pt;
+				hitRecForSamplePoint.n = sample.n;
 				return (mLAs * mpLAc->GetTextureColor(hitRecForSamplePoint));
 			}
 			
@@ -668,15 +599,15 @@ namespace LaplataRayTracer
 	class EnvironmentLight : public Light {
 	public:
 		EnvironmentLight()
-			: mShadow(true), mWi(WORLD_ORIGIN), mpSampler(nullptr) {
+			: mShadow(true), mpSampler(nullptr) {
 
 		}
 
 		EnvironmentLight(EnvironmentLight const& rhs)
-			: mShadow(rhs.mShadow), mWi(rhs.mWi) {
-			if (mpSampler != nullptr) { delete mpSampler; mpSampler = nullptr; }
-
-			mpSampler = (SamplerBase *)rhs.mpSampler->Clone();
+			: mShadow(rhs.mShadow), mpSampler(nullptr) {
+			if (rhs.mpSampler) {
+				mpSampler = (SamplerBase *)rhs.mpSampler->Clone();
+			}
 		}
 
 		EnvironmentLight& operator=(EnvironmentLight const& rhs) {
@@ -685,7 +616,6 @@ namespace LaplataRayTracer
 			}
 
 			this->mShadow = rhs.mShadow;
-			this->mWi = rhs.mWi;
 			
 			if (mpSampler) { delete mpSampler; mpSampler = nullptr; }
 			if (rhs.mpSampler) {
@@ -705,50 +635,29 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		virtual Vec3f GetDirection(const HitRecord& hitRec) {
+		// pt is the direction before its normalization, the texture lights look it up.
+		virtual LightSample Sample(const HitRecord& hitRec, SceneObjects& /*sceneObjects*/) const {
 			Vec3f W = hitRec.n;
 			Vec3f V = Cross(W, Vec3f(0.0072f, 1.0f, 0.0034f));
 			V.MakeUnit();
 			Vec3f U = Cross(V, W);
 
-			mSamplePoint = mpSampler->SampleFromHemishpere();
-			mWi = mSamplePoint.X() * U + mSamplePoint.Y() * V + mSamplePoint.Z() * W;
-			mSamplePoint = mWi;
-			mWi.MakeUnit();
-			return mWi;
-		}
-
-		virtual Color3f Li(HitRecord& hitRec, SceneObjects& sceneObjects) const {
-			return BLACK;
-		}
-
-		virtual float G(const HitRecord& hitRec) const {
-			return 1.0f;
-		}
+			LightSample sample;
+			Vec3f sample_point = mpSampler->SampleFromHemishpere();
+			sample.wi = sample_point.X() * U + sample_point.Y() * V + sample_point.Z() * W;
+			sample.pt = sample.wi;
+			sample.wi.MakeUnit();
+			sample.n = -sample.wi;
+			sample.pdf = (Dot(sample.wi, hitRec.n) * INV_PI_CONST);
+			sample.L = emitted_radiance(sample);
 
-		virtual float Pdf(const HitRecord& hitRec) const {
-			return (Dot(mWi, hitRec.n) * INV_PI_CONST);
+			return sample;
 		}
 
 		virtual bool CastShadow() const {
 			return mShadow;
 		}
 
-		virtual bool ShadowHit(Ray const& shadowRay, SceneObjects const& sceneObjects) const {
-			bool isHit = false;
-
-			int count = (int)sceneObjects.size();
-			for (int i = 0; i < count; ++i) {
-				float tvalue = -FLT_MAX;
-				if (sceneObjects[i]->IntersectP(shadowRay, tvalue)) {
-					isHit = true;
-					break;
-				}
-			}
-
-			return isHit;
-		}
-
 	public:
 		inline void EnableShadow(bool enable) {
 			mShadow = enable;
@@ -758,10 +667,13 @@ namespace LaplataRayTracer
 			mpSampler = sampler;
 		}
 
+	protected:
+		virtual Color3f emitted_radiance(LightSample const& /*sample*/) const {
+			return BLACK;
+		}
+
 	protected:
 		bool mShadow;
-		Vec3f mWi;
-		Vec3f mSamplePoint;
 		SamplerBase *mpSampler;
 
 	};
@@ -805,8 +717,8 @@ namespace LaplataRayTracer
 			return (new EnvironmentConstLight(*this));
 		}
 
-	public:
-		virtual Color3f Li(HitRecord& hitRec, SceneObjects& sceneObjects) const {
+	protected:
+		virtual Color3f emitted_radiance(LightSample const& /*sample*/) const {
 			return mLEs * mLEc;
 		}
 
@@ -869,11 +781,11 @@ namespace LaplataRayTracer
 			return (new EnvrionmentTextureLight(*this));
 		}
 
-	public:
-		virtual Color3f Li(HitRecord& hitRec, SceneObjects& sceneObjects) const {
+	protected:
+		virtual Color3f emitted_radiance(LightSample const& sample) const {
 			HitRecord hitRecForSamplePoint;
-			hitRecForSamplePoint.pt = mSamplePoint;
-			hitRecForSamplePoint.n = mSamplePoint;
+			hitRecForSamplePoint.pt = sample.pt;
+			hitRecForSamplePoint.n = sample.pt;
 			Color3f col = mLEs * mpLEc->GetTextureColor(hitRecForSamplePoint);
 			return col;
 		}
@@ -917,17 +829,26 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		virtual Vec3f GetDirection(const HitRecord& hitRec) {
-			mSurfaceDir = mLightPos - hitRec.wpt;
-			mSurfaceDir.MakeUnit();
-			return mSurfaceDir;
+		virtual LightSample Sample(const HitRecord& hitRec, SceneObjects& /*sceneObjects*/) const {
+			LightSample sample;
+			sample.pt = mLightPos;
+			sample.wi = mLightPos - hitRec.wpt;
+			sample.dist = sample.wi.Length();
+			sample.wi.MakeUnit();
+			sample.L = radiance(sample.wi, sample.dist);
+
+			return sample;
 		}
 
-		virtual Color3f Li(HitRecord& hitRec, SceneObjects& sceneObjects) const {
+		virtual bool CastShadow() const {
+			return mCastShadow;
+		}
+
+	private:
+		inline Color3f radiance(Vec3f const& wi, float dist) const {
 			Color3f L;
 
-			float dist = hitRec.wpt.Distance(mLightPos);
-			float sdotdir = Dot(-mSurfaceDir, mLightDir);
+			float sdotdir = Dot(-wi, mLightDir);
 			if (sdotdir < mHalfCosPenumbraRad) {
 				L.Set(0.0f, 0.0f, 0.0f);
 			}
@@ -949,36 +870,6 @@ namespace LaplataRayTracer
 			return L;
 		}
 
-		virtual float G(const HitRecord& hitRec) const {
-			return 1.0f;
-		}
-
-		virtual float Pdf(const HitRecord& hitRec) const {
-			return 1.0f;
-		}
-
-		virtual bool CastShadow() const {
-			return mCastShadow;
-		}
-
-		virtual bool ShadowHit(Ray const& shadowRay, SceneObjects const& sceneObjects) const {
-			bool isHit = false;
-
-			int count = (int)sceneObjects.size();
-			for (int i = 0; i < count; ++i) {
-				float tvalue = -FLT_MAX;
-				if (sceneObjects[i]->IntersectP(shadowRay, tvalue)) {
-					float dist = shadowRay.O().Distance(mLightPos);
-					if (tvalue < dist) {
-						isHit = true;
-						break;
-					}
-				}
-			}
-
-			return isHit;
-		}
-
 	public:
 		inline void SetLightPos(Vec3f const& pos) {
 			mLightPos = pos;
@@ -1044,8 +935,6 @@ namespace LaplataRayTracer
 		//
 		bool	mCastShadow;
 
-		Vec3f	mSurfaceDir;
-
 	};
 
 	//
@@ -1086,17 +975,26 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		virtual Vec3f GetDirection(const HitRecord& hitRec) {
-			mSurfaceDir = mLightPos - hitRec.wpt;
-			mSurfaceDir.MakeUnit();
+		virtual LightSample Sample(const HitRecord& hitRec, SceneObjects& /*sceneObjects*/) const {
+			LightSample sample;
+			sample.pt = mLightPos;
+			sample.wi = mLightPos - hitRec.wpt;
+			sample.dist = sample.wi.Length();
+			sample.wi.MakeUnit();
+			sample.L = radiance(hitRec, sample.wi);
 
-			return mSurfaceDir;
+			return sample;
 		}
 
-		virtual Color3f Li(HitRecord& hitRec, SceneObjects& sceneObjects) const {
+		virtual bool CastShadow() const {
+			return mCastShadow;
+		}
+
+	private:
+		inline Color3f radiance(const HitRecord& hitRec, Vec3f const& wi) const {
 			Color3f L;
 
-			float sdotdir = Dot(-mSurfaceDir, mLightDir);
+			float sdotdir = Dot(-wi, mLightDir);
 			if (sdotdir < mCosHalfViewAngle || sdotdir < 0.0f) {
 				L.Set(0.0f, 0.0f, 0.0f);
 			}
@@ -1114,36 +1012,6 @@ namespace LaplataRayTracer
 			return L;
 		}
 
-		virtual float G(const HitRecord& hitRec) const {
-			return 1.0f;
-		}
-
-		virtual float Pdf(const HitRecord& hitRec) const {
-			return 1.0f;
-		}
-
-		virtual bool CastShadow() const {
-			return mCastShadow;
-		}
-
-		virtual bool ShadowHit(Ray const& shadowRay, SceneObjects const& sceneObjects) const {
-			bool isHit = false;
-
-			int count = (int)sceneObjects.size();
-			for (int i = 0; i < count; ++i) {
-				float tvalue = -FLT_MAX;
-				if (sceneObjects[i]->IntersectP(shadowRay, tvalue)) {
-					float dist = shadowRay.O().Distance(mLightPos);
-					if (tvalue < dist) {
-						isHit = true;
-						break;
-					}
-				}
-			}
-
-			return isHit;
-		}
-
 	public:
 		inline void SetLightPos(Vec3f const& pos) {
 			mLightPos = pos;
@@ -1209,8 +1077,6 @@ namespace LaplataRayTracer
 			this->mONB = rhs.mONB;
 
 			this->mCastShadow = rhs.mCastShadow;
-
-			this->mSurfaceDir = rhs.mSurfaceDir;
 		}
 
 	private:
@@ -1227,8 +1093,6 @@ namespace LaplataRayTracer
 
 		bool	mCastShadow;
 
-		Vec3f	mSurfaceDir;
-
 	};
 
 	//
@@ -1275,14 +1139,23 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		virtual Vec3f GetDirection(const HitRecord& hitRec) {
-			Vec3f v_dir = mLightPos - hitRec.wpt;
-			v_dir.MakeUnit();
+		virtual LightSample Sample(const HitRecord& hitRec, SceneObjects& /*sceneObjects*/) const {
+			LightSample sample;
+			sample.pt = mLightPos;
+			sample.wi = mLightPos - hitRec.wpt;
+			sample.dist = sample.wi.Length();
+			sample.wi.MakeUnit();
+			sample.L = radiance(hitRec);
 
-			return v_dir;
+			return sample;
 		}
 
-		virtual Color3f Li(HitRecord& hitRec, SceneObjects& sceneObjects) const {
+		virtual bool CastShadow() const {
+			return mCastShadow;
+		}
+
+	private:
+		inline Color3f radiance(const HitRecord& hitRec) const {
 			Color3f L;
 
 			Vec3f v_view_onb = hitRec.wpt - mLightPos;
@@ -1316,36 +1189,6 @@ namespace LaplataRayTracer
 			return L;
 		}
 
-		virtual float G(const HitRecord& hitRec) const {
-			return 1.0f;
-		}
-
-		virtual float Pdf(const HitRecord& hitRec) const {
-			return 1.0f;
-		}
-
-		virtual bool CastShadow() const {
-			return mCastShadow;
-		}
-
-		virtual bool ShadowHit(Ray const& shadowRay, SceneObjects const& sceneObjects) const {
-			bool isHit = false;
-
-			int count = (int)sceneObjects.size();
-			for (int i = 0; i < count; ++i) {
-				float tvalue = -FLT_MAX;
-				if (sceneObjects[i]->IntersectP(shadowRay, tvalue)) {
-					float dist = shadowRay.O().Distance(mLightPos);
-					if (tvalue < dist) {
-						isHit = true;
-						break;
-					}
-				}
-			}
-
-			return isHit;
-		}
-
 	public:
 		inline void SetLightPos(Vec3f const& pos) {
 			mLightPos = pos;
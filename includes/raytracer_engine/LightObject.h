@@ -45,7 +45,7 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec)
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const
 		{
 			if (MaterialObject::HitTest(inRay, tmin, tmax, rec))
 			{
@@ -141,13 +141,12 @@ namespace LaplataRayTracer
 	class MatteMaterial : public MaterialBase
 	{
 	public:
-		MatteMaterial() : mpAlbedo(nullptr) { mpCosinePDF = new CosinePDF; }
+		MatteMaterial() : mpAlbedo(nullptr) { }
 		MatteMaterial(Color3f const& albedo)
 		{
 			mpAlbedo = new ConstantTexture(albedo);
-			mpCosinePDF = new CosinePDF;
 		}
-		MatteMaterial(Texture *albedo) : mpAlbedo(albedo) { mpCosinePDF = new CosinePDF; }
+		MatteMaterial(Texture *albedo) : mpAlbedo(albedo) { }
 		virtual ~MatteMaterial()
 		{
 			release();
@@ -187,8 +186,8 @@ namespace LaplataRayTracer
 		{
 			scatterRec.is_specular = false;
 			scatterRec.albedo = mpAlbedo->GetTextureColor(hitRec);
-			mpCosinePDF->SetW(hitRec.n);
-			scatterRec.pPDF = mpCosinePDF;
+			scatterRec.cosine_pdf.SetW(hitRec.n);
+			scatterRec.pPDF = &scatterRec.cosine_pdf;
 			return true;
 		}
 
@@ -228,12 +227,6 @@ namespace LaplataRayTracer
 				delete mpAlbedo;
 				mpAlbedo = nullptr;
 			}
-
-			if (mpCosinePDF)
-			{
-				delete mpCosinePDF;
-				mpCosinePDF = nullptr;
-			}
 		}
 
 	private:
@@ -243,7 +236,6 @@ namespace LaplataRayTracer
 	private:
 	//	Color3f mAlbedo;
 		Texture *mpAlbedo;
-		CosinePDF *mpCosinePDF;
 
 	};
 
@@ -568,17 +560,18 @@ namespace LaplataRayTracer
 			int light_count = sceneLights.Count();
 			for (int i = 0; i < light_count; ++i) {
 				Light *light = sceneLights.GetLight(i);
-				Vec3f wi = light->GetDirection(hitRec);
+				LightSample sample = light->Sample(hitRec, sceneObjects);
+				Vec3f wi = sample.wi;
 				float ndotwi = Dot(hitRec.n, wi);
 
 				if (ndotwi > 0.0f) {
 					bool in_shadow = false;
 					if (mSelfShadow && light->CastShadow()) {
-						Ray shadowRay(hitRec.wpt, wi/*light->GetDirection(hitRec)*/, 0.0f);
-						in_shadow = light->ShadowHit(shadowRay, sceneObjects);
+						Ray shadowRay(hitRec.wpt, wi, 0.0f);
+						in_shadow = light->ShadowHit(shadowRay, sample, sceneObjects);
 					}
 					if (!in_shadow) {
-						L += mpDiffuseBRDF->F(hitRec, wo, wi) * light->Li(hitRec, sceneObjects) * ndotwi;
+						L += mpDiffuseBRDF->F(hitRec, wo, wi) * sample.L * ndotwi;
 					}
 				}
 			}
@@ -593,18 +586,19 @@ namespace LaplataRayTracer
 			int light_count = sceneLights.Count();
 			for (int i = 0; i < light_count; ++i) {
 				Light *light = sceneLights.GetLight(i);
-				Vec3f wi = light->GetDirection(hitRec);
+				LightSample sample = light->Sample(hitRec, sceneObjects);
+				Vec3f wi = sample.wi;
 				float ndotwi = Dot(hitRec.n, wi);
 
 				if (ndotwi > 0.0f) {
 					bool in_shadow = false;
 					if (mSelfShadow && light->CastShadow()) {
-						Ray shadowRay(hitRec.wpt, wi/*light->GetDirection(hitRec)*/, 0.0f);
-						in_shadow = light->ShadowHit(shadowRay, sceneObjects);
+						Ray shadowRay(hitRec.wpt, wi, 0.0f);
+						in_shadow = light->ShadowHit(shadowRay, sample, sceneObjects);
 					}
 					if (!in_shadow) {
-						L += mpDiffuseBRDF->F(hitRec, wo, wi) * light->Li(hitRec, sceneObjects) * light->G(hitRec) * ndotwi
-							/ light->Pdf(hitRec);
+						L += mpDiffuseBRDF->F(hitRec, wo, wi) * sample.L * sample.g * ndotwi
+							/ sample.pdf;
 					}
 				}
 			}
@@ -747,17 +741,18 @@ namespace LaplataRayTracer
 			int light_count = sceneLights.Count();
 			for (int i = 0; i < light_count; ++i) {
 				Light *light = sceneLights.GetLight(i);
-				Vec3f wi = light->GetDirection(hitRec);
+				LightSample sample = light->Sample(hitRec, sceneObjects);
+				Vec3f wi = sample.wi;
 				float ndotwi = Dot(hitRec.n, wi);
 
 				if (ndotwi > 0.0f) {
 					bool in_shadow = false;
 					if (mSelfShadow && light->CastShadow()) {
-						Ray shadowRay(hitRec.wpt, wi,/*light->GetDirection(hitRec),*/ 0.0f);
-						in_shadow = light->ShadowHit(shadowRay, sceneObjects);
+						Ray shadowRay(hitRec.wpt, wi, 0.0f);
+						in_shadow = light->ShadowHit(shadowRay, sample, sceneObjects);
 					}
 					if (!in_shadow) {
-						L += (mpDiffuseBRDF->F(hitRec, wo, wi) + mpGlossyBRDF->F(hitRec, wo, wi)) * light->Li(hitRec, sceneObjects) * ndotwi;
+						L += (mpDiffuseBRDF->F(hitRec, wo, wi) + mpGlossyBRDF->F(hitRec, wo, wi)) * sample.L * ndotwi;
 					}
 				}
 			}
@@ -772,18 +767,19 @@ namespace LaplataRayTracer
 			int light_count = sceneLights.Count();
 			for (int i = 0; i < light_count; ++i) {
 				Light *light = sceneLights.GetLight(i);
-				Vec3f wi = light->GetDirection(hitRec);
+				LightSample sample = light->Sample(hitRec, sceneObjects);
+				Vec3f wi = sample.wi;
 				float ndotwi = Dot(hitRec.n, wi);
 
 				if (ndotwi > 0.0f) {
 					bool in_shadow = false;
 					if (mSelfShadow && light->CastShadow()) {
-						Ray shadowRay(hitRec.wpt, wi,/*light->GetDirection(hitRec),*/ 0.0f);
-						in_shadow = light->ShadowHit(shadowRay, sceneObjects);
+						Ray shadowRay(hitRec.wpt, wi, 0.0f);
+						in_shadow = light->ShadowHit(shadowRay, sample, sceneObjects);
 					}
 					if (!in_shadow) {
-						L += (mpDiffuseBRDF->F(hitRec, wo, wi) + mpGlossyBRDF->F(hitRec, wo, wi)) * light->Li(hitRec, sceneObjects) * light->G(hitRec) * ndotwi
-							/ light->Pdf(hitRec);
+						L += (mpDiffuseBRDF->F(hitRec, wo, wi) + mpGlossyBRDF->F(hitRec, wo, wi)) * sample.L * sample.g * ndotwi
+							/ sample.pdf;
 					}
 				}
 			}
@@ -1616,25 +1612,26 @@ namespace LaplataRayTracer
             int light_count = sceneLights.Count();
             for (int i = 0; i < light_count; ++i) {
                 Light *light = sceneLights.GetLight(i);
-                Vec3f wi = light->GetDirection(hitRec);
+                LightSample sample = light->Sample(hitRec, sceneObjects);
+                Vec3f wi = sample.wi;
                 float ndotwi = Dot(hitRec.n, wi);
 
                 if (ndotwi > 0.0f) {
                     bool in_shadow = false;
                     if (mSelfShadow && light->CastShadow()) {
-                        Ray shadowRay(hitRec.wpt, wi,/*light->GetDirection(hitRec),*/ 0.0f);
-                        in_shadow = light->ShadowHit(shadowRay, sceneObjects);
+                        Ray shadowRay(hitRec.wpt, wi, 0.0f);
+                        in_shadow = light->ShadowHit(shadowRay, sample, sceneObjects);
                     }
                     if (!in_shadow) {
                         if (mbDiffuse && !mbOrenNayar) {
                             L += (mpLambertianBRDF->F(hitRec, wo, wi) + mpGlossyBRDF->F(hitRec, wo, wi)) *
-                                    light->Li(hitRec, sceneObjects) * ndotwi;
+                                    sample.L * ndotwi;
                         } else if (mbDiffuse && mbOrenNayar) {
                             L += (mpOrenNayarBRDF->F(hitRec, wo, wi) + mpGlossyBRDF->F(hitRec, wo, wi)) *
-                                    light->Li(hitRec, sceneObjects) * ndotwi;
+                                    sample.L * ndotwi;
                         } else {
                             L += (mpGlossyBRDF->F(hitRec, wo, wi)) *
-                                 light->Li(hitRec, sceneObjects) * ndotwi;
+                                 sample.L * ndotwi;
                         }
                     }
                 }
@@ -1650,25 +1647,26 @@ namespace LaplataRayTracer
             int light_count = sceneLights.Count();
             for (int i = 0; i < light_count; ++i) {
                 Light *light = sceneLights.GetLight(i);
-                Vec3f wi = light->GetDirection(hitRec);
+                LightSample sample = light->Sample(hitRec, sceneObjects);
+                Vec3f wi = sample.wi;
                 float ndotwi = Dot(hitRec.n, wi);
 
                 if (ndotwi > 0.0f) {
                     bool in_shadow = false;
                     if (mSelfShadow && light->CastShadow()) {
-                        Ray shadowRay(hitRec.wpt, wi,/*light->GetDirection(hitRec),*/ 0.0f);
-                        in_shadow = light->ShadowHit(shadowRay, sceneObjects);
+                        Ray shadowRay(hitRec.wpt, wi, 0.0f);
+                        in_shadow = light->ShadowHit(shadowRay, sample, sceneObjects);
                     }
                     if (!in_shadow) {
                         if (mbDiffuse && !mbOrenNayar) {
                             L += (mpLambertianBRDF->F(hitRec, wo, wi) + mpGlossyBRDF->F(hitRec, wo, wi)) *
-                                 light->Li(hitRec, sceneObjects) * light->G(hitRec) * ndotwi / light->Pdf(hitRec);
+                                 sample.L * sample.g * ndotwi / sample.pdf;
                         } else if (mbDiffuse && mbOrenNayar){
                             L += (mpOrenNayarBRDF->F(hitRec, wo, wi) + mpGlossyBRDF->F(hitRec, wo, wi)) *
-                                 light->Li(hitRec, sceneObjects) * light->G(hitRec) * ndotwi / light->Pdf(hitRec);
+                                 sample.L * sample.g * ndotwi / sample.pdf;
                         } else {
                             L += (mpGlossyBRDF->F(hitRec, wo, wi)) *
-                                 light->Li(hitRec, sceneObjects) * light->G(hitRec) * ndotwi / light->Pdf(hitRec);
+                                 sample.L * sample.g * ndotwi / sample.pdf;
                         }
                     }
                 }
@@ -1963,17 +1961,18 @@ namespace LaplataRayTracer
 			int light_count = sceneLights.Count();
 			for (int i = 0; i < light_count; ++i) {
 				Light *light = sceneLights.GetLight(i);
-				Vec3f wi = light->GetDirection(hitRec);
+				LightSample sample = light->Sample(hitRec, sceneObjects);
+				Vec3f wi = sample.wi;
 				float ndotwi = Dot(hitRec.n, wi);
 
 				if (ndotwi > 0.0f) {
 					bool in_shadow = false;
 					if (mSelfShadow && light->CastShadow()) {
-						Ray shadowRay(hitRec.wpt, wi,/*light->GetDirection(hitRec),*/ 0.0f);
-						in_shadow = light->ShadowHit(shadowRay, sceneObjects);
+						Ray shadowRay(hitRec.wpt, wi, 0.0f);
+						in_shadow = light->ShadowHit(shadowRay, sample, sceneObjects);
 					}
 					if (!in_shadow) {
-						L += mpFresnelBlend->F(hitRec, wo, wi) * light->Li(hitRec, sceneObjects) * ndotwi;
+						L += mpFresnelBlend->F(hitRec, wo, wi) * sample.L * ndotwi;
 					}
 				}
 			}
@@ -1988,18 +1987,19 @@ namespace LaplataRayTracer
 			int light_count = sceneLights.Count();
 			for (int i = 0; i < light_count; ++i) {
 				Light *light = sceneLights.GetLight(i);
-				Vec3f wi = light->GetDirection(hitRec);
+				LightSample sample = light->Sample(hitRec, sceneObjects);
+				Vec3f wi = sample.wi;
 				float ndotwi = Dot(hitRec.n, wi);
 
 				if (ndotwi > 0.0f) {
 					bool in_shadow = false;
 					if (mSelfShadow && light->CastShadow()) {
-						Ray shadowRay(hitRec.wpt, wi,/*light->GetDirection(hitRec),*/ 0.0f);
-						in_shadow = light->ShadowHit(shadowRay, sceneObjects);
+						Ray shadowRay(hitRec.wpt, wi, 0.0f);
+						in_shadow = light->ShadowHit(shadowRay, sample, sceneObjects);
 					}
 					if (!in_shadow) {
 						L += mpFresnelBlend->F(hitRec, wo, wi) *
-							light->Li(hitRec, sceneObjects) * light->G(hitRec) * ndotwi / light->Pdf(hitRec);
+							sample.L * sample.g * ndotwi / sample.pdf;
 					}
 				}
 			}
@@ -1,3 +1,5 @@
+#include <chrono>
+
 #include "Utility.h"
 #include "ResourcePool.h"
 #include "PLYFileReader.h"
@@ -9,21 +11,17 @@
 namespace LaplataRayTracer
 {
 	//
-	RegularGridMeshObject::RegularGridMeshObject() {
+	MeshObjectBase::MeshObjectBase() {
 		mMeshType = FLAT_SHADING;
-		mnX = 0;
-		mnY = 0;
-		mnZ = 0;
 		mnMeshResID = ResourcePool::INVALID_RES_ID;
 		mpMeshDesc = nullptr;
 		mbReverseNormal = false;
 		mbAutoReleaseMesh = false;
 		mbEnableAcceleration = true;
 		mpAllMaterial = nullptr;
-        mSpeedupFactor = 2.0f;
 	}
 
-	RegularGridMeshObject::~RegularGridMeshObject() {
+	MeshObjectBase::~MeshObjectBase() {
 		//
 		if (mbAutoReleaseMesh) {
 			if (mnMeshResID != ResourcePool::INVALID_RES_ID) {
@@ -35,7 +33,6 @@ namespace LaplataRayTracer
 
 		//
 		CompoundObject::DeleteObjects();
-		release_mesh_cell_objects();
 
 		//
 		if (mpAllMaterial != nullptr) {
@@ -44,13 +41,28 @@ namespace LaplataRayTracer
 		}
 	}
 
+	//
+	RegularGridMeshObject::RegularGridMeshObject() {
+		mnX = 0;
+		mnY = 0;
+		mnZ = 0;
+        mSpeedupFactor = 2.0f;
+		mbHierarchy = false;
+		mnMaxCellTriangles = 16;
+		mBuildStats = BuildStats();
+	}
+
+	RegularGridMeshObject::~RegularGridMeshObject() {
+		release_mesh_cell_objects();
+	}
+
 	//
 	void *RegularGridMeshObject::Clone() {
 		return (RegularGridMeshObject *)(new RegularGridMeshObject(*this));
 	}
 
 	//
-	bool RegularGridMeshObject::HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) {
+	bool RegularGridMeshObject::HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const {
 
 		bool is_hit = false;
 
@@ -90,7 +102,7 @@ namespace LaplataRayTracer
 				int 	ix_step, iy_step, iz_step;
 				int 	ix_stop, iy_stop, iz_stop;
 
-				if (inRay.D().X() > 0) {
+				if (!inRay.Sign(0)) {
 					tx_next = tx_min + (ix_ + 1) * dtx_;
 					ix_step = +1;
 					ix_stop = mnX;
@@ -107,7 +119,7 @@ namespace LaplataRayTracer
 					ix_stop = -1;
 				}
 
-				if (inRay.D().Y() > 0) {
+				if (!inRay.Sign(1)) {
 					ty_next = ty_min + (iy_ + 1) * dty_;
 					iy_step = +1;
 					iy_stop = mnY;
@@ -124,7 +136,7 @@ namespace LaplataRayTracer
 					iy_stop = -1;
 				}
 
-				if (inRay.D().Z() > 0) {
+				if (!inRay.Sign(2)) {
 					tz_next = tz_min + (iz_ + 1) * dtz_;
 					iz_step = +1;
 					iz_stop = mnZ;
@@ -141,19 +153,17 @@ namespace LaplataRayTracer
 					iz_stop = -1;
 				}
 
-				//
+				// a triangle may cross the cell boundary, its hit only counts once the ray gets to the cell
+				// holding the hit point; tmax keeps shrinking meanwhile, so the hit found before stays valid.
+				bool hit_anything = false;
 				while (true) {
-					GeometricObject *object_ptr = (GeometricObject *)(mvecCells[ix_ + mnX * iy_ + mnX * mnY * iz_]);
+					int cell = ix_ + mnX * iy_ + mnX * mnY * iz_;
+					if (hit_cell(cell, inRay, tmin, tmax, rec)) {
+						hit_anything = true;
+					}
 
 					if (tx_next < ty_next && tx_next < tz_next) {
-						if (object_ptr && object_ptr->HitTest(inRay, tmin, tmax, rec) && tmax < tx_next) {
-							//							if (object_ptr->IsCompound()) {
-							//								CompoundObject *object_compound_ptr = (CompoundObject *)object_ptr;
-							//								rec.pMaterial = ((MaterialObject *)(object_compound_ptr->At(object_compound_ptr->LastHit())))->GetMaterial();
-							//							}
-							//							else {
-							//								rec.pMaterial = ((MaterialObject *)object_ptr)->GetMaterial();
-							//							}
+						if (hit_anything && tmax < tx_next) {
 							return (true);
 						}
 
@@ -161,20 +171,12 @@ namespace LaplataRayTracer
 						ix_ += ix_step;
 
 						if (ix_ == ix_stop) {
-							return (false);
+							return (hit_anything);
 						}
-						
 					}
 					else {
 						if (ty_next < tz_next) {
-							if (object_ptr && object_ptr->HitTest(inRay, tmin, tmax, rec) && tmax < ty_next) {
-								//if (object_ptr->IsCompound()) {
-								//	CompoundObject *object_compound_ptr = (CompoundObject *)object_ptr;
-								//	rec.pMaterial = ((MaterialObject *)(object_compound_ptr->At(object_compound_ptr->LastHit())))->GetMaterial();
-								//}
-								//else {
-								//	rec.pMaterial = ((MaterialObject *)object_ptr)->GetMaterial();
-								//}
+							if (hit_anything && tmax < ty_next) {
 								return (true);
 							}
 
@@ -182,19 +184,11 @@ namespace LaplataRayTracer
 							iy_ += iy_step;
 
 							if (iy_ == iy_stop) {
-								return (false);
+								return (hit_anything);
 							}
-								
 						}
 						else {
-							if (object_ptr && object_ptr->HitTest(inRay, tmin, tmax, rec) && tmax < tz_next) {
-								//if (object_ptr->IsCompound()) {
-								//	CompoundObject *object_compound_ptr = (CompoundObject *)object_ptr;
-								//	rec.pMaterial = ((MaterialObject *)(object_compound_ptr->At(object_compound_ptr->LastHit())))->GetMaterial();
-								//}
-								//else {
-								//	rec.pMaterial = ((MaterialObject *)object_ptr)->GetMaterial();
-								//}
+							if (hit_anything && tmax < tz_next) {
 								return (true);
 							}
 
@@ -202,9 +196,8 @@ namespace LaplataRayTracer
 							iz_ += iz_step;
 
 							if (iz_ == iz_stop) {
-								return (false);
+								return (hit_anything);
 							}
-							
 						}
 					}
 				}
@@ -214,7 +207,7 @@ namespace LaplataRayTracer
 			is_hit = CompoundObject::HitTest(inRay, tmin, tmax, rec);
 			//if (is_hit) {
 			//	rec.pMaterial = mpAllMaterial;
-			//	int hitIdx_ = this->LastHit();
+			//	int hitIdx_ = rec.subIndex;
 			//	rec.pMaterial = ((MaterialObject *)this->At(hitIdx_))->GetMaterial();
 			//}
 		}
@@ -262,7 +255,7 @@ namespace LaplataRayTracer
 				int 	ix_step, iy_step, iz_step;
 				int 	ix_stop, iy_stop, iz_stop;
 
-				if (inRay.D().X() > 0) {
+				if (!inRay.Sign(0)) {
 					tx_next = tx_min + (ix_ + 1) * dtx_;
 					ix_step = +1;
 					ix_stop = mnX;
@@ -279,7 +272,7 @@ namespace LaplataRayTracer
 					ix_stop = -1;
 				}
 
-				if (inRay.D().Y() > 0) {
+				if (!inRay.Sign(1)) {
 					ty_next = ty_min + (iy_ + 1) * dty_;
 					iy_step = +1;
 					iy_stop = mnY;
@@ -296,7 +289,7 @@ namespace LaplataRayTracer
 					iy_stop = -1;
 				}
 
-				if (inRay.D().Z() > 0) {
+				if (!inRay.Sign(2)) {
 					tz_next = tz_min + (iz_ + 1) * dtz_;
 					iz_step = +1;
 					iz_stop = mnZ;
@@ -315,10 +308,10 @@ namespace LaplataRayTracer
 
 				//
 				while (true) {
-					GeometricObject *object_ptr = (GeometricObject *)(mvecCells[ix_ + mnX * iy_ + mnX * mnY * iz_]);
+					int cell = ix_ + mnX * iy_ + mnX * mnY * iz_;
 
 					if (tx_next < ty_next && tx_next < tz_next) {
-						if (object_ptr && object_ptr->IntersectP(inRay, tvalue) && tvalue < tx_next) {
+						if (intersect_cell(cell, inRay, tx_next, tvalue)) {
 							return (true);
 						}
 
@@ -330,7 +323,7 @@ namespace LaplataRayTracer
 					}
 					else {
 						if (ty_next < tz_next) {
-							if (object_ptr && object_ptr->IntersectP(inRay, tvalue) && tvalue < ty_next) {
+							if (intersect_cell(cell, inRay, ty_next, tvalue)) {
 								return (true);
 							}
 
@@ -341,7 +334,7 @@ namespace LaplataRayTracer
 								return (false);
 						}
 						else {
-							if (object_ptr && object_ptr->IntersectP(inRay, tvalue) && tvalue < tz_next) {
+							if (intersect_cell(cell, inRay, tz_next, tvalue)) {
 								return (true);
 							}
 
@@ -364,12 +357,12 @@ namespace LaplataRayTracer
 
 	//
 	// From CompoundObject
-	float RegularGridMeshObject::Area() const
+	float MeshObjectBase::Area() const
 	{
         return CompoundObject::Area();
 	}
 
-	bool RegularGridMeshObject::GetBoundingBox(float t0, float t1, AABB& bounding) {
+	bool MeshObjectBase::GetBoundingBox(float t0, float t1, AABB& bounding) {
 		Vec3f pt_min = this->find_min_bounds();
 		Vec3f pt_max = this->find_max_bounds();
 
@@ -385,16 +378,33 @@ namespace LaplataRayTracer
 		return true;
 	}
 
-	void RegularGridMeshObject::Update(float t) {
+	bool MeshObjectBase::GetTransformedBoundingBox(Transform const& xform, float t0, float t1, AABB& bounding) {
+		// the tessellated meshes have no mesh desc, the box of their triangles is all there is.
+		if (mpMeshDesc == nullptr || mpMeshDesc->mesh_vertices.empty()) {
+			return GeometricObject::GetTransformedBoundingBox(xform, t0, t1, bounding);
+		}
+
+		Vec3f pt_min(FLT_MAX), pt_max(-FLT_MAX);
+		for (size_t i = 0; i < mpMeshDesc->mesh_vertices.size(); ++i) {
+			Vec3f pt = xform.ApplyPoint(mpMeshDesc->mesh_vertices[i]);
+			pt_min = Vec3f(std::min<float>(pt_min.X(), pt.X()), std::min<float>(pt_min.Y(), pt.Y()), std::min<float>(pt_min.Z(), pt.Z()));
+			pt_max = Vec3f(std::max<float>(pt_max.X(), pt.X()), std::max<float>(pt_max.Y(), pt.Y()), std::max<float>(pt_max.Z(), pt.Z()));
+		}
+
+		bounding = AABB(pt_min, pt_max);
+		return true;
+	}
+
+	void MeshObjectBase::Update(float t) {
         CompoundObject::Update(t);
 
 	}
 
-	bool RegularGridMeshObject::IsCompound() const {
+	bool MeshObjectBase::IsCompound() const {
 		return true;
 	}
 
-	float RegularGridMeshObject::PDFValue(Vec3f const& o, Vec3f const& v) const {
+	float MeshObjectBase::PDFValue(Vec3f const& o, Vec3f const& v) const {
         return CompoundObject::PDFValue(o, v);
 	}
 
@@ -426,77 +436,299 @@ namespace LaplataRayTracer
 		mnY = (scale_factor * boundary_width) / cube_cell_length + 1;
 		mnZ = (scale_factor * boundary_height) / cube_cell_length + 1;
 
-		// initialize the cells via total cell count
-		unsigned long cell_count = mnX * mnY * mnZ;
+		// the cells are stored in the compressed-sparse-row form: the triangles of cell i are
+		// mvecCellObjects[mvecCellOffsets[i], mvecCellOffsets[i + 1]), it's built in two passes,
+		// counting the triangles per cell first, then filling them in.
+		int cell_count = mnX * mnY * mnZ;
+		const int grid_res[3] = { mnX, mnY, mnZ };
 
-		mvecCells.reserve(cell_count);
+		mvecCellOffsets.assign(cell_count + 1, 0);
 
-		vector<int> each_cell_obj_count;
-		each_cell_obj_count.reserve(cell_count);
+		int cell_range[6];
+		for (int i = 0; i < obj_num; ++i) {
+			if (object_cell_range(i, bounding_box, grid_res, cell_range)) {
+				for (int iz = cell_range[4]; iz <= cell_range[5]; ++iz) {
+					for (int jy = cell_range[2]; jy <= cell_range[3]; ++jy) {
+						for (int kx = cell_range[0]; kx <= cell_range[1]; ++kx) {
+							mvecCellOffsets[kx + mnX * jy + mnX * mnY * iz + 1] += 1;
+						}
+					}
+				}
+			}
+		}
 
 		for (int i = 0; i < cell_count; ++i) {
-			mvecCells.push_back(nullptr);
-			each_cell_obj_count.push_back(0);
+			mvecCellOffsets[i + 1] += mvecCellOffsets[i];
 		}
 
-		// match each object in its base class to the cells in the boundary(each object may cover multiply cells).
-		AABB curr_obj_bounding;
-		int curr_obj_index;
+		mvecCellObjects.resize(mvecCellOffsets[cell_count]);
 
+		vector<int> cell_cursor(mvecCellOffsets.begin(), mvecCellOffsets.end() - 1);
 		for (int i = 0; i < obj_num; ++i) {
-			if (mvecObjects[i]->GetBoundingBox(0.0f, 0.0f, curr_obj_bounding)) {
-				// compute the coverage cells in three directions.
-				int min_x = ((curr_obj_bounding.mX0 - bounding_box.mX0) / (bounding_box.mX1 - bounding_box.mX0)) * mnX;
-				int min_y = ((curr_obj_bounding.mY0 - bounding_box.mY0) / (bounding_box.mY1 - bounding_box.mY0)) * mnY;
-				int min_z = ((curr_obj_bounding.mZ0 - bounding_box.mZ0) / (bounding_box.mZ1 - bounding_box.mZ0)) * mnZ;
-				int max_x = ((curr_obj_bounding.mX1 - bounding_box.mX0) / (bounding_box.mX1 - bounding_box.mX0)) * mnX;
-				int max_y = ((curr_obj_bounding.mY1 - bounding_box.mY0) / (bounding_box.mY1 - bounding_box.mY0)) * mnY;
-				int max_z = ((curr_obj_bounding.mZ1 - bounding_box.mZ0) / (bounding_box.mZ1 - bounding_box.mZ0)) * mnZ;
-
-				min_x = RTMath::Clamp(min_x, 0, mnX - 1);
-				min_y = RTMath::Clamp(min_y, 0, mnY - 1);
-				min_z = RTMath::Clamp(min_z, 0, mnZ - 1);
-				max_x = RTMath::Clamp(max_x, 0, mnX - 1);
-				max_y = RTMath::Clamp(max_y, 0, mnY - 1);
-				max_z = RTMath::Clamp(max_z, 0, mnZ - 1);
-
-				for (int iz = min_z; iz <= max_z; ++iz) {
-					for (int jy = min_y; jy <= max_y; ++jy) {
-						for (int kx = min_x; kx <= max_x; ++kx) {
-							curr_obj_index = kx + mnX * jy + mnX * mnY * iz;
-
-							if (each_cell_obj_count[curr_obj_index] == 0) {
-								mvecCells[curr_obj_index] = mvecObjects[i];
-								each_cell_obj_count[curr_obj_index] += 1;
-							}
-							else if (each_cell_obj_count[curr_obj_index] == 1) {
-								CompoundObject *pCompoundObj = new CompoundObject;
-								pCompoundObj->EnableAutoDelete(false);
-								pCompoundObj->AddObject(mvecCells[curr_obj_index]);
-								pCompoundObj->AddObject(mvecObjects[i]);
-								mvecCells[curr_obj_index] = pCompoundObj;
-								each_cell_obj_count[curr_obj_index] += 1;
+			if (object_cell_range(i, bounding_box, grid_res, cell_range)) {
+				for (int iz = cell_range[4]; iz <= cell_range[5]; ++iz) {
+					for (int jy = cell_range[2]; jy <= cell_range[3]; ++jy) {
+						for (int kx = cell_range[0]; kx <= cell_range[1]; ++kx) {
+							mvecCellObjects[cell_cursor[kx + mnX * jy + mnX * mnY * iz]++] = i;
+						}
+					}
+				}
+			}
+		}
+
+		if (mbHierarchy) {
+			build_sub_grids(bounding_box);
+		}
+
+		update_build_stats();
+	}
+
+	// The cells covered by the bounding-box of the object, [min_x, max_x, min_y, max_y, min_z, max_z].
+	bool RegularGridMeshObject::object_cell_range(int objIndex, AABB const& gridBounds, const int res[3], int cellRange[6]) const {
+		AABB curr_obj_bounding;
+		if (!mvecObjects[objIndex]->GetBoundingBox(0.0f, 0.0f, curr_obj_bounding)) {
+			return false;
+		}
+
+		int min_x = ((curr_obj_bounding.mX0 - gridBounds.mX0) / (gridBounds.mX1 - gridBounds.mX0)) * res[0];
+		int min_y = ((curr_obj_bounding.mY0 - gridBounds.mY0) / (gridBounds.mY1 - gridBounds.mY0)) * res[1];
+		int min_z = ((curr_obj_bounding.mZ0 - gridBounds.mZ0) / (gridBounds.mZ1 - gridBounds.mZ0)) * res[2];
+		int max_x = ((curr_obj_bounding.mX1 - gridBounds.mX0) / (gridBounds.mX1 - gridBounds.mX0)) * res[0];
+		int max_y = ((curr_obj_bounding.mY1 - gridBounds.mY0) / (gridBounds.mY1 - gridBounds.mY0)) * res[1];
+		int max_z = ((curr_obj_bounding.mZ1 - gridBounds.mZ0) / (gridBounds.mZ1 - gridBounds.mZ0)) * res[2];
+
+		cellRange[0] = RTMath::Clamp(min_x, 0, res[0] - 1);
+		cellRange[1] = RTMath::Clamp(max_x, 0, res[0] - 1);
+		cellRange[2] = RTMath::Clamp(min_y, 0, res[1] - 1);
+		cellRange[3] = RTMath::Clamp(max_y, 0, res[1] - 1);
+		cellRange[4] = RTMath::Clamp(min_z, 0, res[2] - 1);
+		cellRange[5] = RTMath::Clamp(max_z, 0, res[2] - 1);
+
+		return true;
+	}
+
+	// Each overfull cell gets a sub-grid, and its triangles are taken out of the top-level arrays.
+	void RegularGridMeshObject::build_sub_grids(AABB const& gridBounds) {
+		int cell_count = mnX * mnY * mnZ;
+
+		float cell_dx = (gridBounds.mX1 - gridBounds.mX0) / mnX;
+		float cell_dy = (gridBounds.mY1 - gridBounds.mY0) / mnY;
+		float cell_dz = (gridBounds.mZ1 - gridBounds.mZ0) / mnZ;
+
+		mvecCellSubGrids.assign(cell_count, -1);
+
+		vector<int> cell_offsets;
+		vector<int> cell_objects;
+		cell_offsets.reserve(cell_count + 1);
+		cell_objects.reserve(mvecCellObjects.size());
+		cell_offsets.push_back(0);
+
+		for (int iz = 0; iz < mnZ; ++iz) {
+			for (int jy = 0; jy < mnY; ++jy) {
+				for (int kx = 0; kx < mnX; ++kx) {
+					int cell = kx + mnX * jy + mnX * mnY * iz;
+					int begin = mvecCellOffsets[cell];
+					int count = mvecCellOffsets[cell + 1] - begin;
+
+					if (count > mnMaxCellTriangles) {
+						SubGrid sub;
+						sub.mBounds = AABB(gridBounds.mX0 + kx * cell_dx, gridBounds.mX0 + (kx + 1) * cell_dx,
+							gridBounds.mY0 + jy * cell_dy, gridBounds.mY0 + (jy + 1) * cell_dy,
+							gridBounds.mZ0 + iz * cell_dz, gridBounds.mZ0 + (iz + 1) * cell_dz);
+						build_sub_grid(sub, &mvecCellObjects[begin], count);
+
+						mvecCellSubGrids[cell] = (int)mvecSubGrids.size();
+						mvecSubGrids.push_back(sub);
+					}
+					else {
+						cell_objects.insert(cell_objects.end(), mvecCellObjects.begin() + begin, mvecCellObjects.begin() + begin + count);
+					}
+
+					cell_offsets.push_back((int)cell_objects.size());
+				}
+			}
+		}
+
+		mvecCellOffsets.swap(cell_offsets);
+		mvecCellObjects.swap(cell_objects);
+	}
+
+	// The resolution is picked like the top-level one, the cells are about as many as the triangles,
+	// just without the speed-up factor since the cell is small already.
+	void RegularGridMeshObject::build_sub_grid(SubGrid& sub, const int *objects, int count) const {
+		const int MAX_SUB_RESOLUTION = 16;
+
+		float sub_length = sub.mBounds.mX1 - sub.mBounds.mX0;
+		float sub_height = sub.mBounds.mY1 - sub.mBounds.mY0;
+		float sub_width = sub.mBounds.mZ1 - sub.mBounds.mZ0;
+		float cube_cell_length = std::pow((sub_length * sub_height * sub_width) / count, 0.333333f);
+
+		sub.mnRes[0] = RTMath::Clamp((int)(sub_length / cube_cell_length) + 1, 1, MAX_SUB_RESOLUTION);
+		sub.mnRes[1] = RTMath::Clamp((int)(sub_height / cube_cell_length) + 1, 1, MAX_SUB_RESOLUTION);
+		sub.mnRes[2] = RTMath::Clamp((int)(sub_width / cube_cell_length) + 1, 1, MAX_SUB_RESOLUTION);
+
+		int cell_count = sub.mnRes[0] * sub.mnRes[1] * sub.mnRes[2];
+		sub.mvecCellOffsets.assign(cell_count + 1, 0);
+
+		int cell_range[6];
+		for (int pass = 0; pass < 2; ++pass) {
+			vector<int> cell_cursor;
+			if (pass == 1) {
+				for (int i = 0; i < cell_count; ++i) {
+					sub.mvecCellOffsets[i + 1] += sub.mvecCellOffsets[i];
+				}
+				sub.mvecCellObjects.resize(sub.mvecCellOffsets[cell_count]);
+				cell_cursor.assign(sub.mvecCellOffsets.begin(), sub.mvecCellOffsets.end() - 1);
+			}
+
+			for (int i = 0; i < count; ++i) {
+				if (!object_cell_range(objects[i], sub.mBounds, sub.mnRes, cell_range)) {
+					continue;
+				}
+
+				for (int iz = cell_range[4]; iz <= cell_range[5]; ++iz) {
+					for (int jy = cell_range[2]; jy <= cell_range[3]; ++jy) {
+						for (int kx = cell_range[0]; kx <= cell_range[1]; ++kx) {
+							int cell = kx + sub.mnRes[0] * (jy + sub.mnRes[1] * iz);
+							if (pass == 0) {
+								sub.mvecCellOffsets[cell + 1] += 1;
 							}
 							else {
-								((CompoundObject *)mvecCells[curr_obj_index])->AddObject(mvecObjects[i]);
-								each_cell_obj_count[curr_obj_index] += 1;
+								sub.mvecCellObjects[cell_cursor[cell]++] = objects[i];
 							}
 						}
 					}
 				}
 			}
 		}
+	}
+
+	void RegularGridMeshObject::update_build_stats() {
+		mBuildStats = BuildStats();
+
+		long occupied_total = 0;
+		int occupied_cells = 0;
+
+		int cell_count = mnX * mnY * mnZ;
+		for (int i = 0; i < cell_count; ++i) {
+			const vector<int> *offsets = &mvecCellOffsets;
+			int first = i, last = i + 1;
+			if (!mvecCellSubGrids.empty() && mvecCellSubGrids[i] >= 0) {
+				const SubGrid& sub = mvecSubGrids[mvecCellSubGrids[i]];
+				offsets = &sub.mvecCellOffsets;
+				first = 0;
+				last = sub.mnRes[0] * sub.mnRes[1] * sub.mnRes[2];
+			}
+
+			for (int j = first; j < last; ++j) {
+				int occupancy = (*offsets)[j + 1] - (*offsets)[j];
+				mBuildStats.mnCells += 1;
+				if (occupancy == 0) {
+					mBuildStats.mnEmptyCells += 1;
+				}
+				else {
+					occupied_cells += 1;
+					occupied_total += occupancy;
+					mBuildStats.mnMaxOccupancy = std::max<int>(mBuildStats.mnMaxOccupancy, occupancy);
+				}
+			}
+		}
+
+		mBuildStats.mnSubGrids = (int)mvecSubGrids.size();
+		mBuildStats.mfAvgOccupancy = (occupied_cells > 0) ? ((float)occupied_total / occupied_cells) : 0.0f;
+	}
+
+	//
+	bool RegularGridMeshObject::GridWalker::Start(AABB const& bounds, const int res[3], Ray const& inRay) {
+		float t_min[3], t_max[3];
+		float t0;
+		if (!bounds.HitTestImpl(inRay, t_min[0], t_min[1], t_min[2], t_max[0], t_max[1], t_max[2], t0)) {
+			return false;
+		}
+
+		Vec3f pt_ = bounds.IsInside(inRay.O()) ? inRay.O() : (inRay.O() + t0 * inRay.D());
+		const float lo[3] = { bounds.mX0, bounds.mY0, bounds.mZ0 };
+		const float hi[3] = { bounds.mX1, bounds.mY1, bounds.mZ1 };
+
+		for (int axis = 0; axis < 3; ++axis) {
+			int cell = (int)(((pt_[axis] - lo[axis]) / (hi[axis] - lo[axis])) * res[axis]);
+			cell = RTMath::Clamp(cell, 0, res[axis] - 1);
+
+			mnRes[axis] = res[axis];
+			mnCell[axis] = cell;
+			mfDelta[axis] = (t_max[axis] - t_min[axis]) / res[axis];
+
+			if (inRay.D()[axis] == 0.0f) {
+				mfNext[axis] = FLT_MAX;
+				mnStep[axis] = -1;
+				mnStop[axis] = -1;
+			}
+			else if (!inRay.Sign(axis)) {
+				mfNext[axis] = t_min[axis] + (cell + 1) * mfDelta[axis];
+				mnStep[axis] = +1;
+				mnStop[axis] = res[axis];
+			}
+			else {
+				mfNext[axis] = t_min[axis] + (res[axis] - cell) * mfDelta[axis];
+				mnStep[axis] = -1;
+				mnStop[axis] = -1;
+			}
+		}
+
+		return true;
+	}
+
+	bool RegularGridMeshObject::hit_sub_grid(SubGrid const& sub, Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const {
+		GridWalker walker;
+		if (!walker.Start(sub.mBounds, sub.mnRes, inRay)) {
+			return false;
+		}
+
+		bool hit_anything = false;
+		do {
+			int cell = walker.Cell();
+			int end = sub.mvecCellOffsets[cell + 1];
+			for (int i = sub.mvecCellOffsets[cell]; i < end; ++i) {
+				if (mvecObjects[sub.mvecCellObjects[i]]->HitTest(inRay, tmin, tmax, rec)) {
+					hit_anything = true;
+				}
+			}
+
+			if (hit_anything && tmax < walker.Exit()) {
+				return true;
+			}
+		} while (walker.Advance());
+
+		return hit_anything;
+	}
+
+	bool RegularGridMeshObject::intersect_sub_grid(SubGrid const& sub, Ray const& inRay, float tnext, float& tvalue) const {
+		GridWalker walker;
+		if (!walker.Start(sub.mBounds, sub.mnRes, inRay)) {
+			return false;
+		}
 
-		each_cell_obj_count.clear();
+		do {
+			int cell = walker.Cell();
+			float t_exit = std::min<float>(walker.Exit(), tnext);
+			int end = sub.mvecCellOffsets[cell + 1];
+			for (int i = sub.mvecCellOffsets[cell]; i < end; ++i) {
+				if (mvecObjects[sub.mvecCellObjects[i]]->IntersectP(inRay, tvalue) && tvalue < t_exit) {
+					return true;
+				}
+			}
+		} while (walker.Advance());
+
+		return false;
 	}
 
 	//
 	// From IMeshFileReaderSink
-	void RegularGridMeshObject::OnReadVertexRecord(float& x, float& y, float& z) {
+	void MeshObjectBase::OnReadVertexRecord(float& x, float& y, float& z) {
 		// to do nothing. We don't care about each vertex data, cause the mesh desc will hold all of them.
 	}
 
-	void RegularGridMeshObject::OnReadFaceRecord(int& index0, int& index1, int& index2) {
+	void MeshObjectBase::OnReadFaceRecord(int& index0, int& index1, int& index2) {
 		if (mpMeshDesc == nullptr) {
 			return;
 		}
@@ -524,7 +756,7 @@ namespace LaplataRayTracer
 	}
 
 	//
-	bool RegularGridMeshObject::LoadFromFile(const char *meshFileName, const EMeshType meshType,
+	bool MeshObjectBase::LoadFromFile(const char *meshFileName, const EMeshType meshType,
 		EModelType modelType, bool isBin) {
 		mbAutoReleaseMesh = true;
 		mMeshType = meshType;
@@ -538,11 +770,11 @@ namespace LaplataRayTracer
 			return false;
 		}
 
-		DeleteObjects();
-		release_mesh_cell_objects();
+		release_acceleration_structure();
+		release_triangles();
 
 		mpMeshDesc = mesh_desc;
-		mvecObjects.reserve(mesh_desc->mesh_face_count);
+		reserve_triangles(mesh_desc->mesh_face_count);
 
 		int succ = 0;
 		if (modelType == EModelType::MODEL_PLY) {
@@ -560,8 +792,8 @@ namespace LaplataRayTracer
 		}
 
 		if (succ != 0) {
-			DeleteObjects();
-			release_mesh_cell_objects();
+			release_acceleration_structure();
+			release_triangles();
 			return false;
 		}
 
@@ -576,7 +808,7 @@ namespace LaplataRayTracer
 		return true;
 	}
 
-	bool RegularGridMeshObject::LoadFromMeshDesc(const int meshResID, const EMeshType meshType) {
+	bool MeshObjectBase::LoadFromMeshDesc(const int meshResID, const EMeshType meshType) {
 		if (meshResID == ResourcePool::INVALID_RES_ID) {
 			return false;
 		}
@@ -591,10 +823,10 @@ namespace LaplataRayTracer
 		}
 		mpMeshDesc = mesh_desc;
 
-		DeleteObjects();
-		release_mesh_cell_objects();
+		release_acceleration_structure();
+		release_triangles();
 
-		mvecObjects.reserve(mesh_desc->mesh_face_count);
+		reserve_triangles(mesh_desc->mesh_face_count);
 		for (int i = 0; i < mesh_desc->mesh_face_count; ++i) {
 			OnReadFaceRecord(mesh_desc->mesh_face_datas[i].index0,
 				mesh_desc->mesh_face_datas[i].index1,
@@ -610,7 +842,7 @@ namespace LaplataRayTracer
 		return true;
 	}
 
-	void RegularGridMeshObject::SetMaterial(Material *material) {
+	void MeshObjectBase::SetMaterial(Material *material) {
 		if (mpAllMaterial != nullptr) {
 			delete mpAllMaterial;
 			mpAllMaterial = nullptr;
@@ -619,35 +851,65 @@ namespace LaplataRayTracer
 		mpAllMaterial = material;
 	}
 
-	Material *RegularGridMeshObject::GetMaterial() {
+	Material *MeshObjectBase::GetMaterial() {
 		return mpAllMaterial;
 	}
 
-	void RegularGridMeshObject::SetSubObjectMaterial(const int index, Material *material, bool autoDelete) {
+	void MeshObjectBase::SetSubObjectMaterial(const int index, Material *material, bool autoDelete) {
 		((MaterialObject *)mvecObjects[index])->SetMaterial(material, autoDelete);
 	}
 
-	Material *RegularGridMeshObject::GetSubObjectMaterial(const int index) {
+	Material *MeshObjectBase::GetSubObjectMaterial(const int index) {
 		return ((MaterialObject *)mvecObjects[index])->GetMaterial();
 	}
 
-	void RegularGridMeshObject::ReverseMeshNormals() {
+	void MeshObjectBase::ReverseMeshNormals() {
 		mbReverseNormal = !mbReverseNormal;
 	}
 
-	void RegularGridMeshObject::EnableAcceleration(bool enable) {
+	void MeshObjectBase::EnableAcceleration(bool enable) {
 		mbEnableAcceleration = enable;
 	}
 
+	size_t MeshObjectBase::MemoryUsage() const {
+		size_t triangle_size = sizeof(FlatShadingMeshTriangle);
+		if (mMeshType == SMOOTH_SHADING) {
+			triangle_size = sizeof(SmoothShadingMeshTriangle);
+		}
+		else if (mMeshType == FLAT_UV_SHADING) {
+			triangle_size = sizeof(FlatShadingUVMeshTriangle);
+		}
+		else if (mMeshType == SMOOTH_UV_SHADING) {
+			triangle_size = sizeof(SmoothShadingUVMeshTriangle);
+		}
+
+		// each triangle is wrapped by a material object, both of them are allocated one by one.
+		size_t objects_memory = mvecObjects.capacity() * sizeof(GeometricObject *) +
+			mvecObjects.size() * (sizeof(MaterialObject) + triangle_size);
+
+		return mesh_desc_memory() + objects_memory;
+	}
+
     void RegularGridMeshObject::SetSeedupFactor(float factor) {
         mSpeedupFactor = factor;
     }
 
+	void RegularGridMeshObject::EnableHierarchy(bool enable) {
+		mbHierarchy = enable;
+	}
+
+	void RegularGridMeshObject::SetMaxCellTriangles(int count) {
+		mnMaxCellTriangles = std::max<int>(count, 1);
+	}
+
 	//
-	void RegularGridMeshObject::TessellateFlatShpere(Vec3f const& pos, int hNum, int vNum) {
-		this->release_mesh_cell_objects();
+	void MeshObjectBase::TessellateFlatShpere(Vec3f const& pos, int hNum, int vNum) {
+		this->release_acceleration_structure();
 		CompoundObject::DeleteObjects();
 
+		// the triangles don't come from the mesh desc any more.
+		mpMeshDesc = nullptr;
+
 		// deal with the north and south pole of the shpere.
 		int k = 1;
 		for (int i = 0; i <= hNum - 1; ++i) {
@@ -735,7 +997,10 @@ namespace LaplataRayTracer
 		}
 	}
 
-	void RegularGridMeshObject::TessellateFlatRotaionalSweeping(Vec3f const& pos, int hNum, int vNum, const float controlPoints[6][2]) {
+	void MeshObjectBase::TessellateFlatRotaionalSweeping(Vec3f const& pos, int hNum, int vNum, const float controlPoints[6][2]) {
+		// not all the triangles come from the mesh desc any more.
+		mpMeshDesc = nullptr;
+
 		const float mat_bezier_N[4][4] = {
 			{ 1,  4,  1, 0 },
 			{ -3,  0,  3, 0 },
@@ -811,7 +1076,7 @@ namespace LaplataRayTracer
 	}
 
 	//
-	Vec3f RegularGridMeshObject::find_min_bounds() {
+	Vec3f MeshObjectBase::find_min_bounds() {
 		AABB obj_box;
 		Vec3f pt_min(FLT_MAX);
 		int num_objects = (int)mvecObjects.size();
@@ -830,14 +1095,14 @@ namespace LaplataRayTracer
 			}
 		}
 
-		pt_min[0] -= RegularGridMeshObject::KEpsilon();
-		pt_min[1] -= RegularGridMeshObject::KEpsilon();
-		pt_min[2] -= RegularGridMeshObject::KEpsilon();
+		pt_min[0] -= MeshObjectBase::KEpsilon();
+		pt_min[1] -= MeshObjectBase::KEpsilon();
+		pt_min[2] -= MeshObjectBase::KEpsilon();
 
 		return pt_min;
 	}
 
-	Vec3f RegularGridMeshObject::find_max_bounds() {
+	Vec3f MeshObjectBase::find_max_bounds() {
 		AABB obj_box;
 		Vec3f pt_max(-FLT_MAX);
 		int num_objects = (int)mvecObjects.size();
@@ -856,14 +1121,14 @@ namespace LaplataRayTracer
 			}
 		}
 
-		pt_max[0] += RegularGridMeshObject::KEpsilon();
-		pt_max[1] += RegularGridMeshObject::KEpsilon();
-		pt_max[2] += RegularGridMeshObject::KEpsilon();
+		pt_max[0] += MeshObjectBase::KEpsilon();
+		pt_max[1] += MeshObjectBase::KEpsilon();
+		pt_max[2] += MeshObjectBase::KEpsilon();
 
 		return pt_max;
 	}
 
-	void RegularGridMeshObject::update_mesh_normals(MeshDesc *meshDesc) {
+	void MeshObjectBase::update_mesh_normals(MeshDesc *meshDesc) {
 		meshDesc->mesh_normal.clear();
 		meshDesc->mesh_normal.reserve(meshDesc->mesh_vertex_count);
 
@@ -882,14 +1147,1050 @@ namespace LaplataRayTracer
 		}
 	}
 
+	void MeshObjectBase::release_triangles() {
+		CompoundObject::DeleteObjects();
+	}
+
+	void MeshObjectBase::reserve_triangles(int count) {
+		mvecObjects.reserve(count);
+	}
+
+	size_t MeshObjectBase::mesh_desc_memory() const {
+		if (mpMeshDesc == nullptr) {
+			return 0;
+		}
+
+		size_t desc_memory = sizeof(MeshDesc) +
+			mpMeshDesc->mesh_vertices.capacity() * sizeof(Vec3f) +
+			mpMeshDesc->mesh_normal.capacity() * sizeof(Vec3f) +
+			(mpMeshDesc->mesh_texU.capacity() + mpMeshDesc->mesh_texV.capacity()) * sizeof(float) +
+			mpMeshDesc->mesh_face_datas.capacity() * sizeof(TriFace);
+		for (int i = 0; i < (int)mpMeshDesc->mesh_vertex_faces.size(); ++i) {
+			desc_memory += sizeof(MeshDesc::FaceListPerVertex) + mpMeshDesc->mesh_vertex_faces[i].capacity() * sizeof(int);
+		}
+
+		return desc_memory;
+	}
+
+	//
+	size_t RegularGridMeshObject::MemoryUsage() const {
+		size_t cells_memory = mvecCellOffsets.capacity() * sizeof(int) + mvecCellObjects.capacity() * sizeof(int) +
+			mvecCellSubGrids.capacity() * sizeof(int) + mvecSubGrids.capacity() * sizeof(SubGrid);
+		for (int i = 0; i < (int)mvecSubGrids.size(); ++i) {
+			cells_memory += (mvecSubGrids[i].mvecCellOffsets.capacity() + mvecSubGrids[i].mvecCellObjects.capacity()) * sizeof(int);
+		}
+
+		return MeshObjectBase::MemoryUsage() + cells_memory;
+	}
+
+	void RegularGridMeshObject::release_acceleration_structure() {
+		release_mesh_cell_objects();
+	}
+
 	void RegularGridMeshObject::release_mesh_cell_objects() {
-		for (int i = 0; i < mvecCells.size(); ++i) {
-			if (mvecCells[i]->IsCompound()) {
-				delete mvecCells[i];
+		mvecCellOffsets.clear();
+		mvecCellObjects.clear();
+		mvecCellSubGrids.clear();
+		mvecSubGrids.clear();
+	}
+
+	//
+	BVHMeshObject::BVHMeshObject() {
+		mnMaxLeafTriangles = 4;
+		mfRefitRebuildRatio = 1.5f;
+		mbCompressedNodes = false;
+	}
+
+	BVHMeshObject::~BVHMeshObject() {
+		release_acceleration_structure();
+	}
+
+	//
+	void *BVHMeshObject::Clone() {
+		BVHMeshObject *clone_object = new BVHMeshObject(*this);
+
+		// the leaf references belong to this object, the clone has its own copied triangles.
+		clone_object->release_acceleration_structure();
+		if (has_acceleration_structure()) {
+			clone_object->BuildupAccelerationStructure();
+		}
+
+		return clone_object;
+	}
+
+	//
+	bool BVHMeshObject::HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const {
+		if (!mbEnableAcceleration || !has_acceleration_structure()) {
+			return CompoundObject::HitTest(inRay, tmin, tmax, rec);
+		}
+
+		bool is_hit = false;
+
+		if (!mQuantizedBVH.IsEmpty()) {
+			mQuantizedBVH.Traverse(inRay, tmin, tmax, [&](int offset, int count, float& leafTMax) {
+				for (int i = 0; i < count; ++i) {
+					if (mvecLeafObjects[offset + i]->HitTest(inRay, tmin, leafTMax, rec)) {
+						is_hit = true;
+					}
+				}
+				return false;
+			});
+
+			return is_hit;
+		}
+
+		const BVHNodeArray& nodes = mBVH.GetNodes();
+
+		int todo[BVHTree::MAX_DEPTH];
+		int todo_count = 0;
+		int node_index = 0;
+
+		while (true) {
+			const BVHNode& node = nodes[node_index];
+			BVHTree::CountNodeFetch(&node);
+			float tnear;
+
+			if (BVHTree::HitNode(node, inRay, tmin, tmax, tnear)) {
+				if (node.IsLeaf()) {
+					// the triangles only accept a hit closer than tmax, and shrink it then.
+					for (int i = 0; i < node.mnCount; ++i) {
+						if (mvecLeafObjects[node.mnOffset + i]->HitTest(inRay, tmin, tmax, rec)) {
+							is_hit = true;
+						}
+					}
+
+					if (todo_count == 0) { break; }
+					node_index = todo[--todo_count];
+				}
+				else {
+					if (inRay.Sign(node.mnAxis)) {
+						todo[todo_count++] = node_index + 1;
+						node_index = node.mnOffset;
+					}
+					else {
+						todo[todo_count++] = node.mnOffset;
+						node_index = node_index + 1;
+					}
+				}
+			}
+			else {
+				if (todo_count == 0) { break; }
+				node_index = todo[--todo_count];
 			}
 		}
 
-		mvecCells.clear();
+		return is_hit;
+	}
+
+	bool BVHMeshObject::IntersectP(Ray const& inRay, float& tvalue) const {
+		if (!mbEnableAcceleration || !has_acceleration_structure()) {
+			return CompoundObject::IntersectP(inRay, tvalue);
+		}
+
+		if (!mQuantizedBVH.IsEmpty()) {
+			float tmax = FLT_MAX;
+			return mQuantizedBVH.Traverse(inRay, 0.0f, tmax, [&](int offset, int count, float&) {
+				for (int i = 0; i < count; ++i) {
+					if (mvecLeafObjects[offset + i]->IntersectP(inRay, tvalue)) {
+						return true;
+					}
+				}
+				return false;
+			});
+		}
+
+		const BVHNodeArray& nodes = mBVH.GetNodes();
+
+		int todo[BVHTree::MAX_DEPTH];
+		int todo_count = 0;
+		int node_index = 0;
+
+		// any hit concludes the test, so the order of the children doesn't matter.
+		while (true) {
+			const BVHNode& node = nodes[node_index];
+			BVHTree::CountNodeFetch(&node);
+			float tnear;
+
+			if (BVHTree::HitNode(node, inRay, 0.0f, FLT_MAX, tnear)) {
+				if (node.IsLeaf()) {
+					for (int i = 0; i < node.mnCount; ++i) {
+						if (mvecLeafObjects[node.mnOffset + i]->IntersectP(inRay, tvalue)) {
+							return true;
+						}
+					}
+
+					if (todo_count == 0) { break; }
+					node_index = todo[--todo_count];
+				}
+				else {
+					todo[todo_count++] = node.mnOffset;
+					node_index = node_index + 1;
+				}
+			}
+			else {
+				if (todo_count == 0) { break; }
+				node_index = todo[--todo_count];
+			}
+		}
+
+		return false;
+	}
+
+	//
+	// From IAccelerationGeometric
+	void BVHMeshObject::BuildupAccelerationStructure() {
+		release_acceleration_structure();
+
+		AABB bounding_box;
+		if (!this->GetBoundingBox(0.0f, 0.0f, bounding_box)) {
+			return;
+		}
+
+		vector<AABB> triangle_bounds;
+		collect_triangle_bounds(triangle_bounds);
+
+		mBVH.Build(triangle_bounds, mnMaxLeafTriangles);
+
+		// the compressed tree has its own leaf order, the binary one isn't needed past it.
+		if (mbCompressedNodes) {
+			mQuantizedBVH.Build(mBVH);
+			mBVH.Clear();
+		}
+
+		// lay the triangle references out in the leaf order, so each leaf is one contiguous range.
+		const vector<int>& prim_indices = mbCompressedNodes ? mQuantizedBVH.GetPrimIndices() : mBVH.GetPrimIndices();
+		mvecLeafObjects.reserve(prim_indices.size());
+		for (int i = 0; i < (int)prim_indices.size(); ++i) {
+			mvecLeafObjects.push_back(mvecObjects[prim_indices[i]]);
+		}
+
+		if (mbCompressedNodes) {
+			mQuantizedBVH.ReleasePrimIndices();
+		}
+	}
+
+	bool BVHMeshObject::RefitAccelerationStructure() {
+		// nothing built yet, or compressed: there is no binary tree to refit.
+		if (mBVH.IsEmpty()) {
+			BuildupAccelerationStructure();
+			return true;
+		}
+
+		vector<AABB> triangle_bounds;
+		collect_triangle_bounds(triangle_bounds);
+
+		// the refitted boxes overlap more and more as the triangles drift away from where they were built.
+		if (mBVH.Refit(triangle_bounds) > mfRefitRebuildRatio) {
+			BuildupAccelerationStructure();
+			return true;
+		}
+
+		return false;
+	}
+
+	void BVHMeshObject::collect_triangle_bounds(vector<AABB>& triangleBounds) {
+		int obj_num = (int)mvecObjects.size();
+
+		triangleBounds.clear();
+		triangleBounds.reserve(obj_num);
+		for (int i = 0; i < obj_num; ++i) {
+			AABB curr_obj_bounding;
+			mvecObjects[i]->GetBoundingBox(0.0f, 0.0f, curr_obj_bounding);
+
+			// the axis-aligned triangles have flat boxes.
+			curr_obj_bounding.mX0 -= MeshObjectBase::KEpsilon(); curr_obj_bounding.mX1 += MeshObjectBase::KEpsilon();
+			curr_obj_bounding.mY0 -= MeshObjectBase::KEpsilon(); curr_obj_bounding.mY1 += MeshObjectBase::KEpsilon();
+			curr_obj_bounding.mZ0 -= MeshObjectBase::KEpsilon(); curr_obj_bounding.mZ1 += MeshObjectBase::KEpsilon();
+			triangleBounds.push_back(curr_obj_bounding);
+		}
+	}
+
+	//
+	void BVHMeshObject::SetMaxLeafTriangles(int count) {
+		mnMaxLeafTriangles = RTMath::Clamp(count, 1, BVHTree::MAX_LEAF_PRIMS);
+	}
+
+	int BVHMeshObject::NodeCount() const {
+		return mQuantizedBVH.IsEmpty() ? mBVH.NodeCount() : mQuantizedBVH.NodeCount();
+	}
+
+	float BVHMeshObject::BytesPerTriangle() const {
+		if (mvecLeafObjects.empty()) {
+			return 0.0f;
+		}
+
+		size_t bytes = mQuantizedBVH.IsEmpty() ? mBVH.MemoryUsage() : mQuantizedBVH.MemoryUsage();
+		return (float)bytes / (float)mvecLeafObjects.size();
+	}
+
+	size_t BVHMeshObject::MemoryUsage() const {
+		return MeshObjectBase::MemoryUsage() + mBVH.MemoryUsage() + mQuantizedBVH.MemoryUsage() +
+			mvecLeafObjects.capacity() * sizeof(GeometricObject *);
 	}
 
+	void BVHMeshObject::release_acceleration_structure() {
+		mBVH.Clear();
+		mQuantizedBVH.Clear();
+		mvecLeafObjects.clear();
+	}
+
+	bool BVHMeshObject::has_acceleration_structure() const {
+		return !mBVH.IsEmpty() || !mQuantizedBVH.IsEmpty();
+	}
+
+	//
+	KDTreeMeshObject::KDTreeMeshObject() {
+		mnMaxLeafTriangles = 1;
+		mnMaxDepth = 0;
+	}
+
+	KDTreeMeshObject::~KDTreeMeshObject() {
+		release_acceleration_structure();
+	}
+
+	//
+	void *KDTreeMeshObject::Clone() {
+		// the leaves hold the triangle indices, not the references, so the copy is ready to use.
+		return (KDTreeMeshObject *)(new KDTreeMeshObject(*this));
+	}
+
+	//
+	bool KDTreeMeshObject::HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const {
+		if (!mbEnableAcceleration || mKDTree.IsEmpty()) {
+			return CompoundObject::HitTest(inRay, tmin, tmax, rec);
+		}
+
+		bool is_hit = false;
+
+		// a triangle in several leaves may be tested again, it can't be closer than tmax the second time.
+		mKDTree.Traverse(inRay, tmin, tmax, [&](KDNode const& leaf, float& leafTMax) {
+			const int *prims = mKDTree.LeafPrims(leaf);
+			for (int i = 0; i < leaf.PrimCount(); ++i) {
+				if (mvecObjects[prims[i]]->HitTest(inRay, tmin, leafTMax, rec)) {
+					is_hit = true;
+				}
+			}
+			return false;
+		});
+
+		return is_hit;
+	}
+
+	bool KDTreeMeshObject::IntersectP(Ray const& inRay, float& tvalue) const {
+		if (!mbEnableAcceleration || mKDTree.IsEmpty()) {
+			return CompoundObject::IntersectP(inRay, tvalue);
+		}
+
+		float tmax = FLT_MAX;
+		return mKDTree.Traverse(inRay, 0.0f, tmax, [&](KDNode const& leaf, float&) {
+			const int *prims = mKDTree.LeafPrims(leaf);
+			for (int i = 0; i < leaf.PrimCount(); ++i) {
+				if (mvecObjects[prims[i]]->IntersectP(inRay, tvalue)) {
+					return true;
+				}
+			}
+			return false;
+		});
+	}
+
+	//
+	// From IAccelerationGeometric
+	void KDTreeMeshObject::BuildupAccelerationStructure() {
+		release_acceleration_structure();
+
+		int obj_num = (int)mvecObjects.size();
+		if (obj_num == 0) {
+			return;
+		}
+
+		vector<AABB> triangle_bounds;
+		triangle_bounds.reserve(obj_num);
+		for (int i = 0; i < obj_num; ++i) {
+			AABB curr_obj_bounding;
+			mvecObjects[i]->GetBoundingBox(0.0f, 0.0f, curr_obj_bounding);
+
+			// the axis-aligned triangles have flat boxes.
+			curr_obj_bounding.mX0 -= MeshObjectBase::KEpsilon(); curr_obj_bounding.mX1 += MeshObjectBase::KEpsilon();
+			curr_obj_bounding.mY0 -= MeshObjectBase::KEpsilon(); curr_obj_bounding.mY1 += MeshObjectBase::KEpsilon();
+			curr_obj_bounding.mZ0 -= MeshObjectBase::KEpsilon(); curr_obj_bounding.mZ1 += MeshObjectBase::KEpsilon();
+			triangle_bounds.push_back(curr_obj_bounding);
+		}
+
+		mKDTree.Build(triangle_bounds, mnMaxLeafTriangles, mnMaxDepth);
+	}
+
+	//
+	void KDTreeMeshObject::SetMaxLeafTriangles(int count) {
+		mnMaxLeafTriangles = RTMath::Clamp(count, 1, BVHTree::MAX_LEAF_PRIMS);
+	}
+
+	void KDTreeMeshObject::SetMaxDepth(int depth) {
+		mnMaxDepth = RTMath::Clamp(depth, 0, KDTree::MAX_DEPTH - 1);
+	}
+
+	size_t KDTreeMeshObject::MemoryUsage() const {
+		return MeshObjectBase::MemoryUsage() + mKDTree.MemoryUsage();
+	}
+
+	void KDTreeMeshObject::release_acceleration_structure() {
+		mKDTree.Clear();
+	}
+
+	//
+	TriangleSoupMeshObject::TriangleSoupMeshObject() {
+		mfTotalArea = 0.0f;
+		mfInvAreaSum = 0.0f;
+		mnMaxLeafTriangles = 2 * TriangleKernel::BLOCK_WIDTH;
+		mfRefitRebuildRatio = 1.5f;
+		mTriangleKernel = TriangleKernel::Detect();
+		mTriangleRecord = TRIANGLE_RECORD_NONE;
+	}
+
+	TriangleSoupMeshObject::~TriangleSoupMeshObject() {
+		release_acceleration_structure();
+	}
+
+	//
+	void *TriangleSoupMeshObject::Clone() {
+		// the face arrays and the BVH are plain values, the copy is ready to use.
+		return (TriangleSoupMeshObject *)(new TriangleSoupMeshObject(*this));
+	}
+
+	//
+	bool TriangleSoupMeshObject::HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const {
+		int hit_index = -1;
+		float hit_beta = 0.0f, hit_gamma = 0.0f;
+		float beta, gamma;
+
+		WatertightRay shear_ray;
+		if (!mvecVertexRecords.empty()) {
+			TriangleKernel::SetupWatertightRay(inRay, shear_ray);
+		}
+
+		if (!mbEnableAcceleration || mBVH.IsEmpty()) {
+			int face_count = (int)mvecFaces.size();
+			for (int i = 0; i < face_count; ++i) {
+				if (hit_triangle(i, inRay, shear_ray, tmin, tmax, beta, gamma, rec)) {
+					hit_index = i;
+					hit_beta = beta;
+					hit_gamma = gamma;
+				}
+			}
+		}
+		else {
+			const BVHNodeArray& nodes = mBVH.GetNodes();
+
+			int todo[BVHTree::MAX_DEPTH];
+			int todo_count = 0;
+			int node_index = 0;
+
+			while (true) {
+				const BVHNode& node = nodes[node_index];
+				BVHTree::CountNodeFetch(&node);
+				float tnear;
+
+				if (BVHTree::HitNode(node, inRay, tmin, tmax, tnear)) {
+					if (node.IsLeaf()) {
+						// the leaf is a range of the face arrays.
+						if (!use_triangle_blocks()) {
+							int end = node.mnOffset + node.mnCount;
+							for (int i = node.mnOffset; i < end; ++i) {
+								if (hit_triangle(i, inRay, shear_ray, tmin, tmax, beta, gamma, rec)) {
+									hit_index = i;
+									hit_beta = beta;
+									hit_gamma = gamma;
+								}
+							}
+						}
+						else {
+							int lane = TriangleKernel::ClosestHit(mTriangleKernel, &mvecBlocks[mvecNodeBlocks[node_index]],
+								TriangleKernel::BlockCount(node.mnCount), inRay, tmin, tmax, beta, gamma);
+							if (lane >= 0) {
+								hit_index = node.mnOffset + lane;
+								hit_beta = beta;
+								hit_gamma = gamma;
+							}
+						}
+
+						if (todo_count == 0) { break; }
+						node_index = todo[--todo_count];
+					}
+					else {
+						if (inRay.Sign(node.mnAxis)) {
+							todo[todo_count++] = node_index + 1;
+							node_index = node.mnOffset;
+						}
+						else {
+							todo[todo_count++] = node.mnOffset;
+							node_index = node_index + 1;
+						}
+					}
+				}
+				else {
+					if (todo_count == 0) { break; }
+					node_index = todo[--todo_count];
+				}
+			}
+		}
+
+		if (hit_index < 0) {
+			return false;
+		}
+
+		shade_triangle(hit_index, inRay, tmax, hit_beta, hit_gamma, rec);
+
+		return true;
+	}
+
+	bool TriangleSoupMeshObject::IntersectP(Ray const& inRay, float& tvalue) const {
+		WatertightRay shear_ray;
+		if (!mvecVertexRecords.empty()) {
+			TriangleKernel::SetupWatertightRay(inRay, shear_ray);
+		}
+
+		if (!mbEnableAcceleration || mBVH.IsEmpty()) {
+			int face_count = (int)mvecFaces.size();
+			for (int i = 0; i < face_count; ++i) {
+				if (intersect_triangle(i, inRay, shear_ray, tvalue)) {
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		const BVHNodeArray& nodes = mBVH.GetNodes();
+
+		int todo[BVHTree::MAX_DEPTH];
+		int todo_count = 0;
+		int node_index = 0;
+
+		while (true) {
+			const BVHNode& node = nodes[node_index];
+			BVHTree::CountNodeFetch(&node);
+			float tnear;
+
+			if (BVHTree::HitNode(node, inRay, 0.0f, FLT_MAX, tnear)) {
+				if (node.IsLeaf()) {
+					if (!use_triangle_blocks()) {
+						int end = node.mnOffset + node.mnCount;
+						for (int i = node.mnOffset; i < end; ++i) {
+							if (intersect_triangle(i, inRay, shear_ray, tvalue)) {
+								return true;
+							}
+						}
+					}
+					else if (TriangleKernel::AnyHit(mTriangleKernel, &mvecBlocks[mvecNodeBlocks[node_index]],
+						TriangleKernel::BlockCount(node.mnCount), inRay, tvalue) >= 0) {
+						return true;
+					}
+
+					if (todo_count == 0) { break; }
+					node_index = todo[--todo_count];
+				}
+				else {
+					todo[todo_count++] = node.mnOffset;
+					node_index = node_index + 1;
+				}
+			}
+			else {
+				if (todo_count == 0) { break; }
+				node_index = todo[--todo_count];
+			}
+		}
+
+		return false;
+	}
+
+	//
+	float TriangleSoupMeshObject::Area() const {
+		return mfTotalArea;
+	}
+
+	bool TriangleSoupMeshObject::GetBoundingBox(float /*t0*/, float /*t1*/, AABB& bounding) {
+		if (mvecFaces.empty()) {
+			return false;
+		}
+
+		Vec3f pt_min(FLT_MAX);
+		Vec3f pt_max(-FLT_MAX);
+		int face_count = (int)mvecFaces.size();
+		for (int i = 0; i < face_count; ++i) {
+			const int indices[3] = { mvecFaces[i].index0, mvecFaces[i].index1, mvecFaces[i].index2 };
+			for (int k = 0; k < 3; ++k) {
+				Vec3f const& v = mpMeshDesc->mesh_vertices[indices[k]];
+				pt_min.Set(std::min<float>(pt_min.X(), v.X()), std::min<float>(pt_min.Y(), v.Y()), std::min<float>(pt_min.Z(), v.Z()));
+				pt_max.Set(std::max<float>(pt_max.X(), v.X()), std::max<float>(pt_max.Y(), v.Y()), std::max<float>(pt_max.Z(), v.Z()));
+			}
+		}
+
+		mBounding.mX0 = pt_min.X() - MeshObjectBase::KEpsilon();
+		mBounding.mY0 = pt_min.Y() - MeshObjectBase::KEpsilon();
+		mBounding.mZ0 = pt_min.Z() - MeshObjectBase::KEpsilon();
+		mBounding.mX1 = pt_max.X() + MeshObjectBase::KEpsilon();
+		mBounding.mY1 = pt_max.Y() + MeshObjectBase::KEpsilon();
+		mBounding.mZ1 = pt_max.Z() + MeshObjectBase::KEpsilon();
+
+		bounding = mBounding;
+
+		return true;
+	}
+
+	void TriangleSoupMeshObject::Update(float /*t*/) {
+		// there are no triangle objects to update, the face normals and areas follow the vertices here.
+		mfTotalArea = 0.0f;
+		mfInvAreaSum = 0.0f;
+
+		int face_count = (int)mvecFaces.size();
+		for (int i = 0; i < face_count; ++i) {
+			Vec3f const& v0 = mpMeshDesc->mesh_vertices[mvecFaces[i].index0];
+			Vec3f const& v1 = mpMeshDesc->mesh_vertices[mvecFaces[i].index1];
+			Vec3f const& v2 = mpMeshDesc->mesh_vertices[mvecFaces[i].index2];
+
+			SimpleTriangle::ComputeNormalImpl(v0, v1, v2, mvecFaceNormals[i]);
+			if (mbReverseNormal) {
+				mvecFaceNormals[i] = -mvecFaceNormals[i];
+			}
+
+			SimpleTriangle::ComputeAreaImpl(v0, v1, v2, mvecFaceAreas[i]);
+
+			mfTotalArea += mvecFaceAreas[i];
+			if (mvecFaceAreas[i] > 0.0f) {
+				mfInvAreaSum += 1.0f / mvecFaceAreas[i];
+			}
+		}
+
+		// and the vertex normals the smooth shading interpolates.
+		if (mpMeshDesc != nullptr && (mMeshType == SMOOTH_SHADING || mMeshType == SMOOTH_UV_SHADING)) {
+			update_mesh_normals(mpMeshDesc);
+		}
+	}
+
+	Vec3f TriangleSoupMeshObject::SampleRandomPoint() const {
+		int index = static_cast<int>(Random::drand48() * mvecFaces.size());
+		TriFace const& face = mvecFaces[index];
+		return SimpleTriangle::SampleRandomPointImpl(mpMeshDesc->mesh_vertices[face.index0],
+			mpMeshDesc->mesh_vertices[face.index1], mpMeshDesc->mesh_vertices[face.index2]);
+	}
+
+	float TriangleSoupMeshObject::PDFValue(Vec3f const& /*o*/, Vec3f const& /*v*/) const {
+		// the same as the compound object: the average of each triangle's pdf.
+		if (mvecFaces.empty()) {
+			return 0.0f;
+		}
+
+		return mfInvAreaSum / (float)mvecFaces.size();
+	}
+
+	Vec3f TriangleSoupMeshObject::SampleRandomDirection(Vec3f const& v) const {
+		Vec3f pt = SampleRandomPoint();
+		return (pt - v);
+	}
+
+	//
+	// From IMeshFileReaderSink
+	void TriangleSoupMeshObject::OnReadFaceRecord(int& index0, int& index1, int& index2) {
+		if (mpMeshDesc == nullptr) {
+			return;
+		}
+
+		Vec3f const& v0 = mpMeshDesc->mesh_vertices[index0];
+		Vec3f const& v1 = mpMeshDesc->mesh_vertices[index1];
+		Vec3f const& v2 = mpMeshDesc->mesh_vertices[index2];
+
+		Vec3f normal;
+		SimpleTriangle::ComputeNormalImpl(v0, v1, v2, normal);
+		if (mbReverseNormal) {
+			normal = -normal;
+		}
+
+		float area;
+		SimpleTriangle::ComputeAreaImpl(v0, v1, v2, area);
+
+		TriFace face = { index0, index1, index2 };
+		mvecFaces.push_back(face);
+		mvecFaceNormals.push_back(normal);
+		mvecFaceAreas.push_back(area);
+
+		mfTotalArea += area;
+		if (area > 0.0f) {
+			mfInvAreaSum += 1.0f / area;
+		}
+	}
+
+	//
+	// From IAccelerationGeometric
+	void TriangleSoupMeshObject::BuildupAccelerationStructure() {
+		release_acceleration_structure();
+
+		int face_count = (int)mvecFaces.size();
+		if (face_count == 0) {
+			return;
+		}
+
+		vector<AABB> triangle_bounds;
+		collect_triangle_bounds(triangle_bounds);
+
+		mBVH.Build(triangle_bounds, mnMaxLeafTriangles, TriangleKernel::BLOCK_WIDTH);
+
+		// reorder the face arrays in the leaf order, so the leaves index the faces directly.
+		const vector<int>& prim_indices = mBVH.GetPrimIndices();
+
+		vector<TriFace> sorted_faces;
+		vector<Vec3f> sorted_normals;
+		vector<float> sorted_areas;
+		sorted_faces.reserve(face_count);
+		sorted_normals.reserve(face_count);
+		sorted_areas.reserve(face_count);
+		for (int i = 0; i < face_count; ++i) {
+			sorted_faces.push_back(mvecFaces[prim_indices[i]]);
+			sorted_normals.push_back(mvecFaceNormals[prim_indices[i]]);
+			sorted_areas.push_back(mvecFaceAreas[prim_indices[i]]);
+		}
+
+		mvecFaces.swap(sorted_faces);
+		mvecFaceNormals.swap(sorted_normals);
+		mvecFaceAreas.swap(sorted_areas);
+
+		mBVH.ReleasePrimIndices();
+
+		build_triangle_blocks();
+		build_triangle_records();
+	}
+
+	bool TriangleSoupMeshObject::RefitAccelerationStructure() {
+		if (mBVH.IsEmpty()) {
+			BuildupAccelerationStructure();
+			return true;
+		}
+
+		// the faces are in the leaf order already, so are their bounds.
+		vector<AABB> triangle_bounds;
+		collect_triangle_bounds(triangle_bounds);
+
+		if (mBVH.Refit(triangle_bounds) > mfRefitRebuildRatio) {
+			BuildupAccelerationStructure();
+			return true;
+		}
+
+		// the blocks and the records hold their own copies of the vertices.
+		build_triangle_blocks();
+		build_triangle_records();
+
+		return false;
+	}
+
+	void TriangleSoupMeshObject::collect_triangle_bounds(vector<AABB>& triangleBounds) const {
+		int face_count = (int)mvecFaces.size();
+
+		triangleBounds.clear();
+		triangleBounds.reserve(face_count);
+		for (int i = 0; i < face_count; ++i) {
+			AABB curr_bounding;
+			SimpleTriangle::GetBoundingBoxImpl(mpMeshDesc->mesh_vertices[mvecFaces[i].index0],
+				mpMeshDesc->mesh_vertices[mvecFaces[i].index1], mpMeshDesc->mesh_vertices[mvecFaces[i].index2], curr_bounding);
+
+			curr_bounding.mX0 -= MeshObjectBase::KEpsilon(); curr_bounding.mX1 += MeshObjectBase::KEpsilon();
+			curr_bounding.mY0 -= MeshObjectBase::KEpsilon(); curr_bounding.mY1 += MeshObjectBase::KEpsilon();
+			curr_bounding.mZ0 -= MeshObjectBase::KEpsilon(); curr_bounding.mZ1 += MeshObjectBase::KEpsilon();
+			triangleBounds.push_back(curr_bounding);
+		}
+	}
+
+	void TriangleSoupMeshObject::build_triangle_blocks() {
+		// the records replace the blocks.
+		if (mTriangleRecord != TRIANGLE_RECORD_NONE) {
+			mvecBlocks.clear();
+			mvecNodeBlocks.clear();
+			return;
+		}
+
+		const BVHNodeArray& nodes = mBVH.GetNodes();
+		int node_count = (int)nodes.size();
+
+		int block_count = 0;
+		mvecNodeBlocks.assign(node_count, -1);
+		for (int i = 0; i < node_count; ++i) {
+			if (nodes[i].IsLeaf()) {
+				mvecNodeBlocks[i] = block_count;
+				block_count += TriangleKernel::BlockCount(nodes[i].mnCount);
+			}
+		}
+
+		// each leaf owns its blocks, the lanes left in the last block of a leaf stay empty.
+		mvecBlocks.resize(block_count);
+		for (int i = 0; i < block_count; ++i) {
+			TriangleKernel::ClearBlock(mvecBlocks[i]);
+		}
+
+		for (int i = 0; i < node_count; ++i) {
+			if (!nodes[i].IsLeaf()) {
+				continue;
+			}
+
+			for (int k = 0; k < nodes[i].mnCount; ++k) {
+				TriFace const& face = mvecFaces[nodes[i].mnOffset + k];
+				TriangleBlock& block = mvecBlocks[mvecNodeBlocks[i] + k / TriangleKernel::BLOCK_WIDTH];
+				TriangleKernel::PackTriangle(block, k % TriangleKernel::BLOCK_WIDTH, mpMeshDesc->mesh_vertices[face.index0],
+					mpMeshDesc->mesh_vertices[face.index1], mpMeshDesc->mesh_vertices[face.index2]);
+			}
+		}
+	}
+
+	void TriangleSoupMeshObject::build_triangle_records() {
+		mvecAffineRecords.clear();
+		mvecVertexRecords.clear();
+
+		int face_count = (int)mvecFaces.size();
+		if (mTriangleRecord == TRIANGLE_RECORD_AFFINE) {
+			mvecAffineRecords.resize(face_count);
+			for (int i = 0; i < face_count; ++i) {
+				TriFace const& face = mvecFaces[i];
+				TriangleKernel::PackAffine(mvecAffineRecords[i], mpMeshDesc->mesh_vertices[face.index0],
+					mpMeshDesc->mesh_vertices[face.index1], mpMeshDesc->mesh_vertices[face.index2]);
+			}
+		}
+		else if (mTriangleRecord == TRIANGLE_RECORD_WATERTIGHT) {
+			mvecVertexRecords.resize(face_count);
+			for (int i = 0; i < face_count; ++i) {
+				TriFace const& face = mvecFaces[i];
+				mvecVertexRecords[i].mV0 = mpMeshDesc->mesh_vertices[face.index0];
+				mvecVertexRecords[i].mV1 = mpMeshDesc->mesh_vertices[face.index1];
+				mvecVertexRecords[i].mV2 = mpMeshDesc->mesh_vertices[face.index2];
+			}
+		}
+	}
+
+	//
+	void TriangleSoupMeshObject::SetMaxLeafTriangles(int count) {
+		mnMaxLeafTriangles = RTMath::Clamp(count, 1, BVHTree::MAX_LEAF_PRIMS);
+	}
+
+	void TriangleSoupMeshObject::SetTriangleKernel(ETriangleKernel kernel) {
+		// never go beyond what the running CPU supports.
+		mTriangleKernel = std::min<ETriangleKernel>(kernel, TriangleKernel::Detect());
+	}
+
+	double TriangleSoupMeshObject::BenchmarkTriangleTests(int rayCount, ETriangleKernel kernel) {
+		if (mvecFaces.empty() || rayCount <= 0) {
+			return 0.0;
+		}
+		if (mBVH.IsEmpty()) {
+			BuildupAccelerationStructure();
+		}
+
+		// the rays go from a sphere around the mesh toward the points inside its box.
+		AABB box;
+		this->GetBoundingBox(0.0f, 0.0f, box);
+		Vec3f center(0.5f * (box.mX0 + box.mX1), 0.5f * (box.mY0 + box.mY1), 0.5f * (box.mZ0 + box.mZ1));
+		Vec3f extent(box.mX1 - box.mX0, box.mY1 - box.mY0, box.mZ1 - box.mZ0);
+		float radius = extent.Length();
+
+		vector<Ray> rays;
+		rays.reserve(rayCount);
+		for (int i = 0; i < rayCount; ++i) {
+			Vec3f dir = SamplerBase::SampleInUnitSphere();
+			dir.MakeUnit();
+			Vec3f o = center + radius * dir;
+			Vec3f target(box.mX0 + Random::frand48() * extent.X(), box.mY0 + Random::frand48() * extent.Y(),
+				box.mZ0 + Random::frand48() * extent.Z());
+			rays.push_back(Ray(o, target - o, 0.0f));
+		}
+
+		ETriangleKernel used_kernel = std::min<ETriangleKernel>(kernel, TriangleKernel::Detect());
+		int face_count = (int)mvecFaces.size();
+		int block_count = (int)mvecBlocks.size();
+		int hit_count = 0;
+		float beta, gamma;
+		HitRecord rec;
+		WatertightRay shear_ray;
+
+		// every ray against every triangle, no BVH, so only the triangle tests are timed.
+		// TRIANGLE_KERNEL_NONE times the records if there are any.
+		auto begin_time = std::chrono::high_resolution_clock::now();
+		for (int r = 0; r < rayCount; ++r) {
+			float tmax = FLT_MAX;
+			if (used_kernel == TRIANGLE_KERNEL_NONE || block_count == 0) {
+				if (!mvecVertexRecords.empty()) {
+					TriangleKernel::SetupWatertightRay(rays[r], shear_ray);
+				}
+				for (int i = 0; i < face_count; ++i) {
+					if (hit_triangle(i, rays[r], shear_ray, 0.0f, tmax, beta, gamma, rec)) {
+						++hit_count;
+					}
+				}
+			}
+			else if (TriangleKernel::ClosestHit(used_kernel, &mvecBlocks[0], block_count, rays[r], 0.0f, tmax, beta, gamma) >= 0) {
+				++hit_count;
+			}
+		}
+		auto end_time = std::chrono::high_resolution_clock::now();
+
+		double seconds = std::chrono::duration<double>(end_time - begin_time).count();
+		double tests_per_second = (seconds > 0.0) ? ((double)rayCount * face_count / seconds) : 0.0;
+
+		const char *test_name = !mvecAffineRecords.empty() ? "affine records" :
+			(!mvecVertexRecords.empty() ? "watertight records" : TriangleKernel::Name(used_kernel));
+		std::cout << "triangle kernel " << test_name << ": " << face_count << " triangles, "
+			<< rayCount << " rays, " << hit_count << " hits, " << tests_per_second << " tests/s" << std::endl;
+
+		return tests_per_second;
+	}
+
+	size_t TriangleSoupMeshObject::MemoryUsage() const {
+		size_t soup_memory = mvecFaces.capacity() * sizeof(TriFace) +
+			mvecFaceNormals.capacity() * sizeof(Vec3f) +
+			mvecFaceAreas.capacity() * sizeof(float) +
+			mvecBlocks.capacity() * sizeof(TriangleBlock) +
+			mvecNodeBlocks.capacity() * sizeof(int) +
+			mvecAffineRecords.capacity() * sizeof(TriangleAffineRecord) +
+			mvecVertexRecords.capacity() * sizeof(TriangleVertexRecord);
+
+		return mesh_desc_memory() + soup_memory + mBVH.MemoryUsage();
+	}
+
+	//
+	void TriangleSoupMeshObject::release_acceleration_structure() {
+		mBVH.Clear();
+		mvecBlocks.clear();
+		mvecNodeBlocks.clear();
+		mvecAffineRecords.clear();
+		mvecVertexRecords.clear();
+	}
+
+	void TriangleSoupMeshObject::release_triangles() {
+		MeshObjectBase::release_triangles();
+
+		mvecFaces.clear();
+		mvecFaceNormals.clear();
+		mvecFaceAreas.clear();
+		mfTotalArea = 0.0f;
+		mfInvAreaSum = 0.0f;
+	}
+
+	void TriangleSoupMeshObject::reserve_triangles(int count) {
+		mvecFaces.reserve(count);
+		mvecFaceNormals.reserve(count);
+		mvecFaceAreas.reserve(count);
+	}
+
+	void TriangleSoupMeshObject::update_mesh_normals(MeshDesc *meshDesc) {
+		// the same average as the base class, but gathered from the face array: mesh_vertex_faces holds the
+		// faces in the file order, the face array is in the leaf order once the BVH is built.
+		int vertex_count = (int)meshDesc->mesh_vertex_count;
+		meshDesc->mesh_normal.assign(vertex_count, Vec3f(0.0f, 0.0f, 0.0f));
+
+		int face_count = (int)mvecFaces.size();
+		for (int i = 0; i < face_count; ++i) {
+			meshDesc->mesh_normal[mvecFaces[i].index0] += mvecFaceNormals[i];
+			meshDesc->mesh_normal[mvecFaces[i].index1] += mvecFaceNormals[i];
+			meshDesc->mesh_normal[mvecFaces[i].index2] += mvecFaceNormals[i];
+		}
+
+		for (int i = 0; i < vertex_count; ++i) {
+			meshDesc->mesh_normal[i].MakeUnit();
+		}
+	}
+
+	//
+	void TriangleSoupMeshObject::shade_triangle(const int index, Ray const& inRay, const float t,
+		const float beta, const float gamma, HitRecord& rec) const {
+		TriFace const& face = mvecFaces[index];
+		float alpha = 1.0f - beta - gamma;
+
+		// the same record as SimpleTriangle::HitTestImpl, the kernels only report t and the barycentrics.
+		rec.hit = true;
+		rec.t = t;
+		rec.n = mvecFaceNormals[index];
+		rec.pt = inRay.O() + t * inRay.D();
+		rec.albedo = Color3f(1.0f, 1.0f, 1.0f);
+
+		if (mMeshType == SMOOTH_SHADING || mMeshType == SMOOTH_UV_SHADING) {
+			rec.n = alpha * mpMeshDesc->mesh_normal[face.index0] +
+				beta * mpMeshDesc->mesh_normal[face.index1] + gamma * mpMeshDesc->mesh_normal[face.index2];
+		}
+
+		if (mMeshType == FLAT_UV_SHADING || mMeshType == SMOOTH_UV_SHADING) {
+			rec.u = alpha * mpMeshDesc->mesh_texU[face.index0] +
+				beta * mpMeshDesc->mesh_texU[face.index1] + gamma * mpMeshDesc->mesh_texU[face.index2];
+			rec.v = alpha * mpMeshDesc->mesh_texV[face.index0] +
+				beta * mpMeshDesc->mesh_texV[face.index1] + gamma * mpMeshDesc->mesh_texV[face.index2];
+		}
+
+		rec.pMaterial = mpAllMaterial;
+	}
+
+
+	//
+	void MeshAccelerationBenchmark::Run(const int meshResID, const EMeshType meshType, int rayCount) {
+		MeshDesc *mesh_desc = ResourcePool::Instance()->QueryMesh(meshResID);
+		if (mesh_desc == nullptr || mesh_desc->mesh_face_count == 0 || rayCount <= 0) {
+			return;
+		}
+
+		RegularGridMeshObject grid;
+		BVHMeshObject bvh;
+		BVHMeshObject compressed_bvh;
+		TriangleSoupMeshObject soup;
+		KDTreeMeshObject kd_tree;
+		MeshObjectBase *mesh_objects[5] = { &grid, &bvh, &compressed_bvh, &soup, &kd_tree };
+		const char *names[5] = { "grid", "bvh", "bvh (compressed)", "soup", "kd-tree" };
+
+		compressed_bvh.EnableCompressedNodes(true);
+		for (int i = 0; i < 5; ++i) {
+			mesh_objects[i]->LoadFromMeshDesc(meshResID, meshType);
+		}
+
+		// the rays go from a sphere around the mesh toward the points inside its box, like BenchmarkTriangleTests.
+		AABB box;
+		bvh.GetBoundingBox(0.0f, 0.0f, box);
+		Vec3f center(0.5f * (box.mX0 + box.mX1), 0.5f * (box.mY0 + box.mY1), 0.5f * (box.mZ0 + box.mZ1));
+		Vec3f extent(box.mX1 - box.mX0, box.mY1 - box.mY0, box.mZ1 - box.mZ0);
+		float radius = extent.Length();
+
+		vector<Ray> rays;
+		rays.reserve(rayCount);
+		for (int i = 0; i < rayCount; ++i) {
+			Vec3f dir = SamplerBase::SampleInUnitSphere();
+			dir.MakeUnit();
+			Vec3f o = center + radius * dir;
+			Vec3f target(box.mX0 + Random::frand48() * extent.X(), box.mY0 + Random::frand48() * extent.Y(),
+				box.mZ0 + Random::frand48() * extent.Z());
+			rays.push_back(Ray(o, target - o, 0.0f));
+		}
+
+		std::cout << "mesh " << meshResID << ": " << mesh_desc->mesh_face_count << " triangles, " << rayCount << " rays" << std::endl;
+		for (int i = 0; i < 5; ++i) {
+			run_one(names[i], mesh_objects[i], rays);
+		}
+
+		std::cout << "  bvh nodes: " << bvh.NodeCount() << ", " << bvh.BytesPerTriangle() << " bytes/triangle, compressed: "
+			<< compressed_bvh.NodeCount() << ", " << compressed_bvh.BytesPerTriangle() << " bytes/triangle" << std::endl;
+	}
+
+	void MeshAccelerationBenchmark::run_one(const char *name, MeshObjectBase *meshObject, vector<Ray> const& rays) {
+		auto build_begin = std::chrono::high_resolution_clock::now();
+		meshObject->BuildupAccelerationStructure();
+		auto build_end = std::chrono::high_resolution_clock::now();
+
+		int ray_count = (int)rays.size();
+		int hit_count = 0;
+		HitRecord rec;
+
+		auto trace_begin = std::chrono::high_resolution_clock::now();
+		for (int r = 0; r < ray_count; ++r) {
+			float tmax = FLT_MAX;
+			if (meshObject->HitTest(rays[r], 0.0f, tmax, rec)) {
+				++hit_count;
+			}
+		}
+		auto trace_end = std::chrono::high_resolution_clock::now();
+
+		double build_seconds = std::chrono::duration<double>(build_end - build_begin).count();
+		double trace_seconds = std::chrono::duration<double>(trace_end - trace_begin).count();
+		double rays_per_second = (trace_seconds > 0.0) ? (ray_count / trace_seconds) : 0.0;
+
+		std::cout << "  " << name << ": build " << build_seconds << "s, " << meshObject->MemoryUsage() << " bytes, "
+			<< rays_per_second << " rays/s, " << hit_count << " hits" << std::endl;
+	}
 }
@@ -6,6 +6,10 @@
 #include "IMeshFileReader.h"
 #include "GeometricObject.h"
 #include "MeshDesc.h"
+#include "BVHAccel.h"
+#include "KDTreeAccel.h"
+#include "QuantizedBVHAccel.h"
+#include "TriangleKernel.h"
 
 namespace LaplataRayTracer
 {
@@ -26,33 +30,28 @@ namespace LaplataRayTracer
 	//-----------------------------------------------------------------
 	// RegularGridMeshObject impl IGeometricAcceleration, IMeshFileReaderSink
 	// BVHMeshObject impl IGeometricAcceleration, IMeshFileReaderSink
+	// KDTreeMeshObject impl IGeometricAcceleration, IMeshFileReaderSink
+	// TriangleSoupMeshObject impl IGeometricAcceleration, IMeshFileReaderSink
 	// most of the .ply or .obj file parser codes are already in separated classes.
 	//-----------------------------------------------------------------
 
 	//
-	class RegularGridMeshObject : public CompoundObject, public IGeometricAcceleration, public IMeshFileReaderSink {
+	// MeshObjectBase holds everything the mesh objects have in common: loading the triangles from
+	// a mesh file or a mesh desc, the materials, the tessellation and the bounds,
+	// the derived classes only have to supply the acceleration structure.
+	class MeshObjectBase : public CompoundObject, public IGeometricAcceleration, public IMeshFileReaderSink {
 	public:
-		RegularGridMeshObject();
-		virtual ~RegularGridMeshObject();
-
-	public:
-		virtual void *Clone();
-
-	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec);
-		virtual bool IntersectP(Ray const& inRay, float& tvalue) const;
+		MeshObjectBase();
+		virtual ~MeshObjectBase();
 
 	public:
 		virtual float Area() const;
 		virtual bool GetBoundingBox(float t0, float t1, AABB& bounding);
+		virtual bool GetTransformedBoundingBox(Transform const& xform, float t0, float t1, AABB& bounding);
 		virtual void Update(float t);
 		virtual bool IsCompound() const;
 		virtual float PDFValue(Vec3f const& o, Vec3f const& v) const;
 
-	public:
-		// From IAccelerationGeometric
-		virtual void BuildupAccelerationStructure();
-
 	public:
 		// From IMeshFileReaderSink
 		virtual void OnReadVertexRecord(float& x, float& y, float& z);
@@ -72,7 +71,9 @@ namespace LaplataRayTracer
 
 		void EnableAcceleration(bool enable);
 
-        void SetSeedupFactor(float factor);
+		// Bytes held by the mesh desc, the triangles and the acceleration structure, it is an estimation
+		// to compare the mesh objects with each other, e.g. before and after switching to the triangle soup.
+		virtual size_t MemoryUsage() const;
 
     public:
         // tessellate geometry functions
@@ -82,28 +83,408 @@ namespace LaplataRayTracer
 	public:
 		static float KEpsilon() { return 0.0001f; }
 
-	private:
+	protected:
+		// the derived classes release their acceleration structure here before the triangles are gone.
+		virtual void release_acceleration_structure() = 0;
+		virtual void release_triangles();
+		virtual void reserve_triangles(int count);
+
+	protected:
 		Vec3f find_min_bounds();
 		Vec3f find_max_bounds();
 
-		void update_mesh_normals(MeshDesc *meshDesc);
+		virtual void update_mesh_normals(MeshDesc *meshDesc);
 
-		void release_mesh_cell_objects();
+		size_t mesh_desc_memory() const;
 
-	private:
-		vector<GeometricObject * >	mvecCells; // just the references from its base objects, so we don't release them.
+	protected:
 		AABB		mBounding;
 		EMeshType	mMeshType;
 		int			mnMeshResID;
 		MeshDesc *  mpMeshDesc;
-		int			mnX;
-		int			mnY;
-		int			mnZ;
 		bool		mbReverseNormal;
 		bool		mbAutoReleaseMesh;
 		bool		mbEnableAcceleration;
 		Material *  mpAllMaterial;
+
+	};
+
+	//
+	class RegularGridMeshObject : public MeshObjectBase {
+	public:
+		// The occupancy of the cells after the build, to compare the flat and the two-level grid on a mesh.
+		// The cells of the sub-grids replace the overfull cells they are built in.
+		struct BuildStats {
+			int		mnCells;
+			int		mnEmptyCells;
+			int		mnSubGrids;
+			int		mnMaxOccupancy;
+			float	mfAvgOccupancy; // upon the non-empty cells
+
+			inline float EmptyRatio() const { return (mnCells > 0) ? ((float)mnEmptyCells / mnCells) : 0.0f; }
+		};
+
+	public:
+		RegularGridMeshObject();
+		virtual ~RegularGridMeshObject();
+
+	public:
+		virtual void *Clone();
+
+	public:
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const;
+		virtual bool IntersectP(Ray const& inRay, float& tvalue) const;
+
+	public:
+		// From IAccelerationGeometric
+		virtual void BuildupAccelerationStructure();
+
+	public:
+        void SetSeedupFactor(float factor);
+		// The two-level mode: a cell holding more than maxCellTriangles gets its own grid,
+		// whose resolution follows the count of the triangles in it.
+		void EnableHierarchy(bool enable);
+		void SetMaxCellTriangles(int count);
+
+		inline const BuildStats& GetBuildStats() const { return mBuildStats; }
+
+		virtual size_t MemoryUsage() const;
+
+	protected:
+		virtual void release_acceleration_structure();
+
+	private:
+		// The grid over an overfull cell, in the same compressed-sparse-row form as the top one.
+		struct SubGrid {
+			AABB		mBounds;
+			int			mnRes[3];
+			vector<int>	mvecCellOffsets;
+			vector<int>	mvecCellObjects;
+		};
+
+		// The 3D-DDA walking the cells of a sub-grid along a ray.
+		struct GridWalker {
+			int		mnRes[3];
+			int		mnCell[3];
+			int		mnStep[3];
+			int		mnStop[3];
+			float	mfNext[3];
+			float	mfDelta[3];
+
+			bool Start(AABB const& bounds, const int res[3], Ray const& inRay);
+
+			inline int Cell() const { return mnCell[0] + mnRes[0] * (mnCell[1] + mnRes[1] * mnCell[2]); }
+			inline float Exit() const { return std::min<float>(mfNext[0], std::min<float>(mfNext[1], mfNext[2])); }
+
+			// false when the ray leaves the grid.
+			inline bool Advance() {
+				int axis = (mfNext[0] < mfNext[1] && mfNext[0] < mfNext[2]) ? 0 : ((mfNext[1] < mfNext[2]) ? 1 : 2);
+				mfNext[axis] += mfDelta[axis];
+				mnCell[axis] += mnStep[axis];
+				return (mnCell[axis] != mnStop[axis]);
+			}
+		};
+
+	private:
+		void release_mesh_cell_objects();
+		bool object_cell_range(int objIndex, AABB const& gridBounds, const int res[3], int cellRange[6]) const;
+		void build_sub_grids(AABB const& gridBounds);
+		void build_sub_grid(SubGrid& sub, const int *objects, int count) const;
+		void update_build_stats();
+
+		bool hit_sub_grid(SubGrid const& sub, Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const;
+		bool intersect_sub_grid(SubGrid const& sub, Ray const& inRay, float tnext, float& tvalue) const;
+
+		// all the triangles of the cell, the closest hit shrinks tmax.
+		inline bool hit_cell(int cell, Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const {
+			if (!mvecCellSubGrids.empty() && mvecCellSubGrids[cell] >= 0) {
+				return hit_sub_grid(mvecSubGrids[mvecCellSubGrids[cell]], inRay, tmin, tmax, rec);
+			}
+
+			bool is_hit = false;
+			int end = mvecCellOffsets[cell + 1];
+			for (int i = mvecCellOffsets[cell]; i < end; ++i) {
+				if (mvecObjects[mvecCellObjects[i]]->HitTest(inRay, tmin, tmax, rec)) {
+					is_hit = true;
+				}
+			}
+			return is_hit;
+		}
+
+		// any triangle of the cell hit before the ray leaves the cell at tnext.
+		inline bool intersect_cell(int cell, Ray const& inRay, float tnext, float& tvalue) const {
+			if (!mvecCellSubGrids.empty() && mvecCellSubGrids[cell] >= 0) {
+				return intersect_sub_grid(mvecSubGrids[mvecCellSubGrids[cell]], inRay, tnext, tvalue);
+			}
+
+			int end = mvecCellOffsets[cell + 1];
+			for (int i = mvecCellOffsets[cell]; i < end; ++i) {
+				if (mvecObjects[mvecCellObjects[i]]->IntersectP(inRay, tvalue) && tvalue < tnext) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+	private:
+		vector<int>	mvecCellOffsets; // mnX * mnY * mnZ + 1 offsets into mvecCellObjects
+		vector<int>	mvecCellObjects; // the indices of the triangles in its base objects, cell by cell
+		vector<int>	mvecCellSubGrids; // the sub-grid of each cell or -1, empty in the flat mode
+		vector<SubGrid>	mvecSubGrids;
+		int			mnX;
+		int			mnY;
+		int			mnZ;
         float       mSpeedupFactor;
+		bool		mbHierarchy;
+		int			mnMaxCellTriangles;
+		BuildStats	mBuildStats;
+
+	};
+
+	//
+	// The triangles are kept in a flattened depth-first BVH, it adapts to the uneven triangle density
+	// much better than the uniform grid does (a small teapot in a large room, etc.).
+	class BVHMeshObject : public MeshObjectBase {
+	public:
+		BVHMeshObject();
+		virtual ~BVHMeshObject();
+
+	public:
+		virtual void *Clone();
+
+	public:
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const;
+		virtual bool IntersectP(Ray const& inRay, float& tvalue) const;
+
+	public:
+		// From IAccelerationGeometric
+		virtual void BuildupAccelerationStructure();
+
+	public:
+		void SetMaxLeafTriangles(int count);
+		inline void SetBVHBuildMode(EBVHBuildMode mode, int threadCount = 0) { mBVH.SetBuildMode(mode, threadCount); }
+
+		// For the frames of a deforming mesh: the vertices in the mesh desc moved but the faces are the same,
+		// call Update for the triangles' normals first. The BVH is refitted instead of rebuilt, unless its SAH cost
+		// has grown beyond the rebuild ratio times the one of the last build. Returns true if it was rebuilt.
+		bool RefitAccelerationStructure();
+		inline void SetRefitRebuildRatio(float ratio) { mfRefitRebuildRatio = ratio; }
+
+		inline const BVHTree& GetBVH() const { return mBVH; }
 
+		// The huge meshes keep the BVH in the 4-wide quantized nodes instead (takes effect at the next build),
+		// several times smaller for a few more slab tests. A compressed BVH is rebuilt instead of refitted.
+		inline void EnableCompressedNodes(bool enable) { mbCompressedNodes = enable; }
+		inline const QuantizedBVH& GetQuantizedBVH() const { return mQuantizedBVH; }
+
+		// The size of whichever layout has been built, to compare the compressed one with the full-precision one.
+		int NodeCount() const;
+		float BytesPerTriangle() const;
+
+		virtual size_t MemoryUsage() const;
+
+	protected:
+		virtual void release_acceleration_structure();
+
+	private:
+		void collect_triangle_bounds(vector<AABB>& triangleBounds);
+		bool has_acceleration_structure() const;
+
+	private:
+		BVHTree						mBVH;
+		QuantizedBVH				mQuantizedBVH;
+		vector<GeometricObject * >	mvecLeafObjects; // just the references in the order of the leaf ranges, so we don't release them.
+		int							mnMaxLeafTriangles;
+		float						mfRefitRebuildRatio;
+		bool						mbCompressedNodes;
+
+	};
+
+	//
+	// The triangles are kept in an SAH kd-tree, its leaves don't overlap, so the closest hit is found in the
+	// front-most leaves and the rest of the tree is never visited. It suits the static scenes with large
+	// empty spaces and big axis-aligned walls (the architectural ones) best, but it can't be refitted.
+	class KDTreeMeshObject : public MeshObjectBase {
+	public:
+		KDTreeMeshObject();
+		virtual ~KDTreeMeshObject();
+
+	public:
+		virtual void *Clone();
+
+	public:
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const;
+		virtual bool IntersectP(Ray const& inRay, float& tvalue) const;
+
+	public:
+		// From IAccelerationGeometric
+		virtual void BuildupAccelerationStructure();
+
+	public:
+		// maxDepth 0 is picked by the triangle count.
+		void SetMaxLeafTriangles(int count);
+		void SetMaxDepth(int depth);
+		inline void SetCosts(float intersectCost, float traversalCost, float emptyBonus) { mKDTree.SetCosts(intersectCost, traversalCost, emptyBonus); }
+
+		inline const KDTree& GetKDTree() const { return mKDTree; }
+
+		virtual size_t MemoryUsage() const;
+
+	protected:
+		virtual void release_acceleration_structure();
+
+	private:
+		KDTree		mKDTree;
+		int			mnMaxLeafTriangles;
+		int			mnMaxDepth;
+
+	};
+
+	//
+	// The triangles are not objects here, but the indices into the contiguous arrays: the positions, normals
+	// and uvs stay in the mesh desc, the face indices, face normals and areas are kept by the object itself.
+	// There is no allocation, no pointer and no virtual call per triangle, the BVH leaves are the ranges
+	// of the face arrays, which are reordered after the BVH is built. The hit triangle is shaded only
+	// once the closest one is found.
+	// All the triangles share the material set by SetMaterial, the sub-object materials and the tessellation
+	// functions work on the triangle objects, so they are not supported by the triangle soup.
+	class TriangleSoupMeshObject : public MeshObjectBase {
+	public:
+		TriangleSoupMeshObject();
+		virtual ~TriangleSoupMeshObject();
+
+	public:
+		virtual void *Clone();
+
+	public:
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const;
+		virtual bool IntersectP(Ray const& inRay, float& tvalue) const;
+
+	public:
+		virtual float Area() const;
+		virtual bool GetBoundingBox(float t0, float t1, AABB& bounding);
+		virtual void Update(float t);
+		virtual Vec3f SampleRandomPoint() const;
+		virtual float PDFValue(Vec3f const& o, Vec3f const& v) const;
+		virtual Vec3f SampleRandomDirection(Vec3f const& v) const;
+
+	public:
+		// From IMeshFileReaderSink
+		virtual void OnReadFaceRecord(int& index0, int& index1, int& index2);
+
+	public:
+		// From IAccelerationGeometric
+		virtual void BuildupAccelerationStructure();
+
+	public:
+		void SetMaxLeafTriangles(int count);
+		inline void SetBVHBuildMode(EBVHBuildMode mode, int threadCount = 0) { mBVH.SetBuildMode(mode, threadCount); }
+
+		// The same as BVHMeshObject's, Update recomputes the face normals and areas (and the vertex normals of the
+		// smooth shading), the refit repacks the triangle blocks.
+		bool RefitAccelerationStructure();
+		inline void SetRefitRebuildRatio(float ratio) { mfRefitRebuildRatio = ratio; }
+
+		inline int TriangleCount() const { return (int)mvecFaces.size(); }
+		inline const BVHTree& GetBVH() const { return mBVH; }
+
+		// The leaves are tested by the widest kernel the CPU supports by default,
+		// TRIANGLE_KERNEL_NONE goes back to the one-by-one SimpleTriangle::HitTestImpl test.
+		void SetTriangleKernel(ETriangleKernel kernel);
+		inline ETriangleKernel GetTriangleKernel() const { return mTriangleKernel; }
+
+		// The per-triangle records in the leaf order trade memory for fewer loads and flops per test: the affine
+		// records (48 bytes per triangle) or the vertex copies for the watertight test (36 bytes), whose shared
+		// edges never let a ray through. The records are tested one triangle at a time instead of the kernel's
+		// blocks, TRIANGLE_RECORD_NONE goes back to the blocks. Takes effect at the next build or refit.
+		inline void SetTriangleRecord(ETriangleRecord record) { mTriangleRecord = record; }
+		inline ETriangleRecord GetTriangleRecord() const { return mTriangleRecord; }
+
+		// Micro-benchmark: rayCount random rays are tested against all the triangles (without the BVH)
+		// by the given kernel, prints and returns the triangle tests per second.
+		double BenchmarkTriangleTests(int rayCount, ETriangleKernel kernel);
+
+		virtual size_t MemoryUsage() const;
+
+	protected:
+		virtual void release_acceleration_structure();
+		virtual void release_triangles();
+		virtual void reserve_triangles(int count);
+
+		virtual void update_mesh_normals(MeshDesc *meshDesc);
+
+	private:
+		// One triangle through its record if there are any, or through the face indices.
+		inline bool hit_triangle(const int index, Ray const& inRay, WatertightRay const& shearRay, const float& tmin, float& tmax,
+			float& beta, float& gamma, HitRecord& rec) const {
+			if (!mvecAffineRecords.empty()) {
+				return TriangleKernel::HitAffine(mvecAffineRecords[index], inRay, tmin, tmax, beta, gamma);
+			}
+			if (!mvecVertexRecords.empty()) {
+				return TriangleKernel::HitWatertight(mvecVertexRecords[index], inRay, shearRay, tmin, tmax, beta, gamma);
+			}
+
+			TriFace const& face = mvecFaces[index];
+			return SimpleTriangle::HitTestImpl(mpMeshDesc->mesh_vertices[face.index0], mpMeshDesc->mesh_vertices[face.index1],
+				mpMeshDesc->mesh_vertices[face.index2], mvecFaceNormals[index], Color3f(1.0f, 1.0f, 1.0f),
+				beta, gamma, inRay, tmin, tmax, rec);
+		}
+
+		inline bool intersect_triangle(const int index, Ray const& inRay, WatertightRay const& shearRay, float& tvalue) const {
+			if (!mvecAffineRecords.empty()) {
+				return TriangleKernel::AnyHitAffine(mvecAffineRecords[index], inRay, tvalue);
+			}
+			if (!mvecVertexRecords.empty()) {
+				return TriangleKernel::AnyHitWatertight(mvecVertexRecords[index], inRay, shearRay, tvalue);
+			}
+
+			TriFace const& face = mvecFaces[index];
+			return SimpleTriangle::IntersectPImpl(mpMeshDesc->mesh_vertices[face.index0], mpMeshDesc->mesh_vertices[face.index1],
+				mpMeshDesc->mesh_vertices[face.index2], inRay, tvalue);
+		}
+
+		// the leaves are tested by the kernel's blocks, unless there are records or no kernel.
+		inline bool use_triangle_blocks() const {
+			return mTriangleKernel != TRIANGLE_KERNEL_NONE && mvecAffineRecords.empty() && mvecVertexRecords.empty();
+		}
+
+		void shade_triangle(const int index, Ray const& inRay, const float t,
+			const float beta, const float gamma, HitRecord& rec) const;
+
+		void collect_triangle_bounds(vector<AABB>& triangleBounds) const;
+		void build_triangle_blocks();
+		void build_triangle_records();
+
+	private:
+		BVHTree			mBVH;
+		vector<TriFace>	mvecFaces;			// in the order of the BVH leaves once it is built
+		vector<Vec3f>	mvecFaceNormals;
+		vector<float>	mvecFaceAreas;
+		float			mfTotalArea;
+		float			mfInvAreaSum;
+		int				mnMaxLeafTriangles;
+		float			mfRefitRebuildRatio;
+
+		ETriangleKernel		mTriangleKernel;
+		TriangleBlockArray	mvecBlocks;		// the leaves' triangles in SoA form, 4 per block
+		vector<int>			mvecNodeBlocks;	// the first block of each leaf node, -1 for the interior nodes
+
+		ETriangleRecord					mTriangleRecord;
+		vector<TriangleAffineRecord>	mvecAffineRecords;	// one per face in the face order, or empty
+		vector<TriangleVertexRecord>	mvecVertexRecords;	// one per face in the face order, or empty
+
+	};
+
+	//
+	// A/B benchmark of the mesh accelerations upon one mesh desc (e.g. each mesh of a BART scene), so the structure
+	// can be picked per object: the grid, the BVH, the triangle soup and the kd-tree are built upon the same triangles,
+	// then the same random rays are traced through each of them. Prints the build time, the memory, the rays per second
+	// and the hits of each, the hits have to agree.
+	class MeshAccelerationBenchmark {
+	public:
+		static void Run(const int meshResID, const EMeshType meshType, int rayCount);
+
+	private:
+		static void run_one(const char *name, MeshObjectBase *meshObject, vector<Ray> const& rays);
 	};
 }
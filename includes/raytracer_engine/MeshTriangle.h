@@ -30,7 +30,7 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) {
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const {
 			Vec3f& v0 = mpMeshDesc->mesh_vertices[mnIndex0];
 			Vec3f& v1 = mpMeshDesc->mesh_vertices[mnIndex1];
 			Vec3f& v2 = mpMeshDesc->mesh_vertices[mnIndex2];
@@ -149,14 +149,14 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		inline float Interpolate_TexU(const float beta, const float gamma) {
+		inline float Interpolate_TexU(const float beta, const float gamma) const {
 			float inter_u = (1 - beta - gamma) * mpMeshDesc->mesh_texU[mnIndex0] +
 				beta * mpMeshDesc->mesh_texU[mnIndex1] + gamma * mpMeshDesc->mesh_texU[mnIndex2];
 			
 			return inter_u;
 		}
 
-		inline float Interpolate_TexV(const float beta, const float gamma) {
+		inline float Interpolate_TexV(const float beta, const float gamma) const {
 			float inter_v = (1 - beta - gamma) * mpMeshDesc->mesh_texV[mnIndex0] +
 				beta * mpMeshDesc->mesh_texV[mnIndex1] + gamma * mpMeshDesc->mesh_texV[mnIndex2];
 
@@ -199,7 +199,7 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) {
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const {
 			return MeshTriangle::HitTest(inRay, tmin, tmax, rec);
 		}
 
@@ -241,7 +241,7 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) {
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const {
 			Vec3f& v0 = mpMeshDesc->mesh_vertices[mnIndex0];
 			Vec3f& v1 = mpMeshDesc->mesh_vertices[mnIndex1];
 			Vec3f& v2 = mpMeshDesc->mesh_vertices[mnIndex2];
@@ -270,7 +270,7 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		inline Vec3f Interpolate_Normal(const float beta, const float gamma) {
+		inline Vec3f Interpolate_Normal(const float beta, const float gamma) const {
 			return ((1 - beta - gamma) * mpMeshDesc->mesh_normal[mnIndex0] +
 				beta * mpMeshDesc->mesh_normal[mnIndex1] + gamma * mpMeshDesc->mesh_normal[mnIndex2]);
 		}
@@ -299,7 +299,7 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) {
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const {
 			Vec3f& v0 = mpMeshDesc->mesh_vertices[mnIndex0];
 			Vec3f& v1 = mpMeshDesc->mesh_vertices[mnIndex1];
 			Vec3f& v2 = mpMeshDesc->mesh_vertices[mnIndex2];
@@ -352,7 +352,7 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) {
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const {
 			Vec3f& v0 = mpMeshDesc->mesh_vertices[mnIndex0];
 			Vec3f& v1 = mpMeshDesc->mesh_vertices[mnIndex1];
 			Vec3f& v2 = mpMeshDesc->mesh_vertices[mnIndex2];
@@ -33,6 +33,22 @@ namespace LaplataRayTracer {
 			return true;
 		}
 
+		virtual bool GetMotionInterval(float& time0, float& time1) const
+		{
+			time0 = mTime0;
+			time1 = mTime1;
+
+			return (mTime1 > mTime0);
+		}
+
+		virtual bool GetBoundingBoxAt(float time, AABB& bounding)
+		{
+			Vec3f pos = getPos(time);
+			bounding = AABB(pos - Vec3f(mfRadius, mfRadius, mfRadius), pos + Vec3f(mfRadius, mfRadius, mfRadius));
+
+			return true;
+		}
+
 	public:
 		inline void SetPos1(Vec3f const& pos1) { mPos1 = pos1; }
 		inline void SetMovingTime(float time0, float time1) {
@@ -191,7 +191,7 @@ namespace  LaplataRayTracer {
         MultiJitteredSampler *multiJitteredSampler = new MultiJitteredSampler(256, 1);
 
         for (int i = 0; i < kTableSize; ++i) {
-            Point2f sample2f = multiJitteredSampler->SampeFromOneSet();
+            Point2f sample2f = multiJitteredSampler->SampeFromOneSet(i);
             r1 	= sample2f.X();
             r2 	= sample2f.Y();
             z 	= 1.0f - 2.0f * r1;
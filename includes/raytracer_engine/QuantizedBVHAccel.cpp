@@ -0,0 +1,230 @@
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include "Utility.h"
+#include "QuantizedBVHAccel.h"
+
+namespace LaplataRayTracer
+{
+	//
+	inline static AABB node_box(BVHNode const& node) {
+		return AABB(node.mBounds[0], node.mBounds[1], node.mBounds[2], node.mBounds[3], node.mBounds[4], node.mBounds[5]);
+	}
+
+	inline static float box_min(AABB const& box, int axis) { return (axis == 0) ? box.mX0 : ((axis == 1) ? box.mY0 : box.mZ0); }
+	inline static float box_max(AABB const& box, int axis) { return (axis == 0) ? box.mX1 : ((axis == 1) ? box.mY1 : box.mZ1); }
+
+	//
+	QuantizedBVH::QuantizedBVH() {
+		mfBuildTime = 0.0f;
+	}
+
+	QuantizedBVH::~QuantizedBVH() {
+		Clear();
+	}
+
+	//
+	void QuantizedBVH::Build(BVHTree const& tree) {
+		Clear();
+
+		if (tree.IsEmpty()) {
+			return;
+		}
+
+		std::chrono::high_resolution_clock::time_point start_time = std::chrono::high_resolution_clock::now();
+
+		mBounds = node_box(tree.GetNodes()[0]);
+
+		// the leaves are appended to the index list node by node, each node's leaves are consecutive.
+		mvecPrimIndices.reserve(tree.GetPrimIndices().size());
+		mvecNodes.push_back(QuantizedBVHNode());
+		collapse_recursive(tree, 0, 0);
+
+		vector<QuantizedBVHNode>(mvecNodes).swap(mvecNodes);
+
+		std::chrono::duration<float> build_time = std::chrono::high_resolution_clock::now() - start_time;
+		mfBuildTime = build_time.count();
+	}
+
+	void QuantizedBVH::Clear() {
+		mvecNodes.clear();
+		mvecPrimIndices.clear();
+	}
+
+	void QuantizedBVH::ReleasePrimIndices() {
+		vector<int>().swap(mvecPrimIndices);
+	}
+
+	size_t QuantizedBVH::MemoryUsage() const {
+		return sizeof(QuantizedBVH) + mvecNodes.capacity() * sizeof(QuantizedBVHNode) + mvecPrimIndices.capacity() * sizeof(int);
+	}
+
+	//
+	// The children of a wide node are the binary ones, opened up while there are free slots: the interior child
+	// of the largest surface area is replaced by its two children, as it's the one most rays would enter.
+	// The wide node has been allocated by its parent along with its siblings.
+	void QuantizedBVH::collapse_recursive(BVHTree const& tree, int nodeIndex, int wideIndex) {
+		BVHNodeArray const& nodes = tree.GetNodes();
+		vector<int> const& prim_indices = tree.GetPrimIndices();
+
+		int slots[QuantizedBVHNode::WIDTH];
+		int slot_count = 0;
+
+		BVHNode const& node = nodes[nodeIndex];
+		if (node.IsLeaf()) {
+			slots[slot_count++] = nodeIndex;
+		}
+		else {
+			slots[slot_count++] = nodeIndex + 1;
+			slots[slot_count++] = node.mnOffset;
+		}
+
+		while (slot_count < QuantizedBVHNode::WIDTH) {
+			int widest = -1;
+			float widest_area = -1.0f;
+			for (int i = 0; i < slot_count; ++i) {
+				BVHNode const& child = nodes[slots[i]];
+				float area = BVHTree::SurfaceArea(node_box(child));
+				if (!child.IsLeaf() && area > widest_area) {
+					widest = i;
+					widest_area = area;
+				}
+			}
+			if (widest < 0) {
+				break;
+			}
+
+			int opened = slots[widest];
+			slots[widest] = opened + 1;
+			slots[slot_count++] = nodes[opened].mnOffset;
+		}
+
+		// the interior children become consecutive nodes, the leaves consecutive ranges of the index list.
+		QuantizedBVHNode wide_node;
+		memset(&wide_node, 0, sizeof(QuantizedBVHNode));
+		wide_node.mnChildBase = (int)mvecNodes.size();
+		wide_node.mnPrimBase = (int)mvecPrimIndices.size();
+
+		AABB child_bounds[QuantizedBVHNode::WIDTH];
+		int interior_count = 0;
+		for (int i = 0; i < slot_count; ++i) {
+			BVHNode const& child = nodes[slots[i]];
+			child_bounds[i] = node_box(child);
+
+			if (child.IsLeaf() && child.mnCount <= LEAF_SLOT_PRIMS) {
+				wide_node.mnOffset[i] = (unsigned char)(mvecPrimIndices.size() - wide_node.mnPrimBase);
+				wide_node.mnCount[i] = (unsigned char)child.mnCount;
+				mvecPrimIndices.insert(mvecPrimIndices.end(), prim_indices.begin() + child.mnOffset,
+					prim_indices.begin() + child.mnOffset + child.mnCount);
+			}
+			else {
+				wide_node.mnInteriorMask |= (unsigned char)(1 << i);
+				wide_node.mnOffset[i] = (unsigned char)interior_count++;
+			}
+		}
+		quantize_children(wide_node, child_bounds, slot_count);
+
+		mvecNodes.resize(mvecNodes.size() + interior_count);
+		mvecNodes[wideIndex] = wide_node;
+
+		for (int i = 0; i < slot_count; ++i) {
+			if (!wide_node.IsInterior(i)) {
+				continue;
+			}
+
+			BVHNode const& child = nodes[slots[i]];
+			int child_index = wide_node.mnChildBase + wide_node.mnOffset[i];
+			if (child.IsLeaf()) {
+				split_leaf_recursive(prim_indices, child.mnOffset, child.mnCount, child_bounds[i], child_index);
+			}
+			else {
+				collapse_recursive(tree, slots[i], child_index);
+			}
+		}
+	}
+
+	// An oversized leaf: up to 8 slots of LEAF_SLOT_PRIMS primitives, or 8 nodes splitting the range further.
+	void QuantizedBVH::split_leaf_recursive(vector<int> const& primIndices, int first, int count, AABB const& bounds, int wideIndex) {
+		QuantizedBVHNode wide_node;
+		memset(&wide_node, 0, sizeof(QuantizedBVHNode));
+		wide_node.mnChildBase = (int)mvecNodes.size();
+		wide_node.mnPrimBase = (int)mvecPrimIndices.size();
+
+		AABB child_bounds[QuantizedBVHNode::WIDTH];
+		int slot_count;
+		int interior_count = 0;
+		if (count <= QuantizedBVHNode::WIDTH * LEAF_SLOT_PRIMS) {
+			slot_count = (count + LEAF_SLOT_PRIMS - 1) / LEAF_SLOT_PRIMS;
+			for (int i = 0; i < slot_count; ++i) {
+				wide_node.mnOffset[i] = (unsigned char)(i * LEAF_SLOT_PRIMS);
+				wide_node.mnCount[i] = (unsigned char)std::min<int>(LEAF_SLOT_PRIMS, count - i * LEAF_SLOT_PRIMS);
+			}
+			mvecPrimIndices.insert(mvecPrimIndices.end(), primIndices.begin() + first, primIndices.begin() + first + count);
+		}
+		else {
+			slot_count = QuantizedBVHNode::WIDTH;
+			for (int i = 0; i < slot_count; ++i) {
+				wide_node.mnInteriorMask |= (unsigned char)(1 << i);
+				wide_node.mnOffset[i] = (unsigned char)interior_count++;
+			}
+		}
+		for (int i = 0; i < slot_count; ++i) {
+			child_bounds[i] = bounds;
+		}
+		quantize_children(wide_node, child_bounds, slot_count);
+
+		mvecNodes.resize(mvecNodes.size() + interior_count);
+		mvecNodes[wideIndex] = wide_node;
+
+		// more than 8 x LEAF_SLOT_PRIMS, so none of the 8 parts is empty.
+		int part = (count + QuantizedBVHNode::WIDTH - 1) / QuantizedBVHNode::WIDTH;
+		for (int i = 0; i < interior_count; ++i) {
+			split_leaf_recursive(primIndices, first + i * part, std::min<int>(part, count - i * part), bounds,
+				wide_node.mnChildBase + i);
+		}
+	}
+
+	void QuantizedBVH::quantize_children(QuantizedBVHNode& node, AABB const childBounds[], int childCount) {
+		for (int axis = 0; axis < 3; ++axis) {
+			float lo = FLT_MAX, hi = -FLT_MAX;
+			for (int i = 0; i < childCount; ++i) {
+				lo = std::min<float>(lo, box_min(childBounds[i], axis));
+				hi = std::max<float>(hi, box_max(childBounds[i], axis));
+			}
+
+			// the smallest power of 2 whose 255 cells cover the extent, one more if the rounding of
+			// the origin's addition falls short of it.
+			int exponent;
+			std::frexp((hi - lo) / 255.0f, &exponent);
+			exponent = RTMath::Clamp(exponent, -126, 127);
+			while (exponent < 127 && lo + 255.0f * exponent_scale(exponent) < hi) {
+				++exponent;
+			}
+
+			float scale = exponent_scale(exponent);
+			node.mOrigin[axis] = lo;
+			node.mExponent[axis] = (signed char)exponent;
+
+			// round outwards, then step further out while the decoded plane, computed the way the traversal does,
+			// still cuts into the full-precision box.
+			for (int i = 0; i < childCount; ++i) {
+				float child_lo = box_min(childBounds[i], axis);
+				float child_hi = box_max(childBounds[i], axis);
+
+				int q_lo = RTMath::Clamp((int)std::floor((child_lo - lo) / scale), 0, 255);
+				int q_hi = RTMath::Clamp((int)std::ceil((child_hi - lo) / scale), 0, 255);
+				while (q_lo > 0 && lo + q_lo * scale > child_lo) { --q_lo; }
+				while (q_hi < 255 && lo + q_hi * scale < child_hi) { ++q_hi; }
+
+				node.mQLo[axis][i] = (unsigned char)q_lo;
+				node.mQHi[axis][i] = (unsigned char)q_hi;
+			}
+
+			for (int i = childCount; i < QuantizedBVHNode::WIDTH; ++i) {
+				node.mQLo[axis][i] = 255;
+				node.mQHi[axis][i] = 0;
+			}
+		}
+	}
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include "Common.h"
+#include "Vec3.h"
+#include "Ray.h"
+#include "AABB.h"
+#include "BVHAccel.h"
+
+namespace LaplataRayTracer
+{
+	//-----------------------------------------------------------------
+	// QuantizedBVHNode is an 8-wide node of 88 bytes. The boxes of the 8 children are stored as 8-bit offsets
+	// upon a grid spanning their union: the grid starts at mOrigin and its cell is 2^mExponent along each axis,
+	// so decoding a plane is exact, origin + q * 2^e. The offsets are rounded outwards, the decoded boxes always
+	// contain the full-precision ones.
+	// The interior children of a node are consecutive nodes from mnChildBase, the primitives of its leaf children
+	// are consecutive slots of the primitive index list from mnPrimBase, so a child only needs a byte of offset.
+	// A leaf lives in the slot of its parent, the empty slots have inverted boxes (lo 255, hi 0) that no ray hits.
+	// A source leaf of more than LEAF_SLOT_PRIMS primitives would not fit the bytes, it becomes a node of its own
+	// whose slots share its box and take LEAF_SLOT_PRIMS primitives each, further nodes below when 8 are too few.
+	//-----------------------------------------------------------------
+	struct QuantizedBVHNode
+	{
+		float			mOrigin[3];
+		signed char		mExponent[3];
+		unsigned char	mnInteriorMask;	// bit i: child i is a node
+		int				mnChildBase;
+		int				mnPrimBase;
+		unsigned char	mnOffset[8];	// interior: the child node after mnChildBase, leaf: its first slot after mnPrimBase
+		unsigned char	mnCount[8];		// primitive count of the leaf children, 0 for the others
+		unsigned char	mQLo[3][8];		// x0, y0, z0 of each child
+		unsigned char	mQHi[3][8];		// x1, y1, z1 of each child
+
+		static const int WIDTH = 8;
+
+		inline bool IsInterior(int child) const { return ((mnInteriorMask >> child) & 1) != 0; }
+	};
+
+	//
+	// The compressed form of a BVHTree for the scenes whose acceleration structure takes too much memory:
+	// the binary tree is collapsed into 8-wide nodes with quantized child boxes, and there are no separate
+	// leaf nodes. The leaves are the ones of the source tree, but the primitive index list is reordered so
+	// the leaves of a node follow each other, the user maps the leaf ranges through this tree's GetPrimIndices.
+	class QuantizedBVH
+	{
+	public:
+		QuantizedBVH();
+		~QuantizedBVH();
+
+	public:
+		// The source tree may be released afterwards, built by any of its modes. Its motion bounds are not kept.
+		void Build(BVHTree const& tree);
+		void Clear();
+
+		// Like BVHTree::ReleasePrimIndices, for the user who has reordered its primitives in the leaf order.
+		void ReleasePrimIndices();
+
+		inline float BuildTime() const { return mfBuildTime; }
+		size_t MemoryUsage() const;
+
+	public:
+		inline bool IsEmpty() const { return mvecNodes.empty(); }
+		inline int NodeCount() const { return (int)mvecNodes.size(); }
+		inline const vector<QuantizedBVHNode>& GetNodes() const { return mvecNodes; }
+		inline const vector<int>& GetPrimIndices() const { return mvecPrimIndices; }
+		inline AABB const& Bounds() const { return mBounds; }
+
+	public:
+		// Walks the leaves hit within [tmin, tmax], the children of a node nearest first. leafFn(offset, count, tmax)
+		// tests the leaf's primitives and shrinks tmax to its closest hit, returning true ends the walk at once
+		// (the any-hit queries), Traverse returns true then. The subtrees farther than tmax are skipped.
+		template <typename LeafFn>
+		bool Traverse(Ray const& ray, float tmin, float& tmax, LeafFn leafFn) const {
+			float tnear;
+			const float root_bounds[6] = { mBounds.mX0, mBounds.mX1, mBounds.mY0, mBounds.mY1, mBounds.mZ0, mBounds.mZ1 };
+			if (mvecNodes.empty() || !BVHTree::HitBounds(root_bounds, ray, tmin, tmax, tnear)) {
+				return false;
+			}
+
+			TodoItem todo[QuantizedBVH::STACK_SIZE];
+			int todo_count = 0;
+
+			todo[todo_count].index = 0;
+			todo[todo_count].count = 0;
+			todo[todo_count].tnear = tnear;
+			++todo_count;
+
+			while (todo_count > 0) {
+				TodoItem item = todo[--todo_count];
+				if (item.tnear > tmax) {
+					continue;
+				}
+
+				if (item.count > 0) {
+					if (leafFn(item.index, item.count, tmax)) {
+						return true;
+					}
+					continue;
+				}
+
+				// the hit children are pushed farthest first, so the nearest one is popped next.
+				TodoItem hits[QuantizedBVHNode::WIDTH];
+				BVHTree::CountNodeFetch(&mvecNodes[item.index]);
+				int hit_count = hit_children(mvecNodes[item.index], ray, tmin, tmax, hits);
+				for (int i = 0; i < hit_count; ++i) {
+					todo[todo_count++] = hits[i];
+				}
+			}
+
+			return false;
+		}
+
+	public:
+		// At most 8 leaves of LEAF_SLOT_PRIMS in a node, so the first slot of the last one stays below 256.
+		static const int LEAF_SLOT_PRIMS = 32;
+		// The levels of nodes an oversized leaf is split into, 32 x 8^4 > 65535 primitives (BVHNode::mnCount).
+		static const int LEAF_SPLIT_DEPTH = 4;
+		// Every node pushes at most 7 siblings of the child it continues with.
+		static const int STACK_SIZE = (QuantizedBVHNode::WIDTH - 1) * (BVHTree::MAX_DEPTH + LEAF_SPLIT_DEPTH) + QuantizedBVHNode::WIDTH;
+
+	private:
+		struct TodoItem {
+			int		index;	// node index, or the first leaf slot
+			int		count;	// 0 for a node, the primitive count of a leaf
+			float	tnear;
+		};
+
+	private:
+		inline static float exponent_scale(int exponent) {
+			union { unsigned int u; float f; } scale;
+			scale.u = (unsigned int)(exponent + 127) << 23;
+			return scale.f;
+		}
+
+		// The slab tests of the children upon the decoded boxes, axis by axis over all the slots (the empty ones
+		// have inverted boxes, they miss), then the hit ones are sorted farthest first.
+		inline int hit_children(QuantizedBVHNode const& node, Ray const& ray, float tmin, float tmax, TodoItem hits[]) const {
+			Vec3f const& o = ray.O();
+			Vec3f const& inv_d = ray.InvD();
+
+			float t0[QuantizedBVHNode::WIDTH], t1[QuantizedBVHNode::WIDTH];
+			for (int i = 0; i < QuantizedBVHNode::WIDTH; ++i) {
+				t0[i] = tmin;
+				t1[i] = tmax;
+			}
+
+			for (int axis = 0; axis < 3; ++axis) {
+				const unsigned char *near_q = ray.Sign(axis) ? node.mQHi[axis] : node.mQLo[axis];
+				const unsigned char *far_q = ray.Sign(axis) ? node.mQLo[axis] : node.mQHi[axis];
+				float scale = exponent_scale(node.mExponent[axis]);
+				float origin = node.mOrigin[axis];
+				float o_axis = o[axis], inv_d_axis = inv_d[axis];
+
+				for (int i = 0; i < QuantizedBVHNode::WIDTH; ++i) {
+					float near_t = (origin + near_q[i] * scale - o_axis) * inv_d_axis;
+					float far_t = (origin + far_q[i] * scale - o_axis) * inv_d_axis;
+					t0[i] = std::max<float>(near_t, t0[i]);
+					t1[i] = std::min<float>(far_t, t1[i]);
+				}
+			}
+
+			int hit_count = 0;
+			for (int i = 0; i < QuantizedBVHNode::WIDTH; ++i) {
+				if (t0[i] <= t1[i]) {
+					int k = hit_count++;
+					while (k > 0 && hits[k - 1].tnear < t0[i]) {
+						hits[k] = hits[k - 1];
+						--k;
+					}
+
+					bool interior = node.IsInterior(i);
+					hits[k].index = (interior ? node.mnChildBase : node.mnPrimBase) + node.mnOffset[i];
+					hits[k].count = interior ? 0 : node.mnCount[i];
+					hits[k].tnear = t0[i];
+				}
+			}
+
+			return hit_count;
+		}
+
+		void collapse_recursive(BVHTree const& tree, int nodeIndex, int wideIndex);
+		void split_leaf_recursive(vector<int> const& primIndices, int first, int count, AABB const& bounds, int wideIndex);
+		static void quantize_children(QuantizedBVHNode& node, AABB const childBounds[], int childCount);
+
+	private:
+		vector<QuantizedBVHNode>	mvecNodes;
+		vector<int>				mvecPrimIndices;
+		AABB					mBounds;
+		float					mfBuildTime;
+
+	};
+}
@@ -6,15 +6,46 @@
 
 namespace LaplataRayTracer
 {
-	inline unsigned long long MNWZ() { return 0x100000000; }
-	inline unsigned long long ANWZ() { return 0x5DEECE66D;  }
-	inline unsigned long long CNWZ() { return 0xB16; }
-	inline unsigned long long INFINITY2() { return 0xFFFFFFFFFFFFLL; } // conflict with something already exists 
+	//
+	// PCG32 (O'Neill, pcg-random.org): 64 bits of state, 32 bits out, one stream per odd increment.
+	class PCG32
+	{
+	public:
+		PCG32() : mlState(0x853C49E6748FEA9BULL), mlInc(0xDA3E39CB94B95BDBULL) { }
 
-	static unsigned long long seed = 1;
+	public:
+		inline void Seed(unsigned long long initState, unsigned long long initSeq)
+		{
+			mlState = 0;
+			mlInc = (initSeq << 1) | 1;
+			NextUInt();
+			mlState += initState;
+			NextUInt();
+		}
 
-	const float 	invRAND_MAX = 1.0f / (float)RAND_MAX;
+		inline unsigned int NextUInt()
+		{
+			unsigned long long old_state = mlState;
+			mlState = old_state * 6364136223846793005ULL + mlInc;
+			unsigned int xorshifted = (unsigned int)(((old_state >> 18) ^ old_state) >> 27);
+			unsigned int rot = (unsigned int)(old_state >> 59);
+			return (xorshifted >> rot) | (xorshifted << ((0u - rot) & 31));
+		}
+
+		// [0, 1)
+		inline float NextFloat() { return (float)(NextUInt() >> 8) * (1.0f / 16777216.0f); }
+		inline double NextDouble() { return (double)NextUInt() * (1.0 / 4294967296.0); }
+
+	private:
+		unsigned long long	mlState;
+		unsigned long long	mlInc;
+
+	};
 
+	//
+	// All the random numbers of the renderer come from the calling thread's PCG32 stream, there is no state shared
+	// between the threads. The renderer restarts the stream for each (pixel, sample, dimension) with SeedThread,
+	// so an image doesn't depend on the thread count nor on the order of the tiles.
 	class Random
 	{
 	public:
@@ -24,39 +55,54 @@ namespace LaplataRayTracer
 	public:
 		inline static void srand48(unsigned int i)
 		{
-			seed = (((long long int)i) << 16) | rand();
+			SeedThread(i);
 		}
-		
+
 		inline static double drand48()
 		{
-			seed = (ANWZ() * seed + CNWZ()) & INFINITY2();
-			unsigned int x = seed >> 16;
-			return ((double)x / (double)MNWZ());
+			return ThreadGenerator().NextDouble();
 		}
 
 		inline static float frand48()
 		{
-			return (float)drand48();
+			return ThreadGenerator().NextFloat();
+		}
+
+		// The stream of the calling thread restarts from (pixel, sample, dimension): the dimension tells the
+		// streams of a sample apart (the camera's, the path's...), the draws go on from there.
+		inline static void SeedThread(unsigned long long pixel, unsigned long long sample = 0, unsigned long long dimension = 0)
+		{
+			unsigned long long h = Hash(Hash(Hash(pixel) ^ sample) ^ dimension);
+			ThreadGenerator().Seed(h, Hash(h));
+		}
+
+		// The generator of the calling thread, for the code which keeps a stream per path (WavefrontPathTracer).
+		inline static PCG32& ThreadGenerator()
+		{
+			static thread_local PCG32 generator;
+			return generator;
 		}
 
 		inline static void SetSeed(unsigned int s)
 		{
-			srand(s);
+			SeedThread(s);
 		}
 
 		inline static void SetSeedWithTime()
 		{
-			srand(time(0));
+			SeedThread((unsigned long long)time(0));
 		}
 
+		// [0, 2^31)
 		inline static int RandInt()
 		{
-			return rand();
+			return (int)(ThreadGenerator().NextUInt() & 0x7FFFFFFF);
 		}
 
+		// [0, 1)
 		inline static float RandFloat()
 		{
-			return (float)RandInt() * invRAND_MAX;
+			return ThreadGenerator().NextFloat();
 		}
 
 		inline static float RandFloat(float low, float high)
@@ -68,6 +114,15 @@ namespace LaplataRayTracer
 		{
 			return ((int)(RandFloat(0, high - low + 1) + low));
 		}
+
+		// splitmix64's finalizer, for the stateless choices (SamplerBase's sets)
+		inline static unsigned long long Hash(unsigned long long x)
+		{
+			x += 0x9E3779B97F4A7C15ULL;
+			x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+			return x ^ (x >> 31);
+		}
 	};
 
 }
@@ -7,11 +7,11 @@ namespace LaplataRayTracer
 	class Ray
 	{
 	public:
-		Ray() { }
+		Ray() { update_inverse_direction(); }
 		Ray(Vec3f const& o, Vec3f const& d, float t)
 			: mo(o), md(d), mt(t)
 		{
-
+			update_inverse_direction();
 		}
 		~Ray() { }
 
@@ -27,16 +27,34 @@ namespace LaplataRayTracer
 			mo = o;
 			md = d;
 			mt = t;
+
+			update_inverse_direction();
 		}
 
 		inline Vec3f O() const { return mo; }
 		inline Vec3f D() const { return md; }
 		inline float T() const { return mt; }
 
+		// The reciprocal direction and the sign bits (1: negative) are computed once when the ray is built,
+		// all the slab tests of the traversal use them instead of dividing by the direction.
+		inline Vec3f const& InvD() const { return mInvD; }
+		inline int Sign(const int axis) const { return mSign[axis]; }
+
+	private:
+		inline void update_inverse_direction()
+		{
+			mInvD.Set(1.0f / md.X(), 1.0f / md.Y(), 1.0f / md.Z());
+			mSign[0] = (mInvD.X() < 0.0f);
+			mSign[1] = (mInvD.Y() < 0.0f);
+			mSign[2] = (mInvD.Z() < 0.0f);
+		}
+
 	private:
 		Vec3f mo;
 		Vec3f md;
 		float mt;
+		Vec3f mInvD;
+		int	  mSign[3];
 
 	};
 }
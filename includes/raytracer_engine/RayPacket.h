@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include "Common.h"
+#include "Vec3.h"
+#include "Ray.h"
+#include "HitRecord.h"
+
+namespace LaplataRayTracer
+{
+	//
+	// A bundle of coherent rays (the primary rays of a tile of neighbouring samples) which walks down
+	// the scene BVH together, see SceneObjects::ClosestHitPacket.
+	// A node is culled for the whole packet at once by interval arithmetic upon the origins and the
+	// reciprocal directions of the rays, this is valid only when all the rays go the same way on each
+	// axis, which is the case of the primary rays of a small tile; otherwise only the per-ray tests are used.
+	// Each ray keeps its own closest hit, they are shaded one by one from there.
+	class RayPacket
+	{
+	public:
+		static const int TILE_SIZE = 8;
+		static const int MAX_SIZE = TILE_SIZE * TILE_SIZE;
+
+	public:
+		RayPacket()
+			: mnCount(0), mbInterval(false), mfMaxT(FLT_MAX)
+		{
+
+		}
+
+		~RayPacket() { }
+
+	public:
+		inline void Clear() { mnCount = 0; mbInterval = false; }
+		inline int Count() const { return mnCount; }
+		inline bool IsFull() const { return mnCount == MAX_SIZE; }
+
+		inline void Add(Ray const& ray)
+		{
+			mRays[mnCount] = ray;
+			mbHit[mnCount] = false;
+			mfTMax[mnCount] = FLT_MAX;
+			++mnCount;
+		}
+
+		inline Ray& GetRay(int index) { return mRays[index]; }
+		inline Ray const& GetRay(int index) const { return mRays[index]; }
+		inline bool IsHit(int index) const { return mbHit[index]; }
+		inline HitRecord& GetHitRecord(int index) { return mHitRecs[index]; }
+
+	public:
+		// Computes the bounds of the origins and of the reciprocal directions, after the last Add.
+		inline void Prepare()
+		{
+			mbInterval = (mnCount > 1);
+			if (mnCount == 0) { return; }
+
+			for (int axis = 0; axis < 3; ++axis) {
+				int sign = mRays[0].Sign(axis);
+				float omin = mRays[0].O()[axis], omax = omin;
+				float imin = mRays[0].InvD()[axis], imax = imin;
+
+				for (int i = 1; i < mnCount; ++i) {
+					float o = mRays[i].O()[axis];
+					float inv_d = mRays[i].InvD()[axis];
+					omin = std::min<float>(omin, o); omax = std::max<float>(omax, o);
+					imin = std::min<float>(imin, inv_d); imax = std::max<float>(imax, inv_d);
+					if (mRays[i].Sign(axis) != sign) { mbInterval = false; }
+				}
+
+				// a ray parallel to a slab makes the products undefined.
+				if (!std::isfinite(imin) || !std::isfinite(imax)) { mbInterval = false; }
+
+				mfOMin[axis] = omin; mfOMax[axis] = omax;
+				mfInvDMin[axis] = imin; mfInvDMax[axis] = imax;
+				mnSign[axis] = sign;
+			}
+
+			UpdateMaxT();
+		}
+
+		// The farthest distance any ray still accepts a hit at, it only shrinks during the traversal.
+		inline void UpdateMaxT()
+		{
+			mfMaxT = 0.0f;
+			for (int i = 0; i < mnCount; ++i) {
+				mfMaxT = std::max<float>(mfMaxT, mfTMax[i]);
+			}
+		}
+
+		// Conservative test of a node (the BVHNode bounds layout) for the whole packet,
+		// false means none of the rays can hit it.
+		inline bool HitNodeInterval(const float bounds[6], float tmin) const
+		{
+			if (!mbInterval) { return true; }
+
+			float t0 = tmin;
+			float t1 = mfMaxT;
+			for (int axis = 0; axis < 3; ++axis) {
+				float near_plane = bounds[2 * axis + mnSign[axis]];
+				float far_plane = bounds[2 * axis + 1 - mnSign[axis]];
+
+				float lo, hi;
+				product_interval(near_plane - mfOMax[axis], near_plane - mfOMin[axis], mfInvDMin[axis], mfInvDMax[axis], lo, hi);
+				t0 = std::max<float>(t0, lo);
+
+				product_interval(far_plane - mfOMax[axis], far_plane - mfOMin[axis], mfInvDMin[axis], mfInvDMax[axis], lo, hi);
+				t1 = std::min<float>(t1, hi);
+			}
+
+			return (t0 <= t1);
+		}
+
+	private:
+		inline static void product_interval(float a0, float a1, float b0, float b1, float& lo, float& hi)
+		{
+			float p0 = a0 * b0, p1 = a0 * b1, p2 = a1 * b0, p3 = a1 * b1;
+			lo = std::min<float>(std::min<float>(p0, p1), std::min<float>(p2, p3));
+			hi = std::max<float>(std::max<float>(p0, p1), std::max<float>(p2, p3));
+		}
+
+	public:
+		int			mnCount;
+		Ray			mRays[MAX_SIZE];
+		bool		mbHit[MAX_SIZE];
+		float		mfTMax[MAX_SIZE];
+		HitRecord	mHitRecs[MAX_SIZE];
+
+	private:
+		bool		mbInterval;
+		float		mfMaxT;
+		int			mnSign[3];
+		float		mfOMin[3], mfOMax[3];
+		float		mfInvDMin[3], mfInvDMax[3];
+	};
+}
@@ -37,6 +37,26 @@ namespace LaplataRayTracer
 
 	public:
 		virtual Color3f Run(Ray& ray, int depath = 0, int maxDepath = 0) = 0;
+		// Carries on from the closest hit of the ray found already (by a packet traversal, see RayPacket),
+		// the tracer which doesn't split its Run this way just traces the ray again.
+		virtual Color3f RunFromHit(Ray& ray, bool /*bHitAnything*/, HitRecord& /*hitRec*/, int depth = 0, int maxDepth = 0)
+		{
+			return this->Run(ray, depth, maxDepth);
+		}
+		// colors[i] is the color of rays[i]. The tracers which work a ray at a time run them one by one,
+		// the batched ones (IsBatched, see WavefrontPathTracer) take the whole batch stage by stage.
+		virtual void RunBatch(Ray *rays, int count, Color3f *colors, int maxDepth = 0)
+		{
+			for (int i = 0; i < count; ++i) {
+				colors[i] = this->Run(rays[i], 0, maxDepth);
+			}
+		}
+		virtual bool IsBatched() const { return false; }
+		// The parallel rendering gives each worker thread the tracer made here, for the tracers which keep
+		// per-call state (the batched ones); nullptr: the workers share this one, which is only read.
+		virtual RayTracer *CreateWorkerTracer() const { return nullptr; }
+		// Takes what a worker tracer (made by CreateWorkerTracer) gathered, before the rendering deletes it.
+		virtual void MergeWorkerTracer(RayTracer const *) { }
 
 	public:
 		virtual void SetRTEnv(RTEnv env)
@@ -59,27 +79,14 @@ namespace LaplataRayTracer
 	public:
 		virtual Color3f Run(Ray& ray, int depth = 0, int maxDepth = 0)
 		{
-			float ft = 0.0f;
-			float tmax = FLT_MAX;
-			float t = FLT_MAX;
-			bool bHitAnything = false;
 			HitRecord hitRec;
-			HitRecord hitTempRec;
-			int count = mRTEvn.mpvecHitableObjs->size();
-			for (int i = 0; i < count; ++i)
-			{
-				bool bHit = (*mRTEvn.mpvecHitableObjs)[i]->HitTest(ray, ft, t, hitTempRec);
-				if (bHit)
-				{
-					if (t < tmax) {
-						tmax = t;
-				        hitTempRec.wpt = ray.O() + hitTempRec.t * ray.D();
-						hitRec = hitTempRec;
-						bHitAnything = true;
-					}
-				}
-			}
+			bool bHitAnything = mRTEvn.mpvecHitableObjs->ClosestHit(ray, hitRec);
 
+			return this->RunFromHit(ray, bHitAnything, hitRec, depth, maxDepth);
+		}
+
+		virtual Color3f RunFromHit(Ray& ray, bool bHitAnything, HitRecord& hitRec, int /*depth*/ = 0, int /*maxDepth*/ = 0)
+		{
 			if (!bHitAnything) {
                 return mRTEvn.mpBackground->Shade(ray);
 			}
@@ -116,27 +123,14 @@ namespace LaplataRayTracer
 				return BLACK;
 			}
 
-			float ft = 0.0f;
-			float tmax = FLT_MAX;
-			float t = FLT_MAX;
-			bool bHitAnything = false;
 			HitRecord hitRec;
-			HitRecord hitTempRec;
-			int count = mRTEvn.mpvecHitableObjs->size();
-			for (int i = 0; i < count; ++i)
-			{
-				bool bHit = (*mRTEvn.mpvecHitableObjs)[i]->HitTest(ray, ft, t, hitTempRec);
-				if (bHit)
-				{
-					if (t < tmax) {
-						tmax = t;
-                        hitTempRec.wpt = ray.O() + hitTempRec.t * ray.D();
-						hitRec = hitTempRec;
-						bHitAnything = true;
-					}
-				}
-			}
+			bool bHitAnything = mRTEvn.mpvecHitableObjs->ClosestHit(ray, hitRec);
+
+			return this->RunFromHit(ray, bHitAnything, hitRec, depth, maxDepth);
+		}
 
+		virtual Color3f RunFromHit(Ray& ray, bool bHitAnything, HitRecord& hitRec, int depth = 0, int maxDepth = 0)
+		{
 			if (!bHitAnything) {
                 return mRTEvn.mpBackground->Shade(ray);
 			}
@@ -162,30 +156,30 @@ namespace LaplataRayTracer
 					if (whittedRec.feature == 1) {
 						Ray reflectedRay(hitRec.wpt, whittedRec.wr, ray.T());
 						Lr = this->Run(reflectedRay, depth + 1, maxDepth);
-						hitRec.albedo += whittedRec.cf1.Filter(t) * Lr;
+						hitRec.albedo += whittedRec.cf1.Filter(hitRec.t) * Lr;
 					}
 					else if (whittedRec.feature == 2) {
 						Ray reflectedRay(hitRec.wpt, whittedRec.wr, ray.T());
 						Lr = this->Run(reflectedRay, depth + 1, maxDepth);
-						hitRec.albedo += whittedRec.cf2.Filter(t) * Lr;
+						hitRec.albedo += whittedRec.cf2.Filter(hitRec.t) * Lr;
 					}
 					else if (whittedRec.feature == 3) {
 						Ray reflectedRay(hitRec.wpt, whittedRec.wr, ray.T());
 						Lr = whittedRec.fr * this->Run(reflectedRay, depth + 1, maxDepth) * std::fabs(Dot(hitRec.n, whittedRec.wr));
-						hitRec.albedo += whittedRec.cf1.Filter(t) * Lr;
+						hitRec.albedo += whittedRec.cf1.Filter(hitRec.t) * Lr;
 
 						Ray refractedRay(hitRec.wpt, whittedRec.wt, ray.T());
 						Lt = whittedRec.ft * this->Run(refractedRay, depth + 1, maxDepth) * std::fabs(Dot(hitRec.n, whittedRec.wt));
-						hitRec.albedo += whittedRec.cf2.Filter(t) * Lt;
+						hitRec.albedo += whittedRec.cf2.Filter(hitRec.t) * Lt;
 					}
 					else if (whittedRec.feature == 4) {
 						Ray reflectedRay(hitRec.wpt, whittedRec.wr, ray.T());
 						Lr = whittedRec.fr * this->Run(reflectedRay, depth + 1, maxDepth) * std::fabs(Dot(hitRec.n, whittedRec.wr));
-						hitRec.albedo += whittedRec.cf2.Filter(t) * Lr;
+						hitRec.albedo += whittedRec.cf2.Filter(hitRec.t) * Lr;
 
 						Ray refractedRay(hitRec.wpt, whittedRec.wt, ray.T());
 						Lt = whittedRec.ft * this->Run(refractedRay, depth + 1, maxDepth) * std::fabs(Dot(hitRec.n, whittedRec.wt));
-						hitRec.albedo += whittedRec.cf1.Filter(t) * Lt;
+						hitRec.albedo += whittedRec.cf1.Filter(hitRec.t) * Lt;
 					}
 				}
 			}
@@ -216,27 +210,14 @@ namespace LaplataRayTracer
 				return BLACK;
 			}
 
-			float ft = 0.0f;
-			float tmax = FLT_MAX;
-			float t = FLT_MAX;
-			bool bHitAnything = false;
 			HitRecord hitRec;
-			HitRecord hitTempRec;
-			int count = mRTEvn.mpvecHitableObjs->size();
-			for (int i = 0; i < count; ++i)
-			{
-				bool bHit = (*mRTEvn.mpvecHitableObjs)[i]->HitTest(ray, ft, t, hitTempRec);
-				if (bHit)
-				{
-					if (t < tmax) {
-						tmax = t;
-                        hitTempRec.wpt = ray.O() + hitTempRec.t * ray.D();
-						hitRec = hitTempRec;
-						bHitAnything = true;
-					}
-				}
-			}
+			bool bHitAnything = mRTEvn.mpvecHitableObjs->ClosestHit(ray, hitRec);
 
+			return this->RunFromHit(ray, bHitAnything, hitRec, depth, maxDepth);
+		}
+
+		virtual Color3f RunFromHit(Ray& ray, bool bHitAnything, HitRecord& hitRec, int depth = 0, int maxDepth = 0)
+		{
 			if (!bHitAnything) {
                 return mRTEvn.mpBackground->Shade(ray);
 			}
@@ -281,27 +262,14 @@ namespace LaplataRayTracer
 				return BLACK;
 			}
 
-			float ft = 0.0f;
-			float tmax = FLT_MAX;
-			float t = FLT_MAX;
-			bool bHitAnything = false;
 			HitRecord hitRec;
-			HitRecord hitTempRec;
-			int count = mRTEvn.mpvecHitableObjs->size();
-			for (int i = 0; i < count; ++i)
-			{
-				bool bHit = (*mRTEvn.mpvecHitableObjs)[i]->HitTest(ray, ft, t, hitTempRec);
-				if (bHit)
-				{
-					if (t < tmax) {
-						tmax = t;
-						hitTempRec.wpt = ray.O() + hitTempRec.t * ray.D();
-						hitRec = hitTempRec;
-						bHitAnything = true;
-					}
-				}
-			}
+			bool bHitAnything = mRTEvn.mpvecHitableObjs->ClosestHit(ray, hitRec);
+
+			return this->RunFromHit(ray, bHitAnything, hitRec, depth, maxDepth);
+		}
 
+		virtual Color3f RunFromHit(Ray& ray, bool bHitAnything, HitRecord& hitRec, int depth = 0, int maxDepth = 0)
+		{
 			if (!bHitAnything) {
                 return mRTEvn.mpBackground->Shade(ray);
 			}
@@ -398,32 +366,14 @@ namespace LaplataRayTracer
 			if (depth > maxDepth)
 				return BLACK;
 
-			// In fact, each object has its own KEpsilon Const value which represents its minimum t value
-			// If I require it from the abstract base Class' function, like KEpsilon(), it will slow down our running,
-			// so ft is not used currently.
-			float ft = 0.0f;
-			float tmax = FLT_MAX;
-			float t = FLT_MAX;
-			bool bHitAnything = false;
 			HitRecord hitRec;
-			HitRecord hitTempRec;
-			int count = mRTEvn.mpvecHitableObjs->size();
-			for (int i = 0; i < count; ++i)
-			{
-				bool bHit = (*mRTEvn.mpvecHitableObjs)[i]->HitTest(ray, ft, t, hitTempRec);
-				if (bHit)
-				{
-					if (t < tmax) {
-						tmax = t;
-                        hitTempRec.wpt = ray.O() + hitTempRec.t * ray.D();
-						hitRec = hitTempRec;
-						//	return Color3f((hitRec.n.X()+1.0f)/2.0f, (hitRec.n.Y()+1.0f)/2, (hitRec.n.Z()+1.0f)/2);
-						//	return hitRec.albedo;
-						bHitAnything = true; 
-					}
-				}
-			}
+			bool bHitAnything = mRTEvn.mpvecHitableObjs->ClosestHit(ray, hitRec);
+
+			return this->RunFromHit(ray, bHitAnything, hitRec, depth, maxDepth);
+		}
 
+		virtual Color3f RunFromHit(Ray& ray, bool bHitAnything, HitRecord& hitRec, int depth = 0, int maxDepth = 0)
+		{
 			if (!bHitAnything) {
                 return mRTEvn.mpBackground->Shade(ray);
 			}
@@ -467,23 +417,14 @@ namespace LaplataRayTracer
                 return BLACK;
             }
 
-			float ft = 0.0f;
-			float t = FLT_MAX;
-			bool bHitAnything = false;
 			HitRecord hitRec;
-			HitRecord hitTempRec;
-			int count = mRTEvn.mpvecHitableObjs->size();
-			for (int i = 0; i < count; ++i)
-			{
-				bool bHit = (*mRTEvn.mpvecHitableObjs)[i]->HitTest(ray, ft, t, hitTempRec);
-				if (bHit)
-				{
-                    hitTempRec.wpt = ray.O() + hitTempRec.t * ray.D();
-					hitRec = hitTempRec;
-					bHitAnything = true;
-				}
-			}
+			bool bHitAnything = mRTEvn.mpvecHitableObjs->ClosestHit(ray, hitRec);
 
+			return this->RunFromHit(ray, bHitAnything, hitRec, depth, maxDepth);
+		}
+
+		virtual Color3f RunFromHit(Ray& ray, bool bHitAnything, HitRecord& hitRec, int depth = 0, int maxDepth = 0)
+		{
 			if (!bHitAnything) {
 			//	g_Console.Write("exit\n");
                 return mRTEvn.mpBackground->Shade(ray);
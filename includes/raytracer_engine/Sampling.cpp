@@ -6,35 +6,31 @@ namespace LaplataRayTracer
 	//
 	// SamplerBase
 	//
+	thread_local SamplerBase::SampleCursor SamplerBase::mThreadCursor = { 0, 0, 0, false, 0 };
+
 	//
 	SamplerBase::SamplerBase(void)
-		: mnSampleCount(1), mnSets(83), mlCount(0), mnJump(0)
+		: mnSampleCount(1), mnSets(83), mpTables(new SampleTables)
 	{
-			mvecSamples_UnitSquare.reserve(mnSampleCount * mnSets);
+			mpTables->mvecSamples_UnitSquare.reserve(mnSampleCount * mnSets);
 			SetupShuffleIndices();
 	}
 	SamplerBase::SamplerBase(const int num)
-		: mnSampleCount(num), mnSets(83), mlCount(0), mnJump(0)
+		: mnSampleCount(num), mnSets(83), mpTables(new SampleTables)
 	{
-		mvecSamples_UnitSquare.reserve(mnSampleCount * mnSets);
+		mpTables->mvecSamples_UnitSquare.reserve(mnSampleCount * mnSets);
 		SetupShuffleIndices();
 	}
 	SamplerBase::SamplerBase(const int num, const int numSet)
-		: mnSampleCount(num), mnSets(numSet), mlCount(0), mnJump(0)
+		: mnSampleCount(num), mnSets(numSet), mpTables(new SampleTables)
 	{
-		mvecSamples_UnitSquare.reserve(mnSampleCount * mnSets);
+		mpTables->mvecSamples_UnitSquare.reserve(mnSampleCount * mnSets);
 		SetupShuffleIndices();
 	}
 	SamplerBase::SamplerBase(const SamplerBase& s)
 		: mnSampleCount(s.mnSampleCount),
 		mnSets(s.mnSets),
-		mvecSamples_UnitSquare(s.mvecSamples_UnitSquare),
-		mvecShuffledIndices(s.mvecShuffledIndices),
-		mvecSamples_UnitDisk(s.mvecSamples_UnitDisk),
-		mvecSamples_HemiShpere(s.mvecSamples_HemiShpere),
-		mvecSamples_Shpere(s.mvecSamples_Shpere),
-		mlCount(s.mlCount),
-		mnJump(s.mnJump)
+		mpTables(s.mpTables)
 	{
 
 	}
@@ -45,13 +41,7 @@ namespace LaplataRayTracer
 
 		mnSampleCount = rhs.mnSampleCount;
 		mnSets = rhs.mnSets;
-		mvecSamples_UnitSquare = rhs.mvecSamples_UnitSquare;
-		mvecShuffledIndices = rhs.mvecShuffledIndices;
-		mvecSamples_UnitDisk = rhs.mvecSamples_UnitDisk;
-		mvecSamples_HemiShpere = rhs.mvecSamples_HemiShpere;
-		mvecSamples_Shpere = rhs.mvecSamples_Shpere;
-		mlCount = rhs.mlCount;
-		mnJump = rhs.mnJump;
+		mpTables = rhs.mpTables;
 
 		return (*this);
 	}
@@ -71,55 +61,72 @@ namespace LaplataRayTracer
 		return mnSampleCount;
 	}
 
+	SampleTables& SamplerBase::mutable_tables(void)
+	{
+		if (mpTables.use_count() > 1)
+			mpTables.reset(new SampleTables(*mpTables));
+
+		return (*mpTables);
+	}
+
 	void SamplerBase::ShuffleXCoordinates(void)
 	{
+		vector<Point2f>& samples = mutable_tables().mvecSamples_UnitSquare;
+
 		for (int p = 0; p < mnSets; p++)
 			for (int i = 0; i < mnSampleCount - 1; i++) {
 				int target = Random::RandInt() % mnSampleCount + p * mnSampleCount;
-				float temp = mvecSamples_UnitSquare[i + p * mnSampleCount + 1].x;
-				mvecSamples_UnitSquare[i + p * mnSampleCount + 1].x = mvecSamples_UnitSquare[target].x;
-				mvecSamples_UnitSquare[target].x = temp;
+				float temp = samples[i + p * mnSampleCount + 1].x;
+				samples[i + p * mnSampleCount + 1].x = samples[target].x;
+				samples[target].x = temp;
 			}
 	}
 	void SamplerBase::ShuffleYCoordinates(void)
 	{
+		vector<Point2f>& samples = mutable_tables().mvecSamples_UnitSquare;
+
 		for (int p = 0; p < mnSets; p++)
 			for (int i = 0; i < mnSampleCount - 1; i++) {
 				int target = Random::RandInt() % mnSampleCount + p * mnSampleCount;
-				float temp = mvecSamples_UnitSquare[i + p * mnSampleCount + 1].y;
-				mvecSamples_UnitSquare[i + p * mnSampleCount + 1].y = mvecSamples_UnitSquare[target].y;
-				mvecSamples_UnitSquare[target].y = temp;
+				float temp = samples[i + p * mnSampleCount + 1].y;
+				samples[i + p * mnSampleCount + 1].y = samples[target].y;
+				samples[target].y = temp;
 			}
 	}
 	void SamplerBase::SetupShuffleIndices(void)
 	{
-		mvecShuffledIndices.reserve(mnSampleCount * mnSets);
+		vector<int>& shuffled_indices = mutable_tables().mvecShuffledIndices;
+		shuffled_indices.clear();
+		shuffled_indices.reserve(mnSampleCount * mnSets);
 		vector<int> indices;
 
 		for (int j = 0; j < mnSampleCount; j++)
 			indices.push_back(j);
 
 		for (int p = 0; p < mnSets; p++) {
-			random_shuffle(indices.begin(), indices.end());
+			// Fisher-Yates upon the thread's stream
+			for (int j = mnSampleCount - 1; j > 0; j--)
+				std::swap(indices[j], indices[Random::RandInt() % (j + 1)]);
 
 			for (int j = 0; j < mnSampleCount; j++)
-				mvecShuffledIndices.push_back(indices[j]);
+				shuffled_indices.push_back(indices[j]);
 		}
 	}
 
 	void SamplerBase::MapSamplesToUnitDisk(void)
 	{
-		int size = mvecSamples_UnitSquare.size();
+		SampleTables& tables = mutable_tables();
+		int size = tables.mvecSamples_UnitSquare.size();
 		float r, phi;		// polar coordinates
 		Point2f sp; 		// sample point on unit disk
 
-		mvecSamples_UnitDisk.reserve(size);
+		tables.mvecSamples_UnitDisk.resize(size);
 
 		for (int j = 0; j < size; j++) {
 			// map sample point to [-1, 1] X [-1,1]
 
-			sp.x = 2.0f * mvecSamples_UnitSquare[j].x - 1.0f;
-			sp.y = 2.0f * mvecSamples_UnitSquare[j].y - 1.0f;
+			sp.x = 2.0f * tables.mvecSamples_UnitSquare[j].x - 1.0f;
+			sp.y = 2.0f * tables.mvecSamples_UnitSquare[j].y - 1.0f;
 
 			if (sp.x > -sp.y) {			// sectors 1 and 2
 				if (sp.x > sp.y) {		// sector 1
@@ -147,26 +154,28 @@ namespace LaplataRayTracer
 
 			phi *= PI_CONST / 4.0;
 
-			mvecSamples_UnitDisk[j].x = r * std::cos(phi);
-			mvecSamples_UnitDisk[j].y = r * std::sin(phi);
+			tables.mvecSamples_UnitDisk[j].x = r * std::cos(phi);
+			tables.mvecSamples_UnitDisk[j].y = r * std::sin(phi);
 		}
 
 	//	mvecSamples_UnitSquare.erase(mvecSamples_UnitSquare.begin(), mvecSamples_UnitSquare.end());
 	}
 	void SamplerBase::MapSamplesToHemiShpere(const float exp)
 	{
-		int size = mvecSamples_UnitSquare.size();
-		mvecSamples_HemiShpere.reserve(mnSampleCount * mnSets);
+		SampleTables& tables = mutable_tables();
+		int size = tables.mvecSamples_UnitSquare.size();
+		tables.mvecSamples_HemiShpere.clear();
+		tables.mvecSamples_HemiShpere.reserve(mnSampleCount * mnSets);
 
 		for (int j = 0; j < size; j++) {
-			float cos_phi = std::cos(2.0f * PI_CONST * mvecSamples_UnitSquare[j].x);
-			float sin_phi = std::sin(2.0f * PI_CONST * mvecSamples_UnitSquare[j].x);
-			float cos_theta = std::pow((1.0f - mvecSamples_UnitSquare[j].y), 1.0f / (exp + 1.0f));
+			float cos_phi = std::cos(2.0f * PI_CONST * tables.mvecSamples_UnitSquare[j].x);
+			float sin_phi = std::sin(2.0f * PI_CONST * tables.mvecSamples_UnitSquare[j].x);
+			float cos_theta = std::pow((1.0f - tables.mvecSamples_UnitSquare[j].y), 1.0f / (exp + 1.0f));
 			float sin_theta = std::sqrt(1.0f - cos_theta * cos_theta);
 			float pu = sin_theta * cos_phi;
 			float pv = sin_theta * sin_phi;
 			float pw = cos_theta;
-			mvecSamples_HemiShpere.push_back(Point3f(pu, pv, pw));
+			tables.mvecSamples_HemiShpere.push_back(Point3f(pu, pv, pw));
 		}
 	}
 	void SamplerBase::MapSamplesToShpere(void)
@@ -175,52 +184,102 @@ namespace LaplataRayTracer
 		float x, y, z;
 		float r, phi;
 
-		mvecSamples_Shpere.reserve(mnSampleCount * mnSets);
+		SampleTables& tables = mutable_tables();
+		tables.mvecSamples_Shpere.clear();
+		tables.mvecSamples_Shpere.reserve(mnSampleCount * mnSets);
 
 		for (int j = 0; j < mnSampleCount * mnSets; j++) {
-			r1 = mvecSamples_UnitSquare[j].x;
-			r2 = mvecSamples_UnitSquare[j].y;
+			r1 = tables.mvecSamples_UnitSquare[j].x;
+			r2 = tables.mvecSamples_UnitSquare[j].y;
 			z = 1.0f - 2.0f * r1;
 			r = std::sqrt(1.0f - z * z);
 			phi = TWO_PI_CONST * r2;
 			x = r * std::cos(phi);
 			y = r * std::sin(phi);
-			mvecSamples_Shpere.push_back(Point3f(x, y, z));
+			tables.mvecSamples_Shpere.push_back(Point3f(x, y, z));
 		}
 	}
 
-	Point2f	SamplerBase::SampleFromUnitSquare(void)
+	//
+	// The set is hashed from the pixel and from the run of mnSampleCount indices the index falls in, so the
+	// neighbouring pixels don't share patterns and a pixel with more sub-samples than a set moves on to another
+	// set every mnSampleCount of them. The samples of a set are taken in their shuffled order.
+	int SamplerBase::table_index(unsigned long long pixel, int index, int set) const
 	{
-		if (mlCount % mnSampleCount == 0)  									// start of a new pixel
-			mnJump = (Random::RandInt() % mnSets) * mnSampleCount;				// random index jump initialised to zero in constructor
-
-		return (mvecSamples_UnitSquare[mnJump + mvecShuffledIndices[mnJump + mlCount++ % mnSampleCount]]);
+		unsigned long long run = (unsigned long long)(index / mnSampleCount);
+		unsigned long long key = Random::Hash(Random::Hash(pixel) ^ run);
+		int first = (int)((key + (unsigned long long)set) % (unsigned long long)mnSets) * mnSampleCount;
+		return (first + mpTables->mvecShuffledIndices[first + index % mnSampleCount]);
 	}
-	Point2f SamplerBase::SampleFromUnitDisk(void)
+
+	int SamplerBase::next_table_index(void) const
 	{
-		if (mlCount % mnSampleCount == 0)  									// start of a new pixel
-			mnJump = (Random::RandInt() % mnSets) * mnSampleCount;
+		SampleCursor& cursor = mThreadCursor;
+		if (cursor.active)
+			return table_index(cursor.pixel, cursor.index, cursor.set++);
 
-		return (mvecSamples_UnitDisk[mnJump + mvecShuffledIndices[mnJump + mlCount++ % mnSampleCount]]);
+		unsigned long count = cursor.count++;
+		return table_index(cursor.pixel, (int)(count % mnSampleCount), cursor.set + (int)(count / mnSampleCount));
 	}
-	Point3f SamplerBase::SampleFromHemishpere(void)
+
+	void SamplerBase::BeginSample(unsigned long long pixel, int index, int firstSet)
 	{
-		if (mlCount % mnSampleCount == 0)  									// start of a new pixel
-			mnJump = (Random::RandInt() % mnSets) * mnSampleCount;
+		SampleCursor& cursor = mThreadCursor;
+		cursor.pixel = pixel;
+		cursor.index = index;
+		cursor.set = firstSet;
+		cursor.active = true;
+	}
+	void SamplerBase::BeginSampleStream(unsigned long long pixel, int firstSet)
+	{
+		SampleCursor& cursor = mThreadCursor;
+		cursor.pixel = pixel;
+		cursor.set = firstSet;
+		cursor.active = false;
+		cursor.count = 0;
+	}
 
-		return (mvecSamples_HemiShpere[mnJump + mvecShuffledIndices[mnJump + mlCount++ % mnSampleCount]]);
+	Point2f	SamplerBase::SampleFromUnitSquare(unsigned long long pixel, int index, int set) const
+	{
+		return (mpTables->mvecSamples_UnitSquare[table_index(pixel, index, set)]);
 	}
-	Point3f SamplerBase::SampleFromShpere(void)
+	Point2f SamplerBase::SampleFromUnitDisk(unsigned long long pixel, int index, int set) const
 	{
-		if (mlCount % mnSampleCount == 0)  									// start of a new pixel
-			mnJump = (Random::RandInt() % mnSets) * mnSampleCount;
+		return (mpTables->mvecSamples_UnitDisk[table_index(pixel, index, set)]);
+	}
+	Point3f SamplerBase::SampleFromHemishpere(unsigned long long pixel, int index, int set) const
+	{
+		return (mpTables->mvecSamples_HemiShpere[table_index(pixel, index, set)]);
+	}
+	Point3f SamplerBase::SampleFromShpere(unsigned long long pixel, int index, int set) const
+	{
+		return (mpTables->mvecSamples_Shpere[table_index(pixel, index, set)]);
+	}
 
-		return (mvecSamples_Shpere[mnJump + mvecShuffledIndices[mnJump + mlCount++ % mnSampleCount]]);
+	Point2f	SamplerBase::SampleFromUnitSquare(void) const
+	{
+		return (mpTables->mvecSamples_UnitSquare[next_table_index()]);
+	}
+	Point2f SamplerBase::SampleFromUnitDisk(void) const
+	{
+		return (mpTables->mvecSamples_UnitDisk[next_table_index()]);
+	}
+	Point3f SamplerBase::SampleFromHemishpere(void) const
+	{
+		return (mpTables->mvecSamples_HemiShpere[next_table_index()]);
+	}
+	Point3f SamplerBase::SampleFromShpere(void) const
+	{
+		return (mpTables->mvecSamples_Shpere[next_table_index()]);
 	}
 
-	Point2f SamplerBase::SampeFromOneSet(void)
+	Point2f SamplerBase::SampeFromOneSet(int index) const
+	{
+		return (mpTables->mvecSamples_UnitSquare[index % mnSampleCount]);
+	}
+	Point2f SamplerBase::SampeFromOneSet(void) const
 	{
-		return(mvecSamples_UnitSquare[mlCount++ % mnSampleCount]);
+		return SampeFromOneSet((int)(mThreadCursor.count++ % mnSampleCount));
 	}
 
 	////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -240,7 +299,7 @@ namespace LaplataRayTracer
 	RegularSampler::RegularSampler(const RegularSampler& rhs)
 		: SamplerBase(rhs)
 	{
-		this->GenerateSamples();
+
 	}
 
 	RegularSampler& RegularSampler::operator= (const RegularSampler& rhs)
@@ -263,12 +322,13 @@ namespace LaplataRayTracer
 
 	void RegularSampler::GenerateSamples(void)
 	{
+		vector<Point2f>& samples = mutable_tables().mvecSamples_UnitSquare;
 		int n = (int)std::sqrt((float)mnSampleCount);
 
 		for (int j = 0; j < mnSets; j++) {
 			for (int p = 0; p < n; p++) {
 				for (int q = 0; q < n; q++) {
-					mvecSamples_UnitSquare.push_back(Point2f((q + 0.5) / n, (p + 0.5) / n));
+					samples.push_back(Point2f((q + 0.5) / n, (p + 0.5) / n));
 				}
 			}
 		}
@@ -289,7 +349,7 @@ namespace LaplataRayTracer
 	PureRandomSampler::PureRandomSampler(const PureRandomSampler& rhs)
 		: SamplerBase(rhs)
 	{
-		this->GenerateSamples();
+
 	}
 	PureRandomSampler& PureRandomSampler::operator=(const PureRandomSampler& rhs)
 	{
@@ -311,9 +371,11 @@ namespace LaplataRayTracer
 
 	void PureRandomSampler::GenerateSamples(void)
 	{
+		vector<Point2f>& samples = mutable_tables().mvecSamples_UnitSquare;
+
 		for (int p = 0; p < mnSets; p++) {
 			for (int q = 0; q < mnSampleCount; q++) {
-				mvecSamples_UnitSquare.push_back(Point2f(Random::RandFloat(), Random::RandFloat()));
+				samples.push_back(Point2f(Random::RandFloat(), Random::RandFloat()));
 			}
 		}
 	}
@@ -338,7 +400,7 @@ namespace LaplataRayTracer
 	JitteredSampler::JitteredSampler(const JitteredSampler& rhs)
 		: SamplerBase(rhs)
 	{
-		this->GenerateSamples();
+
 	}
 	JitteredSampler& JitteredSampler::operator=(const JitteredSampler& rhs)
 	{
@@ -360,13 +422,14 @@ namespace LaplataRayTracer
 
 	void JitteredSampler::GenerateSamples(void)
 	{
+		vector<Point2f>& samples = mutable_tables().mvecSamples_UnitSquare;
 		int n = (int)std::sqrt((float)mnSampleCount);
 
 		for (int p = 0; p < mnSets; p++) {
 			for (int j = 0; j < n; j++) {
 				for (int k = 0; k < n; k++) {
 					Point2f sp((k + Random::RandFloat()) / n, (j + Random::RandFloat()) / n);
-					mvecSamples_UnitSquare.push_back(sp);
+					samples.push_back(sp);
 				}
 			}
 		}
@@ -392,7 +455,7 @@ namespace LaplataRayTracer
 	NRooksSampler::NRooksSampler(const NRooksSampler& rhs)
 		: SamplerBase(rhs)
 	{
-		this->GenerateSamples();
+
 	}
 	NRooksSampler& NRooksSampler::operator=(const NRooksSampler& rhs)
 	{
@@ -414,10 +477,12 @@ namespace LaplataRayTracer
 
 	void NRooksSampler::GenerateSamples(void)
 	{
+		vector<Point2f>& samples = mutable_tables().mvecSamples_UnitSquare;
+
 		for (int p = 0; p < mnSets; p++)
 			for (int j = 0; j < mnSampleCount; j++) {
 				Point2f sp((j + Random::RandFloat()) / mnSampleCount, (j + Random::RandFloat()) / mnSampleCount);
-				mvecSamples_UnitSquare.push_back(sp);
+				samples.push_back(sp);
 			}
 
 		SamplerBase::ShuffleXCoordinates();
@@ -444,7 +509,7 @@ namespace LaplataRayTracer
 	MultiJitteredSampler::MultiJitteredSampler(const MultiJitteredSampler& rhs)
 		: SamplerBase(rhs)
 	{
-		this->GenerateSamples();
+
 	}
 	MultiJitteredSampler& MultiJitteredSampler::operator=(const MultiJitteredSampler& rhs)
 	{
@@ -466,6 +531,8 @@ namespace LaplataRayTracer
 
 	void MultiJitteredSampler::GenerateSamples(void)
 	{
+		vector<Point2f>& samples = mutable_tables().mvecSamples_UnitSquare;
+
 		// num_samples needs to be a perfect square
 		int n = (int)std::sqrt((float)mnSampleCount);
 		float subcell_width = 1.0f / ((float)mnSampleCount);
@@ -474,14 +541,14 @@ namespace LaplataRayTracer
 		// initial patterns
 		Point2f fill_point;
 		for (int j = 0; j < mnSampleCount * mnSets; j++)
-			mvecSamples_UnitSquare.push_back(fill_point);
+			samples.push_back(fill_point);
 
 		// distribute points in the initial patterns
 		for (int p = 0; p < mnSets; p++) {
 			for (int i = 0; i < n; i++) {
 				for (int j = 0; j < n; j++) {
-					mvecSamples_UnitSquare[i * n + j + p * mnSampleCount].x = (i * n + j) * subcell_width + Random::RandFloat(0, subcell_width);
-					mvecSamples_UnitSquare[i * n + j + p * mnSampleCount].y = (j * n + i) * subcell_width + Random::RandFloat(0, subcell_width);
+					samples[i * n + j + p * mnSampleCount].x = (i * n + j) * subcell_width + Random::RandFloat(0, subcell_width);
+					samples[i * n + j + p * mnSampleCount].y = (j * n + i) * subcell_width + Random::RandFloat(0, subcell_width);
 				}
 			}
 		}
@@ -491,9 +558,9 @@ namespace LaplataRayTracer
 			for (int i = 0; i < n; i++) {
 				for (int j = 0; j < n; j++) {
 					int k = Random::RandInt(j, n - 1);
-					float t = mvecSamples_UnitSquare[i * n + j + p * mnSampleCount].x;
-					mvecSamples_UnitSquare[i * n + j + p * mnSampleCount].x = mvecSamples_UnitSquare[i * n + k + p * mnSampleCount].x;
-					mvecSamples_UnitSquare[i * n + k + p * mnSampleCount].x = t;
+					float t = samples[i * n + j + p * mnSampleCount].x;
+					samples[i * n + j + p * mnSampleCount].x = samples[i * n + k + p * mnSampleCount].x;
+					samples[i * n + k + p * mnSampleCount].x = t;
 				}
 			}
 		}
@@ -503,9 +570,9 @@ namespace LaplataRayTracer
 			for (int i = 0; i < n; i++) {
 				for (int j = 0; j < n; j++) {
 					int k = Random::RandInt(j, n - 1);
-					float t = mvecSamples_UnitSquare[j * n + i + p * mnSampleCount].y;
-					mvecSamples_UnitSquare[j * n + i + p * mnSampleCount].y = mvecSamples_UnitSquare[k * n + i + p * mnSampleCount].y;
-					mvecSamples_UnitSquare[k * n + i + p * mnSampleCount].y = t;
+					float t = samples[j * n + i + p * mnSampleCount].y;
+					samples[j * n + i + p * mnSampleCount].y = samples[k * n + i + p * mnSampleCount].y;
+					samples[k * n + i + p * mnSampleCount].y = t;
 				}
 			}
 		}
@@ -526,7 +593,7 @@ namespace LaplataRayTracer
 	HammersleySmapler::HammersleySmapler(const HammersleySmapler& rhs)
 		: SamplerBase(rhs)
 	{
-		this->GenerateSamples();
+
 	}
 	HammersleySmapler& HammersleySmapler::operator=(const HammersleySmapler& rhs)
 	{
@@ -548,10 +615,12 @@ namespace LaplataRayTracer
 
 	void HammersleySmapler::GenerateSamples(void)
 	{
+		vector<Point2f>& samples = mutable_tables().mvecSamples_UnitSquare;
+
 		for (int p = 0; p < mnSets; p++) {
 			for (int j = 0; j < mnSampleCount; j++) {
 				Point2f pv((float)j / (float)mnSampleCount, phi(j));
-				mvecSamples_UnitSquare.push_back(pv);
+				samples.push_back(pv);
 			}
 		}
 	}
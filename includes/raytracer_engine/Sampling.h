@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <memory>
 
 #include "ICloneable.h"
 #include "Point2.h"
@@ -11,6 +12,18 @@ using std::vector;
 
 namespace LaplataRayTracer
 {
+	//
+	// The precomputed samples of a sampler, mnSets sets of mnSampleCount samples each. They're written while the
+	// sampler is set up and read only afterwards, so the copies of a sampler share them (a copy about to change
+	// them gets its own first).
+	struct SampleTables {
+		vector<Point2f>			mvecSamples_UnitSquare;
+		vector<int>				mvecShuffledIndices;
+		vector<Point2f>			mvecSamples_UnitDisk;
+		vector<Point3f> 		mvecSamples_HemiShpere;
+		vector<Point3f> 		mvecSamples_Shpere;
+	};
+
 	//
 	class SamplerBase : public ICloneable {
 	public:
@@ -40,12 +53,29 @@ namespace LaplataRayTracer
 		void MapSamplesToHemiShpere(const float exp);
 		void MapSamplesToShpere(void);
 
-		Point2f	SampleFromUnitSquare(void);
-		Point2f SampleFromUnitDisk(void);
-		Point3f SampleFromHemishpere(void);
-		Point3f SampleFromShpere(void);
-
-		Point2f SampeFromOneSet(void);
+		// The index-th sample of the set picked by (pixel, set), the sampler doesn't change: any number of threads
+		// may draw from it. The sets tell apart the uses of a pixel's samples (the lens, the lights...).
+		Point2f	SampleFromUnitSquare(unsigned long long pixel, int index, int set) const;
+		Point2f SampleFromUnitDisk(unsigned long long pixel, int index, int set) const;
+		Point3f SampleFromHemishpere(unsigned long long pixel, int index, int set) const;
+		Point3f SampleFromShpere(unsigned long long pixel, int index, int set) const;
+
+		// The calling thread's sample (BeginSample), each call draws from the next set.
+		Point2f	SampleFromUnitSquare(void) const;
+		Point2f SampleFromUnitDisk(void) const;
+		Point3f SampleFromHemishpere(void) const;
+		Point3f SampleFromShpere(void) const;
+
+		Point2f SampeFromOneSet(int index) const;
+		Point2f SampeFromOneSet(void) const;
+
+		// The sample the calling thread works on, for the calls without (pixel, index, set), from the set firstSet
+		// on. Scene begins one for each sub-sample.
+		static void BeginSample(unsigned long long pixel, int index, int firstSet = 0);
+		// Leaves the sample: the calls walk the samples of pixel's sets in order, from the first sample of the set
+		// firstSet. Scene starts one per batch, whose paths are shaded interleaved, so their draws don't depend on
+		// what the thread rendered before.
+		static void BeginSampleStream(unsigned long long pixel, int firstSet = 0);
 
 	public:
 		inline static Point2f SampleInUnitDisk() {
@@ -110,15 +140,27 @@ namespace LaplataRayTracer
 		}
 
 	protected:
-		int 					mnSampleCount;
-		int 					mnSets;
-		vector<Point2f>			mvecSamples_UnitSquare;
-		vector<int>				mvecShuffledIndices;
-		vector<Point2f>			mvecSamples_UnitDisk;
-		vector<Point3f> 		mvecSamples_HemiShpere;
-		vector<Point3f> 		mvecSamples_Shpere;
-		unsigned long 			mlCount;
-		int 					mnJump;
+		// The tables to write, the sampler's own.
+		SampleTables& mutable_tables(void);
+		int table_index(unsigned long long pixel, int index, int set) const;
+		int next_table_index(void) const;
+
+	private:
+		struct SampleCursor {
+			unsigned long long	pixel;
+			int					index;
+			int					set;
+			bool				active;
+			unsigned long		count;		// out of a sample, the draws since BeginSampleStream
+		};
+
+	protected:
+		int 							mnSampleCount;
+		int 							mnSets;
+		std::shared_ptr<SampleTables>	mpTables;
+
+	private:
+		static thread_local SampleCursor	mThreadCursor;
 
 	};
 
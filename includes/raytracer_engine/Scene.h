@@ -25,6 +25,8 @@
 #include "ViewPlane.h"
 #include "Camera.h"
 #include "RayTracer.h"
+#include "WavefrontTracer.h"
+#include "TileScheduler.h"
 #include "Texture.h"
 #include "LightObject.h"
 #include "Light.h"
@@ -44,7 +46,8 @@ namespace LaplataRayTracer
 	public:
 		Scene()
 		    : mpSurface(nullptr), mpViewPlane(nullptr), mpCamera(nullptr),
-		    mpRenderWndSink(nullptr), mpViewSampler(nullptr), mpRayTracer(nullptr), mpBackground(nullptr)
+		    mpRenderWndSink(nullptr), mpViewSampler(nullptr), mpRayTracer(nullptr), mpBackground(nullptr), mbPacketTracing(true),
+		    mnRenderThreads(1), mnTileSize(16)
 		{
 
 		}
@@ -63,6 +66,18 @@ namespace LaplataRayTracer
 		inline void SetCamera(Camera *pCamear) { mpCamera = pCamear; }
 		inline void SetRayTracer(RayTracer *pRayTracer) { mpRayTracer = pRayTracer; }
         inline void SetBackground(WorldEnvironment *pSceneEnv) { mpBackground = pSceneEnv; }
+		// false: trace against all the objects one by one, to validate the scene BVH.
+		inline void EnableSceneAcceleration(bool enable) { mvecObjects.EnableAcceleration(enable); }
+		// false: trace the primary rays one by one even if the camera's rays are coherent.
+		inline void EnablePacketTracing(bool enable) { mbPacketTracing = enable; }
+
+		// 1: render on the calling thread (the default), 0: on all the hardware threads, in tiles of
+		// tileSize x tileSize pixels scheduled by work stealing.
+		inline void SetRenderThreads(int threadCount, int tileSize = 16)
+		{
+			mnRenderThreads = (threadCount >= 0) ? threadCount : 1;
+			mnTileSize = (tileSize > 0) ? tileSize : 16;
+		}
 
 	public:
 		virtual void Setup(int w = 400, int h = 400)
@@ -81,6 +96,7 @@ namespace LaplataRayTracer
 
 			// Setup rendering context & parameters.
 			RTEnv env;
+			mvecObjects.BuildupAccelerationStructure();
 			env.mpvecHitableObjs = &mvecObjects;
 			env.mpSceneLights = &mobjSceneLights;
 			env.mpBackground = mpBackground;
@@ -88,95 +104,41 @@ namespace LaplataRayTracer
 
 			// Get a ray according to the current x, y offset of the view plane
 			// Shoot the ray then use RayTracer object to trace it
-			int w = mpViewPlane->Width();
-			int h = mpViewPlane->Height();
+			RenderParams params;
+			params.w = mpViewPlane->Width();
+			params.h = mpViewPlane->Height();
+			params.enableZoom = mpCamera->IsZoomMode();
+			params.zoomFactor = mpCamera->GetZoomFactor();
+			params.usePacket = mbPacketTracing && mpCamera->IsCoherent();
+
+			if (mnRenderThreads != 1)
+			{
+				render_scene_parallel(params);
+				return;
+			}
 
-			bool enableZoom = mpCamera->IsZoomMode();
-			float zoomFactor = mpCamera->GetZoomFactor();
+			int w = params.w;
+			int h = params.h;
 
+			mvecRowColors.resize(w);
 			for (int row = 0; row < h; ++row)
 			{
-				for (int col = 0; col < w; ++col)
+				if (mpRayTracer->IsBatched())
+				{
+					// the sub-samples of a whole row are traced as one batch.
+					render_span_batched(row, 0, w, params, mobjScratch, mpRayTracer, &mvecRowColors[0]);
+				}
+				else
 				{
-					Color3f color(0.0f, 0.0f, 0.0f);
-                    /*int sampler_count = mpViewSampler->GetSampleCount();
-					for (int c = 0; c < sampler_count; ++c)
+					for (int col = 0; col < w; ++col)
 					{
-						float x;
-						float y;
-
-						Point2f sp = mpViewSampler->SampleFromUnitSquare();
-
-						if (enableZoom)
-						{
-							x = zoomFactor * (col - 0.5f * w + sp.X());
-							y = zoomFactor * (row - 0.5f * h + sp.Y());
-						}
-						else
-						{
-							x = (col - 0.5f * w + sp.X());
-							y = (row - 0.5f * h + sp.Y());
-						}
-
-						Ray ray;
-						if (mpCamera->GenerateRay(x, y, ray))
-                        {
-							color += mpRayTracer->Run(ray, 0, 10);
-						}
+						mvecRowColors[col] = render_pixel(col, row, params, mobjScratch, mpRayTracer);
 					}
-                    color /= (float)sampler_count;*/
-                    int N = 30;
-                    for (int m = 0; m < N; ++m)
-                    {
-                        for (int n = 0; n < N; ++n)
-                        {
-                            float x;
-                            float y;
-
-                            if (enableZoom)
-                            {
-                                x = zoomFactor * (col - 0.5f * w + (float)m / N);
-                                y = zoomFactor * (row - 0.5f * h + (float)n / N);
-                            }
-                            else
-                            {
-                                x = (col - 0.5f * w + (float)m / N);
-                                y = (row - 0.5f * h + (float)n / N);
-                            }
-
-                            Ray ray;
-                            if (mpCamera->GenerateRay(x, y, ray))
-                            {
-                                color += mpRayTracer->Run(ray, 0, 10);
-                            }
-                        }
-                    }
-                    color /= (N*N);
-					
-//                    float x = (col - 0.5f * w);
-//                    float y = (row - 0.5f * h);
-//                    Ray ray;
-//                    if (mpCamera->GenerateRay(x, y, ray))
-//                    {
-//                        color = mpRayTracer->Run(ray, 0, 10);
-//                    }
-
-                    // Postphone processing
-					ImageProc::De_NAN(color);
-                    ImageProc::HDR_Operator_MaxToOne(color);
-
-					int r = (int)(255.99f*color[0]);
-					int g = (int)(255.99f*color[1]);
-					int b = (int)(255.99f*color[2]);
-
-#ifdef PLATFORM_WIN
-					mpSurface->SetPixel(col, h - row - 1, RGB(r, g, b));
-#endif // PLATFORM_WIN
+				}
 
-#ifdef PLATFORM_MACOSX
-                    TGAColor pixel_color(r, g, b);
-                    mpSurface->set(col, h - row - 1, pixel_color);
-#endif // PLATFORM_MACOSX
+				for (int col = 0; col < w; ++col)
+				{
+					put_pixel(col, row, h, mvecRowColors[col]);
 				}
 
 				//
@@ -258,13 +220,345 @@ namespace LaplataRayTracer
 					delete mvecObjects[i];
 					mvecObjects[i] = nullptr;
 				}
-				mvecObjects.clear();
 			}
+			mvecObjects.clear();
+			mvecObjects.ReleaseAccelerationStructure();
 
 			//
 			mobjSceneLights.Purge();
 		}
 
+	protected:
+		struct RenderParams
+		{
+			int		w;
+			int		h;
+			bool	enableZoom;
+			float	zoomFactor;
+			bool	usePacket;
+		};
+
+		// The scratch state of a rendering thread.
+		struct RenderScratch
+		{
+			RayPacket		packet;
+			int				packetSamples[RayPacket::MAX_SIZE];	// the sub-sample of each ray of the packet
+			vector<Ray>		batchRays;
+			vector<Color3f>	batchColors;
+			vector<int>		batchPixelEnd;	// the end of each pixel's rays in batchRays
+		};
+
+		// The N x N sub-samples of a pixel, averaged.
+		Color3f render_pixel(int col, int row, RenderParams const& params, RenderScratch& scratch, RayTracer *pTracer)
+		{
+			int w = params.w;
+			int h = params.h;
+			bool enableZoom = params.enableZoom;
+			float zoomFactor = params.zoomFactor;
+
+			Color3f color(0.0f, 0.0f, 0.0f);
+            /*int sampler_count = mpViewSampler->GetSampleCount();
+			for (int c = 0; c < sampler_count; ++c)
+			{
+				float x;
+				float y;
+
+				Point2f sp = mpViewSampler->SampleFromUnitSquare();
+
+				if (enableZoom)
+				{
+					x = zoomFactor * (col - 0.5f * w + sp.X());
+					y = zoomFactor * (row - 0.5f * h + sp.Y());
+				}
+				else
+				{
+					x = (col - 0.5f * w + sp.X());
+					y = (row - 0.5f * h + sp.Y());
+				}
+
+				Ray ray;
+				if (mpCamera->GenerateRay(x, y, ray))
+                {
+					color += pTracer->Run(ray, 0, 10);
+				}
+			}
+            color /= (float)sampler_count;*/
+            int N = SUB_SAMPLES;
+            unsigned long long pixel = (unsigned long long)row * w + col;
+            if (params.usePacket)
+            {
+                // the N x N sub-samples in 8x8 tiles, each tile finds its closest hits as one packet.
+                RayPacket& packet = scratch.packet;
+                for (int m0 = 0; m0 < N; m0 += RayPacket::TILE_SIZE)
+                {
+                    for (int n0 = 0; n0 < N; n0 += RayPacket::TILE_SIZE)
+                    {
+                        packet.Clear();
+                        for (int m = m0; m < m0 + RayPacket::TILE_SIZE && m < N; ++m)
+                        {
+                            for (int n = n0; n < n0 + RayPacket::TILE_SIZE && n < N; ++n)
+                            {
+                                float x = (col - 0.5f * w + (float)m / N);
+                                float y = (row - 0.5f * h + (float)n / N);
+                                if (enableZoom)
+                                {
+                                    x *= zoomFactor;
+                                    y *= zoomFactor;
+                                }
+
+                                Ray ray;
+                                Random::SeedThread(pixel, m * N + n, RNG_CAMERA);
+                                SamplerBase::BeginSample(pixel, m * N + n, RNG_CAMERA);
+                                if (mpCamera->GenerateRay(x, y, ray))
+                                {
+                                    scratch.packetSamples[packet.Count()] = m * N + n;
+                                    packet.Add(ray);
+                                }
+                            }
+                        }
+
+                        mvecObjects.ClosestHitPacket(packet);
+                        for (int i = 0; i < packet.Count(); ++i)
+                        {
+                            Random::SeedThread(pixel, scratch.packetSamples[i], RNG_PATH);
+                            SamplerBase::BeginSample(pixel, scratch.packetSamples[i], RNG_PATH);
+                            color += pTracer->RunFromHit(packet.GetRay(i), packet.IsHit(i), packet.GetHitRecord(i), 0, 10);
+                        }
+                    }
+                }
+                color /= (N*N);
+            }
+            else
+            {
+                for (int m = 0; m < N; ++m)
+                {
+                    for (int n = 0; n < N; ++n)
+                    {
+                        float x;
+                        float y;
+
+                        if (enableZoom)
+                        {
+                            x = zoomFactor * (col - 0.5f * w + (float)m / N);
+                            y = zoomFactor * (row - 0.5f * h + (float)n / N);
+                        }
+                        else
+                        {
+                            x = (col - 0.5f * w + (float)m / N);
+                            y = (row - 0.5f * h + (float)n / N);
+                        }
+
+                        Ray ray;
+                        Random::SeedThread(pixel, m * N + n, RNG_CAMERA);
+                        SamplerBase::BeginSample(pixel, m * N + n, RNG_CAMERA);
+                        if (mpCamera->GenerateRay(x, y, ray))
+                        {
+                            Random::SeedThread(pixel, m * N + n, RNG_PATH);
+                            SamplerBase::BeginSample(pixel, m * N + n, RNG_PATH);
+                            color += pTracer->Run(ray, 0, 10);
+                        }
+                    }
+                }
+                color /= (N*N);
+            }
+
+//            float x = (col - 0.5f * w);
+//            float y = (row - 0.5f * h);
+//            Ray ray;
+//            if (mpCamera->GenerateRay(x, y, ray))
+//            {
+//                color = pTracer->Run(ray, 0, 10);
+//            }
+
+			return color;
+		}
+
+		// The sub-samples of the pixels [col0, col1) of a row as one batch, for the tracers which work
+		// stage by stage over many paths (RayTracer::IsBatched). colors[i] is the color of the pixel col0 + i.
+		void render_span_batched(int row, int col0, int col1, RenderParams const& params, RenderScratch& scratch,
+			RayTracer *pTracer, Color3f *colors)
+		{
+			const int N = SUB_SAMPLES;
+			int w = params.w;
+			int h = params.h;
+
+			scratch.batchRays.clear();
+			scratch.batchPixelEnd.resize(col1 - col0);
+			for (int col = col0; col < col1; ++col)
+			{
+				for (int m = 0; m < N; ++m)
+				{
+					for (int n = 0; n < N; ++n)
+					{
+						float x = (col - 0.5f * w + (float)m / N);
+						float y = (row - 0.5f * h + (float)n / N);
+						if (params.enableZoom)
+						{
+							x *= params.zoomFactor;
+							y *= params.zoomFactor;
+						}
+
+						Ray ray;
+						Random::SeedThread((unsigned long long)row * w + col, m * N + n, RNG_CAMERA);
+						SamplerBase::BeginSample((unsigned long long)row * w + col, m * N + n, RNG_CAMERA);
+						if (mpCamera->GenerateRay(x, y, ray))
+						{
+							scratch.batchRays.push_back(ray);
+						}
+					}
+				}
+				scratch.batchPixelEnd[col - col0] = (int)scratch.batchRays.size();
+			}
+			scratch.batchColors.resize(scratch.batchRays.size());
+			if (!scratch.batchRays.empty())
+			{
+				// the paths of the batch are shaded interleaved, they share the streams of its first pixel.
+				Random::SeedThread((unsigned long long)row * w + col0, 0, RNG_PATH);
+				SamplerBase::BeginSampleStream((unsigned long long)row * w + col0, RNG_PATH);
+				pTracer->RunBatch(&scratch.batchRays[0], (int)scratch.batchRays.size(), &scratch.batchColors[0], 10);
+			}
+
+			int begin = 0;
+			for (int col = col0; col < col1; ++col)
+			{
+				Color3f color(0.0f, 0.0f, 0.0f);
+				for (int i = begin; i < scratch.batchPixelEnd[col - col0]; ++i)
+				{
+					color += scratch.batchColors[i];
+				}
+				color /= (N*N);
+				begin = scratch.batchPixelEnd[col - col0];
+
+				colors[col - col0] = color;
+			}
+		}
+
+		//
+		// The view plane is cut into tiles run by a work-stealing scheduler (see WorkStealingScheduler). Each worker
+		// has its own scratch state and, for the tracers which keep state, its own tracer; the random streams are
+		// seeded per pixel and sample (see render_pixel), so the image doesn't depend on the thread count.
+		// The tiles write their pixels into the frame buffer, each pixel has one writer so there is no lock;
+		// the calling thread reports the progress meanwhile, then copies the frame buffer to the surface.
+		void render_scene_parallel(RenderParams const& params)
+		{
+			int w = params.w;
+			int h = params.h;
+			int tile_size = mnTileSize;
+
+			vector<RenderTile> tiles;
+			for (int y0 = 0; y0 < h; y0 += tile_size)
+			{
+				for (int x0 = 0; x0 < w; x0 += tile_size)
+				{
+					RenderTile tile;
+					tile.mnX0 = x0;
+					tile.mnY0 = y0;
+					tile.mnX1 = std::min<int>(x0 + tile_size, w);
+					tile.mnY1 = std::min<int>(y0 + tile_size, h);
+					tiles.push_back(tile);
+				}
+			}
+
+			int tile_count = (int)tiles.size();
+			int worker_count = WorkStealingScheduler::WorkerCountFor(tile_count, mnRenderThreads);
+
+			vector<RenderScratch> scratches(worker_count);
+			vector<RayTracer *> tracers(worker_count, nullptr);
+			for (int i = 0; i < worker_count; ++i)
+			{
+				tracers[i] = mpRayTracer->CreateWorkerTracer();
+			}
+
+			mvecFrameBuffer.assign((size_t)w * h, Color3f(0.0f, 0.0f, 0.0f));
+			Color3f *frame_buffer = &mvecFrameBuffer[0];
+
+			WorkStealingScheduler scheduler;
+			scheduler.Start(tile_count, worker_count, [this, &params, &tiles, &scratches, &tracers, frame_buffer](int worker, int task)
+			{
+				RenderTile const& tile = tiles[task];
+				RenderScratch& scratch = scratches[worker];
+				RayTracer *tracer = (tracers[worker] != nullptr) ? tracers[worker] : mpRayTracer;
+
+				for (int row = tile.mnY0; row < tile.mnY1; ++row)
+				{
+					Color3f *row_colors = frame_buffer + (size_t)row * params.w;
+					if (tracer->IsBatched())
+					{
+						render_span_batched(row, tile.mnX0, tile.mnX1, params, scratch, tracer, row_colors + tile.mnX0);
+					}
+					else
+					{
+						for (int col = tile.mnX0; col < tile.mnX1; ++col)
+						{
+							row_colors[col] = render_pixel(col, row, params, scratch, tracer);
+						}
+					}
+				}
+			});
+
+			// the finished tiles as rows, at most every PROGRESS_INTERVAL_MS.
+			int reported_rows = 0;
+			while (!scheduler.Wait(PROGRESS_INTERVAL_MS))
+			{
+				int done_rows = (int)((long long)h * scheduler.DoneCount() / tile_count);
+				if (mpRenderWndSink && done_rows > reported_rows)
+				{
+					mpRenderWndSink->OnNotifyRenderProgress(done_rows - 1, h);
+				}
+				reported_rows = std::max<int>(reported_rows, done_rows);
+			}
+
+			for (int i = 0; i < worker_count; ++i)
+			{
+				if (tracers[i] != nullptr)
+				{
+					mpRayTracer->MergeWorkerTracer(tracers[i]);
+					delete tracers[i];
+				}
+			}
+
+			for (int row = 0; row < h; ++row)
+			{
+				for (int col = 0; col < w; ++col)
+				{
+					put_pixel(col, row, h, mvecFrameBuffer[(size_t)row * w + col]);
+				}
+			}
+
+			if (mpRenderWndSink && reported_rows < h)
+			{
+				mpRenderWndSink->OnNotifyRenderProgress(h - 1, h);
+			}
+		}
+
+		inline void put_pixel(int col, int row, int h, Color3f color)
+		{
+			// Postphone processing
+			ImageProc::De_NAN(color);
+			ImageProc::HDR_Operator_MaxToOne(color);
+
+			int r = (int)(255.99f*color[0]);
+			int g = (int)(255.99f*color[1]);
+			int b = (int)(255.99f*color[2]);
+
+#ifdef PLATFORM_WIN
+			mpSurface->SetPixel(col, h - row - 1, RGB(r, g, b));
+#endif // PLATFORM_WIN
+
+#ifdef PLATFORM_MACOSX
+			TGAColor pixel_color(r, g, b);
+			mpSurface->set(col, h - row - 1, pixel_color);
+#endif // PLATFORM_MACOSX
+		}
+
+	protected:
+		static const int SUB_SAMPLES = 30;			// N x N sub-samples per pixel
+		static const int PROGRESS_INTERVAL_MS = 100;
+
+		// the dimensions of Random::SeedThread, a sub-sample's streams, and the first sets of SamplerBase::BeginSample
+		static const int RNG_CAMERA = 0;
+		static const int RNG_PATH = 1;
+
 //	protected:
 //		inline void showRenderingPercentage(float ration)
 //		{
@@ -296,6 +590,15 @@ namespace LaplataRayTracer
 
         WorldEnvironment *mpBackground;
 
+		bool			mbPacketTracing;
+
+		RenderScratch	mobjScratch;		// of the single-threaded rendering
+		vector<Color3f>	mvecRowColors;
+
+		int				mnRenderThreads;
+		int				mnTileSize;
+		vector<Color3f>	mvecFrameBuffer;	// of the parallel rendering
+
 	};
 
 }
@@ -14,7 +14,7 @@ namespace LaplataRayTracer
 		virtual ~NormalShpere() { }
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec)
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const
 		{
 			if (SimpleSphere::HitTest(inRay, tmin, tmax, rec)) {
 
@@ -79,7 +79,7 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec)
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const
 		{
 			if (mpProxyObject && mpProxyObject->HitTest(inRay, tmin, tmax, rec))
 			{
@@ -223,7 +223,7 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec)
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const
 		{
 			if (SimpleSphere::HitTest(inRay, tmin, tmax, rec))
 			{
@@ -0,0 +1,126 @@
+#include <chrono>
+
+#include "TileScheduler.h"
+
+namespace LaplataRayTracer
+{
+	//
+	WorkStealingScheduler::WorkStealingScheduler()
+		: mnDone(0), mnStolen(0), mnFinishedWorkers(0) {
+
+	}
+
+	WorkStealingScheduler::~WorkStealingScheduler() {
+		Wait();
+	}
+
+	int WorkStealingScheduler::HardwareThreads() {
+		int threads = (int)std::thread::hardware_concurrency();
+		return (threads > 0) ? threads : 1;
+	}
+
+	int WorkStealingScheduler::WorkerCountFor(int taskCount, int threadCount) {
+		int workers = (threadCount > 0) ? threadCount : HardwareThreads();
+		return std::max<int>(1, std::min<int>(workers, std::max<int>(taskCount, 1)));
+	}
+
+	//
+	void WorkStealingScheduler::Start(int taskCount, int threadCount, TaskFunc const& task) {
+		Wait();
+
+		int workers = WorkerCountFor(taskCount, threadCount);
+
+		mTask = task;
+		mnDone.store(0);
+		mnStolen.store(0);
+		mnFinishedWorkers = 0;
+
+		// each worker gets a run of consecutive tasks.
+		mvecQueues.resize(workers);
+		for (int w = 0; w < workers; ++w) {
+			mvecQueues[w] = new WorkQueue;
+			int begin = (int)((long long)taskCount * w / workers);
+			int end = (int)((long long)taskCount * (w + 1) / workers);
+			for (int t = begin; t < end; ++t) {
+				mvecQueues[w]->tasks.push_back(t);
+			}
+		}
+
+		mvecWorkers.reserve(workers);
+		for (int w = 0; w < workers; ++w) {
+			mvecWorkers.push_back(std::thread(&WorkStealingScheduler::worker_loop, this, w));
+		}
+	}
+
+	bool WorkStealingScheduler::Wait(int milliseconds) {
+		if (mvecWorkers.empty()) {
+			return true;
+		}
+
+		{
+			std::unique_lock<std::mutex> guard(mDoneLock);
+			int workers = (int)mvecWorkers.size();
+			if (milliseconds < 0) {
+				mDoneSignal.wait(guard, [this, workers]() { return mnFinishedWorkers == workers; });
+			}
+			else if (!mDoneSignal.wait_for(guard, std::chrono::milliseconds(milliseconds),
+				[this, workers]() { return mnFinishedWorkers == workers; })) {
+				return false;
+			}
+		}
+
+		for (size_t w = 0; w < mvecWorkers.size(); ++w) {
+			mvecWorkers[w].join();
+		}
+		mvecWorkers.clear();
+
+		for (size_t w = 0; w < mvecQueues.size(); ++w) {
+			delete mvecQueues[w];
+		}
+		mvecQueues.clear();
+
+		return true;
+	}
+
+	//
+	void WorkStealingScheduler::worker_loop(int worker) {
+		int task;
+		while (pop_own(worker, task) || steal(worker, task)) {
+			mTask(worker, task);
+			mnDone.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		std::lock_guard<std::mutex> guard(mDoneLock);
+		++mnFinishedWorkers;
+		mDoneSignal.notify_all();
+	}
+
+	bool WorkStealingScheduler::pop_own(int worker, int& task) {
+		WorkQueue& queue = *mvecQueues[worker];
+		std::lock_guard<std::mutex> guard(queue.lock);
+		if (queue.tasks.empty()) {
+			return false;
+		}
+
+		task = queue.tasks.front();
+		queue.tasks.pop_front();
+		return true;
+	}
+
+	// The victims are scanned from the next worker on, so the thieves don't all fall upon the same one.
+	bool WorkStealingScheduler::steal(int worker, int& task) {
+		int workers = (int)mvecQueues.size();
+		for (int k = 1; k < workers; ++k) {
+			WorkQueue& victim = *mvecQueues[(worker + k) % workers];
+			std::lock_guard<std::mutex> guard(victim.lock);
+			if (!victim.tasks.empty()) {
+				task = victim.tasks.back();
+				victim.tasks.pop_back();
+				mnStolen.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+
+		return false;
+	}
+}
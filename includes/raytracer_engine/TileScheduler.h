@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "Common.h"
+
+namespace LaplataRayTracer
+{
+	//-----------------------------------------------------------------
+	// A rectangle of the view plane, [mnX0, mnX1) x [mnY0, mnY1), the unit of work of the parallel rendering.
+	//-----------------------------------------------------------------
+	struct RenderTile
+	{
+		int		mnX0, mnY0;
+		int		mnX1, mnY1;
+
+		inline int PixelCount() const { return (mnX1 - mnX0) * (mnY1 - mnY0); }
+	};
+
+	//
+	// Runs the tasks 0 .. count-1 upon a set of worker threads with work stealing: each worker starts with its own
+	// run of consecutive tasks (the neighbouring tiles, which share the nodes and the textures), takes them from the
+	// front, and once it's out of work steals from the back of another worker's run, where the work is farthest
+	// from what its owner is doing. The tasks are all known upfront, so a worker whose scan finds nothing left is done.
+	class WorkStealingScheduler
+	{
+	public:
+		typedef std::function<void(int worker, int task)> TaskFunc;
+
+	public:
+		WorkStealingScheduler();
+		~WorkStealingScheduler();
+
+	public:
+		// threadCount 0 means all the hardware threads. Returns at once, the tasks run until Wait returns true.
+		void Start(int taskCount, int threadCount, TaskFunc const& task);
+		// Blocks until all the tasks are done or the milliseconds have passed (negative: no limit). True when done,
+		// the threads are joined then.
+		bool Wait(int milliseconds = -1);
+
+		inline int WorkerCount() const { return (int)mvecWorkers.size(); }
+		// The finished tasks, safe to read from any thread while running.
+		inline int DoneCount() const { return mnDone.load(std::memory_order_relaxed); }
+		// The tasks a worker took from the others in the last run, to check the balance.
+		inline int StolenCount() const { return mnStolen.load(std::memory_order_relaxed); }
+
+		static int HardwareThreads();
+		// The workers Start runs for taskCount tasks upon threadCount threads.
+		static int WorkerCountFor(int taskCount, int threadCount);
+
+	private:
+		struct WorkQueue {
+			std::mutex		lock;
+			std::deque<int>	tasks;
+		};
+
+	private:
+		void worker_loop(int worker);
+		bool pop_own(int worker, int& task);
+		bool steal(int worker, int& task);
+
+	private:
+		TaskFunc					mTask;
+		vector<WorkQueue *>			mvecQueues;
+		vector<std::thread>			mvecWorkers;
+
+		std::atomic<int>			mnDone;
+		std::atomic<int>			mnStolen;
+
+		std::mutex					mDoneLock;
+		std::condition_variable		mDoneSignal;
+		int							mnFinishedWorkers;
+
+	};
+}
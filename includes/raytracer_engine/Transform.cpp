@@ -1,3 +1,5 @@
+#include <cfloat>
+
 #include "Transform.h"
 
 namespace LaplataRayTracer {
@@ -202,6 +204,21 @@ namespace LaplataRayTracer {
 		return ret_ray;
 	}
 
+	AABB Transform::ApplyBox(AABB const& box) const {
+		Vec3f pt_min(FLT_MAX), pt_max(-FLT_MAX);
+
+		for (int i = 0; i < 8; ++i) {
+			Vec3f corner((i & 1) ? box.mX1 : box.mX0, (i & 2) ? box.mY1 : box.mY0, (i & 4) ? box.mZ1 : box.mZ0);
+			Vec3f pt;
+			apply_point_impl(mMat, corner, pt);
+
+			pt_min = Vec3f(std::min<float>(pt_min.X(), pt.X()), std::min<float>(pt_min.Y(), pt.Y()), std::min<float>(pt_min.Z(), pt.Z()));
+			pt_max = Vec3f(std::max<float>(pt_max.X(), pt.X()), std::max<float>(pt_max.Y(), pt.Y()), std::max<float>(pt_max.Z(), pt.Z()));
+		}
+
+		return AABB(pt_min, pt_max);
+	}
+
 	Vec3f Transform::InverseApplyPoint(Vec3f const& p) const {
 		Vec3f ret_pt;
 		apply_point_impl(mInvMat, p, ret_pt);
@@ -49,6 +49,8 @@ namespace LaplataRayTracer
 		Vec3f ApplyVector(Vec3f const& v) const;
 		Vec3f ApplyNormal(Vec3f const& n) const;
 		Ray ApplyRay(Ray const& ray) const;
+		// The box bounding the 8 transformed corners of box.
+		AABB ApplyBox(AABB const& box) const;
 
         	Vec3f InverseApplyPoint(Vec3f const& p) const;
         	Vec3f InverseApplyVector(Vec3f const& v) const;
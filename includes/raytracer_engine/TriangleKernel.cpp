@@ -0,0 +1,392 @@
+#include <float.h>
+#include <string.h>
+
+#include "TriangleKernel.h"
+
+#ifdef TRIANGLE_KERNEL_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TRIANGLE_KERNEL_AVX2_TARGET
+#else
+#define TRIANGLE_KERNEL_AVX2_TARGET __attribute__((target("avx2")))
+#endif // _MSC_VER
+#endif // TRIANGLE_KERNEL_X86
+
+namespace LaplataRayTracer
+{
+	//
+	static ETriangleKernel detect_kernel() {
+#ifdef TRIANGLE_KERNEL_X86
+		bool has_avx2 = false;
+#ifdef _MSC_VER
+		int cpu_info[4];
+		__cpuid(cpu_info, 0);
+		if (cpu_info[0] >= 7) {
+			__cpuid(cpu_info, 1);
+			bool os_saves_ymm = ((cpu_info[2] & (1 << 27)) != 0) && ((_xgetbv(0) & 0x6) == 0x6);
+			__cpuidex(cpu_info, 7, 0);
+			has_avx2 = os_saves_ymm && ((cpu_info[1] & (1 << 5)) != 0);
+		}
+#else
+		__builtin_cpu_init();
+		has_avx2 = (__builtin_cpu_supports("avx2") != 0);
+#endif // _MSC_VER
+
+		// SSE2 is the baseline of every x86-64 CPU.
+		return has_avx2 ? TRIANGLE_KERNEL_AVX2 : TRIANGLE_KERNEL_SSE;
+#else
+		return TRIANGLE_KERNEL_SCALAR;
+#endif // TRIANGLE_KERNEL_X86
+	}
+
+	// probed once, the meshes may be built on several threads at the same time.
+	ETriangleKernel TriangleKernel::Detect() {
+		static const ETriangleKernel kernel = detect_kernel();
+		return kernel;
+	}
+
+	const char *TriangleKernel::Name(ETriangleKernel kernel) {
+		switch (kernel) {
+		case TRIANGLE_KERNEL_NONE: return "one-by-one";
+		case TRIANGLE_KERNEL_SCALAR: return "scalar";
+		case TRIANGLE_KERNEL_SSE: return "sse";
+		case TRIANGLE_KERNEL_AVX2: return "avx2";
+		default: return "unknown";
+		}
+	}
+
+	void TriangleKernel::ClearBlock(TriangleBlock& block) {
+		memset(&block, 0, sizeof(TriangleBlock));
+	}
+
+	void TriangleKernel::PackTriangle(TriangleBlock& block, int lane, Vec3f const& v0, Vec3f const& v1, Vec3f const& v2) {
+		block.v0x[lane] = v0.X();
+		block.v0y[lane] = v0.Y();
+		block.v0z[lane] = v0.Z();
+		block.e1x[lane] = v1.X() - v0.X();
+		block.e1y[lane] = v1.Y() - v0.Y();
+		block.e1z[lane] = v1.Z() - v0.Z();
+		block.e2x[lane] = v2.X() - v0.X();
+		block.e2y[lane] = v2.Y() - v0.Y();
+		block.e2z[lane] = v2.Z() - v0.Z();
+	}
+
+	//
+	int TriangleKernel::ClosestHit(ETriangleKernel kernel, const TriangleBlock *blocks, int blockCount,
+		Ray const& inRay, const float tmin, float& tmax, float& beta, float& gamma) {
+		switch (kernel) {
+#ifdef TRIANGLE_KERNEL_X86
+		case TRIANGLE_KERNEL_AVX2:
+			return closest_hit_avx2(blocks, blockCount, inRay, tmin, tmax, beta, gamma);
+		case TRIANGLE_KERNEL_SSE:
+			return closest_hit_sse(blocks, blockCount, inRay, tmin, tmax, beta, gamma);
+#endif // TRIANGLE_KERNEL_X86
+		default:
+			return closest_hit_scalar(blocks, blockCount, inRay, tmin, tmax, beta, gamma);
+		}
+	}
+
+	int TriangleKernel::AnyHit(ETriangleKernel kernel, const TriangleBlock *blocks, int blockCount,
+		Ray const& inRay, float& tvalue) {
+		switch (kernel) {
+#ifdef TRIANGLE_KERNEL_X86
+		case TRIANGLE_KERNEL_AVX2:
+			return any_hit_avx2(blocks, blockCount, inRay, tvalue);
+		case TRIANGLE_KERNEL_SSE:
+			return any_hit_sse(blocks, blockCount, inRay, tvalue);
+#endif // TRIANGLE_KERNEL_X86
+		default:
+			return any_hit_scalar(blocks, blockCount, inRay, tvalue);
+		}
+	}
+
+	//
+	void TriangleKernel::PackAffine(TriangleAffineRecord& record, Vec3f const& v0, Vec3f const& v1, Vec3f const& v2) {
+		memset(&record, 0, sizeof(TriangleAffineRecord));
+
+		// the inverse of the matrix whose columns are e1, e2 and n = e1 x e2, its determinant is |n|^2.
+		Vec3f e1 = v1 - v0;
+		Vec3f e2 = v2 - v0;
+		Vec3f n = Cross(e1, e2);
+		float det = Dot(n, n);
+		if (det == 0.0f) {
+			return;
+		}
+		float inv_det = 1.0f / det;
+
+		Vec3f rows[3] = { Cross(e2, n) * inv_det, Cross(n, e1) * inv_det, n * inv_det };
+		for (int i = 0; i < 3; ++i) {
+			record.mRow[i][0] = rows[i].X();
+			record.mRow[i][1] = rows[i].Y();
+			record.mRow[i][2] = rows[i].Z();
+			record.mRow[i][3] = -Dot(rows[i], v0);
+		}
+	}
+
+	void TriangleKernel::SetupWatertightRay(Ray const& inRay, WatertightRay& shearRay) {
+		Vec3f const& d = inRay.D();
+
+		int kz = 0;
+		if (std::fabs(d.Y()) > std::fabs(d[kz])) { kz = 1; }
+		if (std::fabs(d.Z()) > std::fabs(d[kz])) { kz = 2; }
+		int kx = (kz + 1) % 3;
+		int ky = (kx + 1) % 3;
+
+		// keep the winding of the triangles, the edge functions' signs then tell the side.
+		if (d[kz] < 0.0f) {
+			std::swap(kx, ky);
+		}
+
+		shearRay.kx = kx;
+		shearRay.ky = ky;
+		shearRay.kz = kz;
+		shearRay.sx = d[kx] / d[kz];
+		shearRay.sy = d[ky] / d[kz];
+		shearRay.sz = 1.0f / d[kz];
+	}
+
+	//
+	// Moller-Trumbore, lane by lane.
+	int TriangleKernel::closest_hit_scalar(const TriangleBlock *blocks, int blockCount,
+		Ray const& inRay, const float tmin, float& tmax, float& beta, float& gamma) {
+		Vec3f o = inRay.O();
+		Vec3f d = inRay.D();
+		const float t_low = tmin + TriangleKernel::KEpsilon();
+		int hit_lane = -1;
+
+		for (int b = 0; b < blockCount; ++b) {
+			TriangleBlock const& block = blocks[b];
+			for (int i = 0; i < BLOCK_WIDTH; ++i) {
+				float px = d.Y() * block.e2z[i] - d.Z() * block.e2y[i];
+				float py = d.Z() * block.e2x[i] - d.X() * block.e2z[i];
+				float pz = d.X() * block.e2y[i] - d.Y() * block.e2x[i];
+				float det = block.e1x[i] * px + block.e1y[i] * py + block.e1z[i] * pz;
+				if (det == 0.0f) {
+					continue;
+				}
+				float inv_det = 1.0f / det;
+
+				float tx = o.X() - block.v0x[i], ty = o.Y() - block.v0y[i], tz = o.Z() - block.v0z[i];
+				float u = (tx * px + ty * py + tz * pz) * inv_det;
+				if (u < 0.0f || u > 1.0f) {
+					continue;
+				}
+
+				float qx = ty * block.e1z[i] - tz * block.e1y[i];
+				float qy = tz * block.e1x[i] - tx * block.e1z[i];
+				float qz = tx * block.e1y[i] - ty * block.e1x[i];
+				float v = (d.X() * qx + d.Y() * qy + d.Z() * qz) * inv_det;
+				if (v < 0.0f || u + v > 1.0f) {
+					continue;
+				}
+
+				float t = (block.e2x[i] * qx + block.e2y[i] * qy + block.e2z[i] * qz) * inv_det;
+				if (t >= t_low && t < tmax) {
+					tmax = t;
+					beta = u;
+					gamma = v;
+					hit_lane = b * BLOCK_WIDTH + i;
+				}
+			}
+		}
+
+		return hit_lane;
+	}
+
+	int TriangleKernel::any_hit_scalar(const TriangleBlock *blocks, int blockCount, Ray const& inRay, float& tvalue) {
+		float tmax = FLT_MAX;
+		float beta, gamma;
+
+		for (int b = 0; b < blockCount; ++b) {
+			int lane = closest_hit_scalar(blocks + b, 1, inRay, 0.0f, tmax, beta, gamma);
+			if (lane >= 0) {
+				tvalue = tmax;
+				return b * BLOCK_WIDTH + lane;
+			}
+		}
+
+		return -1;
+	}
+
+#ifdef TRIANGLE_KERNEL_X86
+	//
+	// 4 lanes of one block at once.
+	int TriangleKernel::closest_hit_sse(const TriangleBlock *blocks, int blockCount,
+		Ray const& inRay, const float tmin, float& tmax, float& beta, float& gamma) {
+		Vec3f o = inRay.O();
+		Vec3f d = inRay.D();
+
+		const __m128 ox = _mm_set1_ps(o.X()), oy = _mm_set1_ps(o.Y()), oz = _mm_set1_ps(o.Z());
+		const __m128 dx = _mm_set1_ps(d.X()), dy = _mm_set1_ps(d.Y()), dz = _mm_set1_ps(d.Z());
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 t_low = _mm_set1_ps(tmin + TriangleKernel::KEpsilon());
+
+		int hit_lane = -1;
+
+		for (int b = 0; b < blockCount; ++b) {
+			TriangleBlock const& block = blocks[b];
+
+			__m128 e1x = _mm_load_ps(block.e1x), e1y = _mm_load_ps(block.e1y), e1z = _mm_load_ps(block.e1z);
+			__m128 e2x = _mm_load_ps(block.e2x), e2y = _mm_load_ps(block.e2y), e2z = _mm_load_ps(block.e2z);
+
+			__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+			__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+			__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+			__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+			__m128 inv_det = _mm_div_ps(one, det);
+
+			__m128 tx = _mm_sub_ps(ox, _mm_load_ps(block.v0x));
+			__m128 ty = _mm_sub_ps(oy, _mm_load_ps(block.v0y));
+			__m128 tz = _mm_sub_ps(oz, _mm_load_ps(block.v0z));
+			__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inv_det);
+
+			__m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+			__m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+			__m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+			__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv_det);
+			__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv_det);
+
+			// the ordered compares also reject the NaNs of the empty lanes.
+			__m128 mask = _mm_cmpneq_ps(det, zero);
+			mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+			mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+			mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+			mask = _mm_and_ps(mask, _mm_cmpge_ps(t, t_low));
+			mask = _mm_and_ps(mask, _mm_cmplt_ps(t, _mm_set1_ps(tmax)));
+
+			int hit_bits = _mm_movemask_ps(mask);
+			if (hit_bits != 0) {
+				alignas(16) float t_lanes[4], u_lanes[4], v_lanes[4];
+				_mm_store_ps(t_lanes, t);
+				_mm_store_ps(u_lanes, u);
+				_mm_store_ps(v_lanes, v);
+
+				for (int i = 0; i < BLOCK_WIDTH; ++i) {
+					if ((hit_bits & (1 << i)) && t_lanes[i] < tmax) {
+						tmax = t_lanes[i];
+						beta = u_lanes[i];
+						gamma = v_lanes[i];
+						hit_lane = b * BLOCK_WIDTH + i;
+					}
+				}
+			}
+		}
+
+		return hit_lane;
+	}
+
+	int TriangleKernel::any_hit_sse(const TriangleBlock *blocks, int blockCount, Ray const& inRay, float& tvalue) {
+		float tmax = FLT_MAX;
+		float beta, gamma;
+
+		for (int b = 0; b < blockCount; ++b) {
+			int lane = closest_hit_sse(blocks + b, 1, inRay, 0.0f, tmax, beta, gamma);
+			if (lane >= 0) {
+				tvalue = tmax;
+				return b * BLOCK_WIDTH + lane;
+			}
+		}
+
+		return -1;
+	}
+
+	//
+	// 8 lanes of two neighbouring blocks at once, the odd block left is done by the sse kernel.
+	TRIANGLE_KERNEL_AVX2_TARGET
+	static inline __m256 load_block_pair(const float *lo, const float *hi) {
+		return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_load_ps(lo)), _mm_load_ps(hi), 1);
+	}
+
+	TRIANGLE_KERNEL_AVX2_TARGET
+	int TriangleKernel::closest_hit_avx2(const TriangleBlock *blocks, int blockCount,
+		Ray const& inRay, const float tmin, float& tmax, float& beta, float& gamma) {
+		Vec3f o = inRay.O();
+		Vec3f d = inRay.D();
+
+		const __m256 ox = _mm256_set1_ps(o.X()), oy = _mm256_set1_ps(o.Y()), oz = _mm256_set1_ps(o.Z());
+		const __m256 dx = _mm256_set1_ps(d.X()), dy = _mm256_set1_ps(d.Y()), dz = _mm256_set1_ps(d.Z());
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 t_low = _mm256_set1_ps(tmin + TriangleKernel::KEpsilon());
+
+		int hit_lane = -1;
+
+		int b = 0;
+		for (; b + 1 < blockCount; b += 2) {
+			TriangleBlock const& lo = blocks[b];
+			TriangleBlock const& hi = blocks[b + 1];
+
+			__m256 e1x = load_block_pair(lo.e1x, hi.e1x), e1y = load_block_pair(lo.e1y, hi.e1y), e1z = load_block_pair(lo.e1z, hi.e1z);
+			__m256 e2x = load_block_pair(lo.e2x, hi.e2x), e2y = load_block_pair(lo.e2y, hi.e2y), e2z = load_block_pair(lo.e2z, hi.e2z);
+
+			__m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+			__m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+			__m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+			__m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+			__m256 inv_det = _mm256_div_ps(one, det);
+
+			__m256 tx = _mm256_sub_ps(ox, load_block_pair(lo.v0x, hi.v0x));
+			__m256 ty = _mm256_sub_ps(oy, load_block_pair(lo.v0y, hi.v0y));
+			__m256 tz = _mm256_sub_ps(oz, load_block_pair(lo.v0z, hi.v0z));
+			__m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, px), _mm256_mul_ps(ty, py)), _mm256_mul_ps(tz, pz)), inv_det);
+
+			__m256 qx = _mm256_sub_ps(_mm256_mul_ps(ty, e1z), _mm256_mul_ps(tz, e1y));
+			__m256 qy = _mm256_sub_ps(_mm256_mul_ps(tz, e1x), _mm256_mul_ps(tx, e1z));
+			__m256 qz = _mm256_sub_ps(_mm256_mul_ps(tx, e1y), _mm256_mul_ps(ty, e1x));
+			__m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)), inv_det);
+			__m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), inv_det);
+
+			__m256 mask = _mm256_cmp_ps(det, zero, _CMP_NEQ_UQ);
+			mask = _mm256_and_ps(mask, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+			mask = _mm256_and_ps(mask, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+			mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+			mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, t_low, _CMP_GE_OQ));
+			mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, _mm256_set1_ps(tmax), _CMP_LT_OQ));
+
+			int hit_bits = _mm256_movemask_ps(mask);
+			if (hit_bits != 0) {
+				alignas(32) float t_lanes[8], u_lanes[8], v_lanes[8];
+				_mm256_store_ps(t_lanes, t);
+				_mm256_store_ps(u_lanes, u);
+				_mm256_store_ps(v_lanes, v);
+
+				for (int i = 0; i < 2 * BLOCK_WIDTH; ++i) {
+					if ((hit_bits & (1 << i)) && t_lanes[i] < tmax) {
+						tmax = t_lanes[i];
+						beta = u_lanes[i];
+						gamma = v_lanes[i];
+						hit_lane = b * BLOCK_WIDTH + i;
+					}
+				}
+			}
+		}
+
+		if (b < blockCount) {
+			int lane = closest_hit_sse(blocks + b, 1, inRay, tmin, tmax, beta, gamma);
+			if (lane >= 0) {
+				hit_lane = b * BLOCK_WIDTH + lane;
+			}
+		}
+
+		return hit_lane;
+	}
+
+	int TriangleKernel::any_hit_avx2(const TriangleBlock *blocks, int blockCount, Ray const& inRay, float& tvalue) {
+		float tmax = FLT_MAX;
+		float beta, gamma;
+
+		for (int b = 0; b < blockCount; b += 2) {
+			int count = std::min<int>(2, blockCount - b);
+			int lane = closest_hit_avx2(blocks + b, count, inRay, 0.0f, tmax, beta, gamma);
+			if (lane >= 0) {
+				tvalue = tmax;
+				return b * BLOCK_WIDTH + lane;
+			}
+		}
+
+		return -1;
+	}
+#endif // TRIANGLE_KERNEL_X86
+}
@@ -0,0 +1,233 @@
+#pragma once
+
+#include "Common.h"
+#include "Vec3.h"
+#include "Ray.h"
+#include "BVHAccel.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define TRIANGLE_KERNEL_X86
+#endif // x86
+
+namespace LaplataRayTracer
+{
+	enum ETriangleKernel {
+		TRIANGLE_KERNEL_NONE = -1,	// one triangle at a time via SimpleTriangle::HitTestImpl, no triangle blocks
+		TRIANGLE_KERNEL_SCALAR = 0,	// the triangle blocks, lane by lane
+		TRIANGLE_KERNEL_SSE,		// 4 triangles at once
+		TRIANGLE_KERNEL_AVX2,		// 8 triangles at once
+	};
+
+	//-----------------------------------------------------------------
+	// TriangleBlock packs 4 triangles in SoA form: the first vertex and the two edges from it,
+	// so the Moller-Trumbore test of one ray against all 4 triangles is a few vector instructions.
+	// The unused lanes have zero edges, they never report a hit.
+	//-----------------------------------------------------------------
+	struct alignas(16) TriangleBlock
+	{
+		float	v0x[4], v0y[4], v0z[4];
+		float	e1x[4], e1y[4], e1z[4];
+		float	e2x[4], e2y[4], e2z[4];
+	};
+
+	typedef vector<TriangleBlock, AlignedAllocator<TriangleBlock, 32> > TriangleBlockArray;
+
+	enum ETriangleRecord {
+		TRIANGLE_RECORD_NONE = 0,		// the vertices are fetched through the face indices, Cramer's rule
+		TRIANGLE_RECORD_AFFINE,			// the Woop transform of each triangle to the unit one, the fewest flops per test
+		TRIANGLE_RECORD_WATERTIGHT,		// a copy of each triangle's vertices, the shear-based watertight test
+	};
+
+	//-----------------------------------------------------------------
+	// TriangleAffineRecord is the affine transform (Woop) taking the triangle to the unit triangle on the z = 0 plane:
+	// the edges v1 - v0 and v2 - v0 go to the x and y axes, the normal to the z axis. A ray is tested by transforming
+	// its origin and direction with the 3 rows, the hit is at z = 0, x and y are the barycentrics of v1 and v2.
+	// The degenerate triangles get zero rows, no ray hits them.
+	//-----------------------------------------------------------------
+	struct alignas(16) TriangleAffineRecord
+	{
+		float	mRow[3][4];
+	};
+
+	// The watertight test needs the vertices themselves, the edges shared by two triangles have to be computed
+	// from the same floats on both sides.
+	struct TriangleVertexRecord
+	{
+		Vec3f	mV0, mV1, mV2;
+	};
+
+	//
+	// The per-ray part of the watertight test (Woop, Benthin, Wald 2013): the axes permuted so the direction's
+	// largest component is z, and the shear taking the direction to the z axis.
+	struct WatertightRay
+	{
+		int		kx, ky, kz;
+		float	sx, sy, sz;
+	};
+
+	//
+	// The ray-vs-triangle-block tests. The lane index returned is counted from the first block,
+	// the instruction set is picked at runtime via Detect, the scalar one is always available.
+	class TriangleKernel
+	{
+	public:
+		static const int BLOCK_WIDTH = 4;
+
+	public:
+		// The widest kernel the running CPU supports.
+		static ETriangleKernel Detect();
+		static const char *Name(ETriangleKernel kernel);
+
+		static void ClearBlock(TriangleBlock& block);
+		static void PackTriangle(TriangleBlock& block, int lane, Vec3f const& v0, Vec3f const& v1, Vec3f const& v2);
+
+		inline static int BlockCount(int triangleCount) {
+			return (triangleCount + BLOCK_WIDTH - 1) / BLOCK_WIDTH;
+		}
+
+	public:
+		// The closest hit with tmin + KEpsilon <= t < tmax, tmax is shrunk to it. Returns -1 if there is no hit.
+		static int ClosestHit(ETriangleKernel kernel, const TriangleBlock *blocks, int blockCount,
+			Ray const& inRay, const float tmin, float& tmax, float& beta, float& gamma);
+		// Any hit with t >= KEpsilon, like IntersectPImpl. Returns -1 if there is no hit.
+		static int AnyHit(ETriangleKernel kernel, const TriangleBlock *blocks, int blockCount,
+			Ray const& inRay, float& tvalue);
+
+	public:
+		// The per-triangle records, tested one triangle at a time. The closest-hit tests accept
+		// tmin + KEpsilon <= t < tmax and shrink tmax, the any-hit ones accept t >= KEpsilon, like the blocks.
+		static void PackAffine(TriangleAffineRecord& record, Vec3f const& v0, Vec3f const& v1, Vec3f const& v2);
+		static void SetupWatertightRay(Ray const& inRay, WatertightRay& shearRay);
+
+		inline static bool HitAffine(TriangleAffineRecord const& record, Ray const& inRay, const float tmin, float& tmax,
+			float& beta, float& gamma) {
+			float t, u, v;
+			if (!intersect_affine(record, inRay, t, u, v) || t < tmin + TriangleKernel::KEpsilon() || t >= tmax) {
+				return false;
+			}
+
+			tmax = t;
+			beta = u;
+			gamma = v;
+			return true;
+		}
+
+		inline static bool AnyHitAffine(TriangleAffineRecord const& record, Ray const& inRay, float& tvalue) {
+			float t, u, v;
+			if (!intersect_affine(record, inRay, t, u, v) || t < TriangleKernel::KEpsilon()) {
+				return false;
+			}
+
+			tvalue = t;
+			return true;
+		}
+
+		inline static bool HitWatertight(TriangleVertexRecord const& record, Ray const& inRay, WatertightRay const& shearRay,
+			const float tmin, float& tmax, float& beta, float& gamma) {
+			float t, u, v;
+			if (!intersect_watertight(record, inRay, shearRay, t, u, v) || t < tmin + TriangleKernel::KEpsilon() || t >= tmax) {
+				return false;
+			}
+
+			tmax = t;
+			beta = u;
+			gamma = v;
+			return true;
+		}
+
+		inline static bool AnyHitWatertight(TriangleVertexRecord const& record, Ray const& inRay, WatertightRay const& shearRay,
+			float& tvalue) {
+			float t, u, v;
+			if (!intersect_watertight(record, inRay, shearRay, t, u, v) || t < TriangleKernel::KEpsilon()) {
+				return false;
+			}
+
+			tvalue = t;
+			return true;
+		}
+
+	public:
+		// the same as SimpleTriangle
+		inline static float KEpsilon() { return 0.001f; }
+
+	private:
+		inline static bool intersect_affine(TriangleAffineRecord const& record, Ray const& inRay, float& t, float& u, float& v) {
+			Vec3f const& o = inRay.O();
+			Vec3f const& d = inRay.D();
+			const float (&m)[3][4] = record.mRow;
+
+			float o_z = m[2][0] * o.X() + m[2][1] * o.Y() + m[2][2] * o.Z() + m[2][3];
+			float d_z = m[2][0] * d.X() + m[2][1] * d.Y() + m[2][2] * d.Z();
+			if (d_z == 0.0f) {
+				return false;
+			}
+			t = -o_z / d_z;
+
+			float px = o.X() + t * d.X(), py = o.Y() + t * d.Y(), pz = o.Z() + t * d.Z();
+			u = m[0][0] * px + m[0][1] * py + m[0][2] * pz + m[0][3];
+			if (u < 0.0f || u > 1.0f) {
+				return false;
+			}
+
+			v = m[1][0] * px + m[1][1] * py + m[1][2] * pz + m[1][3];
+			return (v >= 0.0f && u + v <= 1.0f);
+		}
+
+		// The vertices are moved to the ray's origin and sheared, the ray becomes the z axis and the test is
+		// the signs of the 2D edge functions at the origin. They are exact for the shared edges, so a ray never
+		// slips between two triangles, the ones exactly zero are recomputed in double.
+		inline static bool intersect_watertight(TriangleVertexRecord const& record, Ray const& inRay, WatertightRay const& shearRay,
+			float& t, float& u, float& v) {
+			Vec3f const& o = inRay.O();
+			const int kx = shearRay.kx, ky = shearRay.ky, kz = shearRay.kz;
+
+			Vec3f a = record.mV0 - o, b = record.mV1 - o, c = record.mV2 - o;
+
+			float ax = a[kx] - shearRay.sx * a[kz], ay = a[ky] - shearRay.sy * a[kz];
+			float bx = b[kx] - shearRay.sx * b[kz], by = b[ky] - shearRay.sy * b[kz];
+			float cx = c[kx] - shearRay.sx * c[kz], cy = c[ky] - shearRay.sy * c[kz];
+
+			float e0 = cx * by - cy * bx;
+			float e1 = ax * cy - ay * cx;
+			float e2 = bx * ay - by * ax;
+
+			if (e0 == 0.0f || e1 == 0.0f || e2 == 0.0f) {
+				e0 = (float)((double)cx * (double)by - (double)cy * (double)bx);
+				e1 = (float)((double)ax * (double)cy - (double)ay * (double)cx);
+				e2 = (float)((double)bx * (double)ay - (double)by * (double)ax);
+			}
+
+			if ((e0 < 0.0f || e1 < 0.0f || e2 < 0.0f) && (e0 > 0.0f || e1 > 0.0f || e2 > 0.0f)) {
+				return false;
+			}
+
+			float det = e0 + e1 + e2;
+			if (det == 0.0f) {
+				return false;
+			}
+
+			float az = shearRay.sz * a[kz], bz = shearRay.sz * b[kz], cz = shearRay.sz * c[kz];
+			float inv_det = 1.0f / det;
+
+			t = (e0 * az + e1 * bz + e2 * cz) * inv_det;
+			u = e1 * inv_det;
+			v = e2 * inv_det;
+			return true;
+		}
+
+		static int closest_hit_scalar(const TriangleBlock *blocks, int blockCount,
+			Ray const& inRay, const float tmin, float& tmax, float& beta, float& gamma);
+		static int any_hit_scalar(const TriangleBlock *blocks, int blockCount, Ray const& inRay, float& tvalue);
+
+#ifdef TRIANGLE_KERNEL_X86
+		static int closest_hit_sse(const TriangleBlock *blocks, int blockCount,
+			Ray const& inRay, const float tmin, float& tmax, float& beta, float& gamma);
+		static int any_hit_sse(const TriangleBlock *blocks, int blockCount, Ray const& inRay, float& tvalue);
+
+		static int closest_hit_avx2(const TriangleBlock *blocks, int blockCount,
+			Ray const& inRay, const float tmin, float& tmax, float& beta, float& gamma);
+		static int any_hit_avx2(const TriangleBlock *blocks, int blockCount, Ray const& inRay, float& tvalue);
+#endif // TRIANGLE_KERNEL_X86
+
+	};
+}
@@ -31,7 +31,7 @@ namespace LaplataRayTracer
 		}
 
 	public:
-		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) {
+		virtual bool HitTest(Ray const& inRay, const float& tmin, float& tmax, HitRecord& rec) const {
 			HitRecord rec1, rec2;
 			float TMAX = FLT_MAX;
 			if (mpBoundary->HitTest(inRay, -TMAX, TMAX, rec1)) {
@@ -0,0 +1,390 @@
+#include <algorithm>
+
+#include "Utility.h"
+#include "Random.h"
+#include "WavefrontTracer.h"
+
+namespace LaplataRayTracer
+{
+	// Spreads the low 10 bits of v to every third bit.
+	inline static unsigned long long expand_bits_10(unsigned long long v) {
+		v &= 0x3ffull;
+		v = (v | (v << 16)) & 0x30000ffull;
+		v = (v | (v << 8)) & 0x300f00full;
+		v = (v | (v << 4)) & 0x30c30c3ull;
+		v = (v | (v << 2)) & 0x9249249ull;
+		return v;
+	}
+
+	//
+	void PathStateQueues::Resize(int capacity) {
+		if ((int)mvecRays.size() >= capacity) {
+			return;
+		}
+
+		mvecRays.resize(capacity);
+		mvecHitRecs.resize(capacity);
+		mvecThroughput.resize(capacity);
+		mvecRadiance.resize(capacity);
+		mvecMaterialPDF.resize(capacity);
+		mvecHit.resize(capacity);
+		mvecStreams.resize(capacity);
+		mvecGroupOfPath.resize(capacity);
+		mvecSortKeys.reserve(capacity);
+
+		mvecExtend.reserve(capacity);
+		mvecLight.reserve(capacity);
+		mvecShade.resize(capacity);
+	}
+
+	void PathStateQueues::Release() {
+		vector<Ray>().swap(mvecRays);
+		vector<HitRecord>().swap(mvecHitRecs);
+		vector<Color3f>().swap(mvecThroughput);
+		vector<Color3f>().swap(mvecRadiance);
+		vector<float>().swap(mvecMaterialPDF);
+		vector<char>().swap(mvecHit);
+		vector<PCG32>().swap(mvecStreams);
+		vector<int>().swap(mvecGroupOfPath);
+		vector<unsigned long long>().swap(mvecSortKeys);
+
+		vector<int>().swap(mvecExtend);
+		vector<int>().swap(mvecLight);
+		vector<int>().swap(mvecShade);
+		vector<Material *>().swap(mvecGroupMaterials);
+		vector<int>().swap(mvecGroupStart);
+	}
+
+	//
+	WavefrontPathTracer::WavefrontPathTracer(EWavefrontIntegrator integrator)
+		: mIntegrator(integrator), mpLightList(nullptr), mnBatchSize(1 << 14),
+		mbRayReordering(false), mbNodeCacheStats(false) {
+
+	}
+
+	WavefrontPathTracer::~WavefrontPathTracer() {
+
+	}
+
+	RayTracer *WavefrontPathTracer::CreateWorkerTracer() const {
+		WavefrontPathTracer *tracer = new WavefrontPathTracer(mIntegrator);
+		tracer->mRTEvn = mRTEvn;
+		tracer->mpLightList = mpLightList;
+		tracer->mnBatchSize = mnBatchSize;
+		tracer->mbRayReordering = mbRayReordering;
+		tracer->mbNodeCacheStats = mbNodeCacheStats;
+		return tracer;
+	}
+
+	void WavefrontPathTracer::MergeWorkerTracer(RayTracer const *workerTracer) {
+		WavefrontPathTracer const *tracer = static_cast<WavefrontPathTracer const *>(workerTracer);
+		mPrimaryNodeCache.Merge(tracer->mPrimaryNodeCache);
+		mSecondaryNodeCache.Merge(tracer->mSecondaryNodeCache);
+	}
+
+	//
+	Color3f WavefrontPathTracer::Run(Ray& ray, int depth, int maxDepth) {
+		if (depth > maxDepth) {
+			return BLACK;
+		}
+
+		Color3f color;
+		RunBatch(&ray, 1, &color, maxDepth - depth);
+		return color;
+	}
+
+	void WavefrontPathTracer::RunBatch(Ray *rays, int count, Color3f *colors, int maxDepth) {
+		PCG32& thread_stream = Random::ThreadGenerator();
+		unsigned long long seed = ((unsigned long long)thread_stream.NextUInt() << 32) | thread_stream.NextUInt();
+
+		for (int first = 0; first < count; first += mnBatchSize) {
+			int batch_count = std::min<int>(mnBatchSize, count - first);
+
+			generate_stage(rays + first, batch_count, seed, first);
+
+			// the segments of depth 0 to maxDepth, like the recursive tracers the paths still alive afterwards
+			// get nothing more.
+			for (int depth = 0; depth <= maxDepth && !mQueues.mvecExtend.empty(); ++depth) {
+				if (depth > 0 && mbRayReordering) {
+					reorder_stage();
+				}
+				extend_stage(depth);
+				shade_stage();
+				if (mIntegrator == WAVEFRONT_PATH_MIS) {
+					light_stage();
+				}
+			}
+
+			accumulate_stage(colors + first, batch_count);
+		}
+	}
+
+	//
+	// The stream of a path is the one of its index in the RunBatch call.
+	void WavefrontPathTracer::generate_stage(Ray const *rays, int count, unsigned long long seed, int first) {
+		mQueues.Resize(count);
+		mQueues.mvecExtend.clear();
+		mQueues.mvecLight.clear();
+
+		for (int i = 0; i < count; ++i) {
+			mQueues.mvecRays[i] = rays[i];
+			mQueues.mvecThroughput[i].Set(1.0f, 1.0f, 1.0f);
+			mQueues.mvecRadiance[i].Set(0.0f, 0.0f, 0.0f);
+			mQueues.mvecStreams[i].Seed(seed, (unsigned long long)(first + i));
+			mQueues.mvecExtend.push_back(i);
+		}
+	}
+
+	//
+	// The key is the direction's octant (3 bits) above the 30-bit Morton code of the origin, quantized upon the
+	// bounds of the queued origins. The paths of the same key keep their order.
+	void WavefrontPathTracer::reorder_stage() {
+		vector<int>& extend = mQueues.mvecExtend;
+		vector<unsigned long long>& keys = mQueues.mvecSortKeys;
+		int count = (int)extend.size();
+		if (count < 2) {
+			return;
+		}
+
+		float omin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+		float omax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		for (int i = 0; i < count; ++i) {
+			Vec3f const& o = mQueues.mvecRays[extend[i]].O();
+			for (int axis = 0; axis < 3; ++axis) {
+				omin[axis] = std::min<float>(omin[axis], o[axis]);
+				omax[axis] = std::max<float>(omax[axis], o[axis]);
+			}
+		}
+
+		float scale[3];
+		for (int axis = 0; axis < 3; ++axis) {
+			float extent = omax[axis] - omin[axis];
+			scale[axis] = (extent > 0.0f) ? (1024.0f / extent) : 0.0f;
+		}
+
+		keys.resize(count);
+		for (int i = 0; i < count; ++i) {
+			int path = extend[i];
+			Ray const& ray = mQueues.mvecRays[path];
+			Vec3f const& o = ray.O();
+
+			unsigned long long code = 0;
+			for (int axis = 0; axis < 3; ++axis) {
+				int cell = RTMath::Clamp((int)((o[axis] - omin[axis]) * scale[axis]), 0, 1023);
+				code |= expand_bits_10((unsigned long long)cell) << (2 - axis);
+			}
+			unsigned long long octant = (unsigned long long)((ray.Sign(0) << 2) | (ray.Sign(1) << 1) | ray.Sign(2));
+
+			keys[i] = (((octant << 30) | code) << 31) | (unsigned long long)path;
+		}
+
+		std::sort(keys.begin(), keys.end());
+
+		for (int i = 0; i < count; ++i) {
+			extend[i] = (int)(keys[i] & 0x7fffffffull);
+		}
+	}
+
+	void WavefrontPathTracer::extend_stage(int depth) {
+		SceneObjects const& scene_objects = *mRTEvn.mpvecHitableObjs;
+		vector<int> const& extend = mQueues.mvecExtend;
+
+		NodeCacheCounter *bound_counter = BVHTree::BoundNodeCacheCounter();
+		if (mbNodeCacheStats) {
+			BVHTree::BindNodeCacheCounter((depth == 0) ? &mPrimaryNodeCache : &mSecondaryNodeCache);
+		}
+
+		// the participating media draw their free paths.
+		PCG32& thread_stream = Random::ThreadGenerator();
+		PCG32 caller_stream = thread_stream;
+
+		for (size_t i = 0; i < extend.size(); ++i) {
+			int path = extend[i];
+			HitRecord& hit_rec = mQueues.mvecHitRecs[path];
+			hit_rec = HitRecord();
+			thread_stream = mQueues.mvecStreams[path];
+			mQueues.mvecHit[path] = scene_objects.ClosestHit(mQueues.mvecRays[path], hit_rec) ? 1 : 0;
+			mQueues.mvecStreams[path] = thread_stream;
+		}
+
+		thread_stream = caller_stream;
+		BVHTree::BindNodeCacheCounter(bound_counter);
+	}
+
+	//
+	// The missed paths end upon the background, the hit ones are grouped by material (a counting sort, the
+	// groups in the order their materials are first met) so each material shades all its paths in a row.
+	void WavefrontPathTracer::shade_stage() {
+		vector<int>& extend = mQueues.mvecExtend;
+		vector<int>& shade = mQueues.mvecShade;
+		vector<Material *>& group_materials = mQueues.mvecGroupMaterials;
+		vector<int>& group_start = mQueues.mvecGroupStart;
+		vector<int>& group_of_path = mQueues.mvecGroupOfPath;
+
+		group_materials.clear();
+		group_start.clear();
+
+		std::map<Material *, int> groups;
+		Material *last_material = nullptr;
+		int last_group = -1;
+		int shade_count = 0;
+
+		for (size_t i = 0; i < extend.size(); ++i) {
+			int path = extend[i];
+			HitRecord& hit_rec = mQueues.mvecHitRecs[path];
+
+			if (!mQueues.mvecHit[path]) {
+				mQueues.mvecRadiance[path] += mQueues.mvecThroughput[path] * mRTEvn.mpBackground->Shade(mQueues.mvecRays[path]);
+				group_of_path[path] = -1;
+				continue;
+			}
+			if (hit_rec.pMaterial == nullptr) {
+				mQueues.mvecRadiance[path] += mQueues.mvecThroughput[path] * hit_rec.albedo;
+				group_of_path[path] = -1;
+				continue;
+			}
+
+			// the neighbouring paths mostly hit the same material.
+			if (hit_rec.pMaterial != last_material) {
+				std::map<Material *, int>::iterator it = groups.find(hit_rec.pMaterial);
+				if (it == groups.end()) {
+					it = groups.insert(std::make_pair(hit_rec.pMaterial, (int)group_materials.size())).first;
+					group_materials.push_back(hit_rec.pMaterial);
+					group_start.push_back(0);
+				}
+				last_material = hit_rec.pMaterial;
+				last_group = it->second;
+			}
+
+			group_of_path[path] = last_group;
+			++group_start[last_group];
+			++shade_count;
+		}
+
+		// the counts become the starts of the groups.
+		int start = 0;
+		for (size_t g = 0; g < group_start.size(); ++g) {
+			int count = group_start[g];
+			group_start[g] = start;
+			start += count;
+		}
+		group_start.push_back(shade_count);
+
+		vector<int> cursor(group_start.begin(), group_start.end() - 1);
+		for (size_t i = 0; i < extend.size(); ++i) {
+			int path = extend[i];
+			if (group_of_path[path] >= 0) {
+				shade[cursor[group_of_path[path]]++] = path;
+			}
+		}
+		extend.clear();
+
+		PCG32& thread_stream = Random::ThreadGenerator();
+		PCG32 caller_stream = thread_stream;
+
+		for (size_t g = 0; g < group_materials.size(); ++g) {
+			Material *pMaterial = group_materials[g];
+			for (int i = group_start[g]; i < group_start[g + 1]; ++i) {
+				int path = shade[i];
+				thread_stream = mQueues.mvecStreams[path];
+				if (mIntegrator == WAVEFRONT_PATH_MIS) {
+					shade_path_mis(pMaterial, path);
+				}
+				else {
+					shade_path(pMaterial, path);
+				}
+				mQueues.mvecStreams[path] = thread_stream;
+			}
+		}
+
+		thread_stream = caller_stream;
+	}
+
+	void WavefrontPathTracer::shade_path(Material *pMaterial, int path) {
+		Ray& ray = mQueues.mvecRays[path];
+		HitRecord& hit_rec = mQueues.mvecHitRecs[path];
+		Color3f& throughput = mQueues.mvecThroughput[path];
+
+		mQueues.mvecRadiance[path] += throughput * pMaterial->Emissive(ray, hit_rec);
+
+		Ray ray_scatter;
+		Color3f attenuation_albedo;
+		if (pMaterial->PathShade(ray, hit_rec, attenuation_albedo, ray_scatter)) {
+			throughput *= attenuation_albedo;
+			ray = ray_scatter;
+			mQueues.mvecExtend.push_back(path);
+		}
+	}
+
+	//
+	// The direction is drawn from the mixture of the light pdf and the material's pdf as PathTracer_MIS does.
+	// The material's pdf holds the frame of the current hit, so its value is taken here, the light's one
+	// is left to the light stage.
+	void WavefrontPathTracer::shade_path_mis(Material *pMaterial, int path) {
+		Ray& ray = mQueues.mvecRays[path];
+		HitRecord& hit_rec = mQueues.mvecHitRecs[path];
+		Color3f& throughput = mQueues.mvecThroughput[path];
+
+		Color3f emissive_albedo = pMaterial->Emissive(ray, hit_rec);
+		ScatterRecord srec;
+		if (!pMaterial->PathShade2(ray, hit_rec, srec)) {
+			mQueues.mvecRadiance[path] += throughput * emissive_albedo;
+			return;
+		}
+
+		if (srec.is_specular) {
+			throughput *= srec.albedo;
+			ray = srec.specular_ray;
+			mQueues.mvecExtend.push_back(path);
+			return;
+		}
+
+		mQueues.mvecRadiance[path] += throughput * emissive_albedo;
+
+		Vec3f out_dir;
+		if (mpLightList != nullptr && Random::drand48() < 0.5f) {
+			out_dir = mpLightList->SampleRandomDirection(hit_rec.wpt);
+		}
+		else {
+			out_dir = srec.pPDF->Generate();
+		}
+
+		Ray out_ray;
+		out_ray.Set(hit_rec.wpt, out_dir, ray.T());
+		float material_pdf = srec.pPDF->Value(out_dir);
+		throughput *= srec.albedo * pMaterial->PathShade2_pdf(ray, hit_rec, out_ray);
+		ray = out_ray;
+
+		if (mpLightList != nullptr) {
+			mQueues.mvecMaterialPDF[path] = material_pdf;
+			mQueues.mvecLight.push_back(path);
+		}
+		else {
+			throughput /= material_pdf;
+			mQueues.mvecExtend.push_back(path);
+		}
+	}
+
+	//
+	// The light pdfs of the sampled directions, each one is a ray cast against the lights.
+	void WavefrontPathTracer::light_stage() {
+		vector<int>& light = mQueues.mvecLight;
+
+		for (size_t i = 0; i < light.size(); ++i) {
+			int path = light[i];
+			Ray const& ray = mQueues.mvecRays[path];
+
+			float light_pdf = mpLightList->PDFValue(ray.O(), ray.D());
+			float pdf = 0.5f * light_pdf + 0.5f * mQueues.mvecMaterialPDF[path];
+			mQueues.mvecThroughput[path] /= pdf;
+			mQueues.mvecExtend.push_back(path);
+		}
+		light.clear();
+	}
+
+	void WavefrontPathTracer::accumulate_stage(Color3f *colors, int count) {
+		for (int i = 0; i < count; ++i) {
+			colors[i] = mQueues.mvecRadiance[i];
+		}
+	}
+}
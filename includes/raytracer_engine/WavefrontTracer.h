@@ -0,0 +1,132 @@
+#pragma once
+
+#include <vector>
+
+#include "Common.h"
+#include "Random.h"
+#include "Vec3.h"
+#include "Ray.h"
+#include "HitRecord.h"
+#include "Material.h"
+#include "RayTracer.h"
+#include "BVHAccel.h"
+
+using std::vector;
+
+namespace LaplataRayTracer
+{
+	enum EWavefrontIntegrator {
+		WAVEFRONT_PATH = 0,		// the same estimator as PathTracer, Material::PathShade
+		WAVEFRONT_PATH_MIS,		// the same estimator as PathTracer_MIS, Material::PathShade2 mixed with light sampling
+	};
+
+	//-----------------------------------------------------------------
+	// The states of a batch of paths in SoA form, indexed by path. The stages walk the queues of path indices,
+	// a path is in at most one queue at a time and leaves them all when it terminates.
+	//-----------------------------------------------------------------
+	class PathStateQueues
+	{
+	public:
+		void Resize(int capacity);
+		void Release();
+
+	public:
+		// per path
+		vector<Ray>			mvecRays;			// the segment to extend next
+		vector<HitRecord>	mvecHitRecs;		// its closest hit
+		vector<Color3f>		mvecThroughput;		// the product of the albedos / pdfs so far
+		vector<Color3f>		mvecRadiance;		// the radiance gathered so far
+		vector<float>		mvecMaterialPDF;	// MIS: the material's pdf of the sampled direction, until the light stage
+		vector<char>		mvecHit;
+		vector<PCG32>		mvecStreams;		// the path's own random stream, swapped in while it's extended and shaded
+
+		// the reorder stage: the key of each queued path in the high bits, the path in the low ones
+		vector<unsigned long long>	mvecSortKeys;
+
+		// the queues
+		vector<int>			mvecExtend;
+		vector<int>			mvecLight;
+		vector<int>			mvecShade;			// grouped by material, in order within a group
+
+		// the materials of the shade queue, group i is mvecShade[mvecGroupStart[i], mvecGroupStart[i + 1])
+		vector<Material *>	mvecGroupMaterials;
+		vector<int>			mvecGroupStart;
+		vector<int>			mvecGroupOfPath;
+
+	};
+
+	//
+	// A path tracer which works upon a batch of paths stage by stage rather than a path at a time:
+	// generate (the camera rays of the batch), reorder (the secondary rays sorted for coherence, see
+	// EnableRayReordering), extend (the closest hits of all the live paths), shade (the hit
+	// paths grouped by material, each material shades its paths back to back), light (MIS only: the light pdfs
+	// of the sampled directions, the ray-vs-light tests of the batch) and accumulate (the radiance of each path
+	// to its color). The paths draw from streams of their own, seeded from the calling thread's stream once per
+	// RunBatch, so the colors don't depend on the batch size nor on the order of the paths in the queues.
+	// It computes the same estimators as PathTracer and PathTracer_MIS, the batches are the place
+	// for SIMD shading and for the reordering of the rays.
+	class WavefrontPathTracer : public RayTracer
+	{
+	public:
+		WavefrontPathTracer(EWavefrontIntegrator integrator = WAVEFRONT_PATH);
+		virtual ~WavefrontPathTracer();
+
+	public:
+		// A single path, a batch of one.
+		virtual Color3f Run(Ray& ray, int depth = 0, int maxDepth = 0);
+
+		// The batch is split in runs of at most BatchSize paths, which keep their states in the queues.
+		virtual void RunBatch(Ray *rays, int count, Color3f *colors, int maxDepth = 0);
+		virtual bool IsBatched() const { return true; }
+		// The settings and the environment, the queues are the worker's own.
+		virtual RayTracer *CreateWorkerTracer() const;
+		virtual void MergeWorkerTracer(RayTracer const *workerTracer);
+
+	public:
+		// The lights sampled by WAVEFRONT_PATH_MIS, as PathTracer_MIS::BindLightList.
+		inline void BindLightList(GeometricObject *lightList) { mpLightList = lightList; }
+		inline void SetBatchSize(int batchSize) { mnBatchSize = (batchSize > 0) ? batchSize : 1; }
+		inline int BatchSize() const { return mnBatchSize; }
+
+		// The queues are kept between the batches, this frees them.
+		inline void ReleaseQueues() { mQueues.Release(); }
+
+		// The secondary rays scatter all over, so before each bounce's extend stage they are sorted by the octant
+		// of their direction, then by the Morton code of their origin within the batch's origins: the rays in a
+		// row of the queue start close to each other going the same way, and walk the same nodes. It pays off
+		// once the nodes don't fit in the caches, and more with larger batches; it's off by default.
+		inline void EnableRayReordering(bool enable) { mbRayReordering = enable; }
+		inline bool IsRayReorderingEnabled() const { return mbRayReordering; }
+
+		// Counts the node fetches of the extend stages in a simulated cache (NodeCacheCounter), the primary rays
+		// apart from the secondary ones, to measure what the reordering gains on a scene. The counters stay
+		// empty unless the engine is built with NODE_CACHE_STATS.
+		inline void EnableNodeCacheStats(bool enable) { mbNodeCacheStats = enable; }
+		inline void ResetNodeCacheStats() { mPrimaryNodeCache.Reset(); mSecondaryNodeCache.Reset(); }
+		inline NodeCacheCounter const& PrimaryNodeCache() const { return mPrimaryNodeCache; }
+		inline NodeCacheCounter const& SecondaryNodeCache() const { return mSecondaryNodeCache; }
+
+	private:
+		void generate_stage(Ray const *rays, int count, unsigned long long seed, int first);
+		void reorder_stage();
+		void extend_stage(int depth);
+		void shade_stage();
+		void light_stage();
+		void accumulate_stage(Color3f *colors, int count);
+
+		void shade_path(Material *pMaterial, int path);
+		void shade_path_mis(Material *pMaterial, int path);
+
+	private:
+		EWavefrontIntegrator	mIntegrator;
+		GeometricObject *		mpLightList;
+		int						mnBatchSize;
+		PathStateQueues			mQueues;
+
+		bool					mbRayReordering;
+		bool					mbNodeCacheStats;
+		NodeCacheCounter		mPrimaryNodeCache;
+		NodeCacheCounter		mSecondaryNodeCache;
+
+	};
+}
@@ -0,0 +1,429 @@
+#include "WorldObjects.h"
+
+namespace LaplataRayTracer
+{
+	// pad the box a little, so the flat objects (rectangles, disks...) still have a volume.
+	inline static void pad_box(AABB& box) {
+		box.mX0 -= SceneObjects::KEpsilon(); box.mX1 += SceneObjects::KEpsilon();
+		box.mY0 -= SceneObjects::KEpsilon(); box.mY1 += SceneObjects::KEpsilon();
+		box.mZ0 -= SceneObjects::KEpsilon(); box.mZ1 += SceneObjects::KEpsilon();
+	}
+
+	//
+	SceneObjects::SceneObjects() {
+		mbAccelerationBuilt = false;
+		mbEnableAcceleration = true;
+		mbEnableMotionBounds = true;
+	}
+
+	SceneObjects::~SceneObjects() {
+		ReleaseAccelerationStructure();
+	}
+
+	//
+	// From IGeometricAcceleration
+	void SceneObjects::BuildupAccelerationStructure() {
+		release_top_level();
+
+		// the proxies' own structures first, their bounding-boxes are what the scene BVH needs.
+		build_bottom_levels();
+
+		vector<GeometricObject * > bounded_objects;
+		vector<AABB> bounds;
+		bounded_objects.reserve(this->size());
+		bounds.reserve(this->size());
+
+		// the motion interval of all the moving objects.
+		float motion_time0 = FLT_MAX;
+		float motion_time1 = -FLT_MAX;
+
+		int count = (int)this->size();
+		for (int i = 0; i < count; ++i) {
+			Hitable *object = (*this)[i];
+			GeometricObject *geo_object = dynamic_cast<GeometricObject *>(object);
+
+			AABB box;
+			if (geo_object != nullptr && geo_object->GetBoundingBox(0.0f, 0.0f, box)) {
+				pad_box(box);
+
+				bounded_objects.push_back(geo_object);
+				bounds.push_back(box);
+
+				float time0, time1;
+				if (mbEnableMotionBounds && geo_object->GetMotionInterval(time0, time1)) {
+					motion_time0 = std::min<float>(motion_time0, time0);
+					motion_time1 = std::max<float>(motion_time1, time1);
+				}
+			}
+			else {
+				mvecUnboundedObjects.push_back(object);
+			}
+		}
+
+		// with the moving objects, the tree is built upon the bounds swept over the whole interval,
+		// and the nodes get their bounds at both ends of it, which the traversal interpolates by the ray's time.
+		bool has_motion = (motion_time1 > motion_time0);
+		vector<AABB> bounds0, bounds1;
+		if (has_motion) {
+			int bounded_count = (int)bounded_objects.size();
+			bounds0.resize(bounded_count);
+			bounds1.resize(bounded_count);
+			for (int i = 0; i < bounded_count; ++i) {
+				bounded_objects[i]->GetBoundingBoxAt(motion_time0, bounds0[i]);
+				bounded_objects[i]->GetBoundingBoxAt(motion_time1, bounds1[i]);
+				pad_box(bounds0[i]);
+				pad_box(bounds1[i]);
+				bounds[i] = AABB::SurroundingBox(bounds0[i], bounds1[i]);
+			}
+		}
+
+		mBVH.Build(bounds, 2);
+		if (has_motion) {
+			mBVH.SetMotionBounds(bounds0, bounds1, motion_time0, motion_time1);
+		}
+
+		const vector<int>& prim_indices = mBVH.GetPrimIndices();
+		mvecBVHObjects.reserve(prim_indices.size());
+		for (int i = 0; i < (int)prim_indices.size(); ++i) {
+			mvecBVHObjects.push_back(bounded_objects[prim_indices[i]]);
+		}
+
+		mbAccelerationBuilt = true;
+	}
+
+	//
+	bool SceneObjects::ClosestHit(Ray const& ray, HitRecord& rec) const {
+		bool is_hit = false;
+
+		if (mbEnableAcceleration && mbAccelerationBuilt) {
+			is_hit = closest_hit_bvh(ray, rec);
+		}
+		else {
+			is_hit = closest_hit_linear(ray, rec);
+		}
+
+		if (is_hit) {
+			rec.wpt = ray.O() + rec.t * ray.D();
+		}
+
+		return is_hit;
+	}
+
+	void SceneObjects::ClosestHitPacket(RayPacket& packet) const {
+		if (mbEnableAcceleration && mbAccelerationBuilt) {
+			closest_hit_packet_bvh(packet);
+
+			for (int i = 0; i < packet.mnCount; ++i) {
+				if (packet.mbHit[i]) {
+					packet.mHitRecs[i].wpt = packet.mRays[i].O() + packet.mHitRecs[i].t * packet.mRays[i].D();
+				}
+			}
+		}
+		else {
+			for (int i = 0; i < packet.mnCount; ++i) {
+				packet.mbHit[i] = ClosestHit(packet.mRays[i], packet.mHitRecs[i]);
+			}
+		}
+	}
+
+	bool SceneObjects::Occluded(Ray const& ray, float tmax) const {
+		if (mbEnableAcceleration && mbAccelerationBuilt) {
+			return occluded_bvh(ray, tmax);
+		}
+
+		return occluded_linear(ray, tmax);
+	}
+
+	void SceneObjects::ReleaseAccelerationStructure() {
+		release_top_level();
+		msetBottomLevels.clear();
+	}
+
+	//
+	void SceneObjects::build_bottom_levels() {
+		// the proxies may have been deformed or moved since the last build, so each one is rebuilt once per build.
+		msetBottomLevels.clear();
+
+		int count = (int)this->size();
+		for (int i = 0; i < count; ++i) {
+			Instance *instance = dynamic_cast<Instance *>((*this)[i]);
+			if (instance == nullptr) {
+				continue;
+			}
+
+			// the world box follows the rebuilt proxy.
+			instance->InvalidateBoundingBox();
+
+			GeometricObject *proxy = instance->GetBottomLevelObject();
+			if (proxy == nullptr || msetBottomLevels.find(proxy) != msetBottomLevels.end()) {
+				continue;
+			}
+
+			IGeometricAcceleration *accel = dynamic_cast<IGeometricAcceleration *>(proxy);
+			if (accel != nullptr) {
+				accel->BuildupAccelerationStructure();
+			}
+			msetBottomLevels.insert(proxy);
+		}
+	}
+
+	void SceneObjects::release_top_level() {
+		mBVH.Clear();
+		mvecBVHObjects.clear();
+		mvecUnboundedObjects.clear();
+		mbAccelerationBuilt = false;
+	}
+
+	//
+	bool SceneObjects::closest_hit_linear(Ray const& ray, HitRecord& rec) const {
+		// In fact, each object has its own KEpsilon Const value which represents its minimum t value
+		// If I require it from the abstract base Class' function, like KEpsilon(), it will slow down our running,
+		// so tmin is not used currently.
+		const float tmin = 0.0f;
+		float tmax = FLT_MAX;
+		float t = FLT_MAX;
+		bool hit_anything = false;
+		HitRecord temp_rec;
+
+		int count = (int)this->size();
+		for (int i = 0; i < count; ++i) {
+			if ((*this)[i]->HitTest(ray, tmin, t, temp_rec) && t < tmax) {
+				tmax = t;
+				rec = temp_rec;
+				hit_anything = true;
+			}
+		}
+
+		return hit_anything;
+	}
+
+	bool SceneObjects::occluded_linear(Ray const& ray, float tmax) const {
+		int count = (int)this->size();
+		for (int i = 0; i < count; ++i) {
+			float tvalue = -FLT_MAX;
+			if ((*this)[i]->IntersectP(ray, tvalue) && tvalue < tmax) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// Any blocker will do, so the children are visited in the node order and the traversal stops at
+	// the first hit; the nodes beyond tmax (the light) are culled by the slab test.
+	bool SceneObjects::occluded_bvh(Ray const& ray, float tmax) const {
+		int unbounded_count = (int)mvecUnboundedObjects.size();
+		for (int i = 0; i < unbounded_count; ++i) {
+			float tvalue = -FLT_MAX;
+			if (mvecUnboundedObjects[i]->IntersectP(ray, tvalue) && tvalue < tmax) {
+				return true;
+			}
+		}
+
+		if (mBVH.IsEmpty()) {
+			return false;
+		}
+
+		const BVHNodeArray& nodes = mBVH.GetNodes();
+
+		int todo[BVHTree::MAX_DEPTH];
+		int todo_count = 0;
+		int node_index = 0;
+
+		while (true) {
+			const BVHNode& node = nodes[node_index];
+			BVHTree::CountNodeFetch(&node);
+			float tnear;
+
+			if (mBVH.HitNodeAt(node_index, ray, 0.0f, tmax, tnear)) {
+				if (node.IsLeaf()) {
+					for (int i = 0; i < node.mnCount; ++i) {
+						float tvalue = -FLT_MAX;
+						if (mvecBVHObjects[node.mnOffset + i]->IntersectP(ray, tvalue) && tvalue < tmax) {
+							return true;
+						}
+					}
+
+					if (todo_count == 0) { break; }
+					node_index = todo[--todo_count];
+				}
+				else {
+					todo[todo_count++] = node.mnOffset;
+					node_index = node_index + 1;
+				}
+			}
+			else {
+				if (todo_count == 0) { break; }
+				node_index = todo[--todo_count];
+			}
+		}
+
+		return false;
+	}
+
+	bool SceneObjects::closest_hit_bvh(Ray const& ray, HitRecord& rec) const {
+		const float tmin = 0.0f;
+		float tmax = FLT_MAX;
+		float t = FLT_MAX;
+		bool hit_anything = false;
+		HitRecord temp_rec;
+
+		// the unbounded ones first, they make the BVH traversal a bit shorter when they are hit.
+		int unbounded_count = (int)mvecUnboundedObjects.size();
+		for (int i = 0; i < unbounded_count; ++i) {
+			if (mvecUnboundedObjects[i]->HitTest(ray, tmin, t, temp_rec) && t < tmax) {
+				tmax = t;
+				rec = temp_rec;
+				hit_anything = true;
+			}
+		}
+
+		if (mBVH.IsEmpty()) {
+			return hit_anything;
+		}
+
+		const BVHNodeArray& nodes = mBVH.GetNodes();
+
+		int todo[BVHTree::MAX_DEPTH];
+		int todo_count = 0;
+		int node_index = 0;
+
+		while (true) {
+			const BVHNode& node = nodes[node_index];
+			BVHTree::CountNodeFetch(&node);
+			float tnear;
+
+			if (mBVH.HitNodeAt(node_index, ray, tmin, tmax, tnear)) {
+				if (node.IsLeaf()) {
+					for (int i = 0; i < node.mnCount; ++i) {
+						Hitable *object = mvecBVHObjects[node.mnOffset + i];
+						if (object->HitTest(ray, tmin, t, temp_rec) && t < tmax) {
+							tmax = t;
+							rec = temp_rec;
+							hit_anything = true;
+						}
+					}
+
+					if (todo_count == 0) { break; }
+					node_index = todo[--todo_count];
+				}
+				else {
+					// visit the near child first, the far one may be culled by the closer hit then.
+					if (ray.Sign(node.mnAxis)) {
+						todo[todo_count++] = node_index + 1;
+						node_index = node.mnOffset;
+					}
+					else {
+						todo[todo_count++] = node.mnOffset;
+						node_index = node_index + 1;
+					}
+				}
+			}
+			else {
+				if (todo_count == 0) { break; }
+				node_index = todo[--todo_count];
+			}
+		}
+
+		return hit_anything;
+	}
+
+	//
+	// The packet goes down the BVH as a whole: a node is skipped when the interval test of the packet
+	// fails, or when none of the rays from the first active one hits it. The rays before the first
+	// active one have missed the node, so they are not tested again in its children.
+	// In the leaves the rays are split, each one tests the objects on its own.
+	void SceneObjects::closest_hit_packet_bvh(RayPacket& packet) const {
+		const float tmin = 0.0f;
+		HitRecord temp_rec;
+		const int count = packet.mnCount;
+
+		int unbounded_count = (int)mvecUnboundedObjects.size();
+		for (int i = 0; i < count; ++i) {
+			for (int j = 0; j < unbounded_count; ++j) {
+				float t = packet.mfTMax[i];
+				if (mvecUnboundedObjects[j]->HitTest(packet.mRays[i], tmin, t, temp_rec) && t < packet.mfTMax[i]) {
+					packet.mfTMax[i] = t;
+					packet.mHitRecs[i] = temp_rec;
+					packet.mbHit[i] = true;
+				}
+			}
+		}
+
+		if (mBVH.IsEmpty()) {
+			return;
+		}
+
+		packet.Prepare();
+
+		const BVHNodeArray& nodes = mBVH.GetNodes();
+
+		int todo[BVHTree::MAX_DEPTH];
+		int todo_first[BVHTree::MAX_DEPTH];
+		int todo_count = 0;
+		int node_index = 0;
+		int first = 0;
+
+		while (true) {
+			const BVHNode& node = nodes[node_index];
+			BVHTree::CountNodeFetch(&node);
+			float tnear;
+
+			int active = -1;
+			if (packet.HitNodeInterval(node.mBounds, tmin)) {
+				for (int i = first; i < count; ++i) {
+					if (mBVH.HitNodeAt(node_index, packet.mRays[i], tmin, packet.mfTMax[i], tnear)) {
+						active = i;
+						break;
+					}
+				}
+			}
+
+			if (active >= 0) {
+				if (node.IsLeaf()) {
+					for (int i = active; i < count; ++i) {
+						Ray const& ray = packet.mRays[i];
+						if (i != active && !mBVH.HitNodeAt(node_index, ray, tmin, packet.mfTMax[i], tnear)) {
+							continue;
+						}
+
+						for (int j = 0; j < node.mnCount; ++j) {
+							float t = packet.mfTMax[i];
+							Hitable *object = mvecBVHObjects[node.mnOffset + j];
+							if (object->HitTest(ray, tmin, t, temp_rec) && t < packet.mfTMax[i]) {
+								packet.mfTMax[i] = t;
+								packet.mHitRecs[i] = temp_rec;
+								packet.mbHit[i] = true;
+							}
+						}
+					}
+					packet.UpdateMaxT();
+
+					if (todo_count == 0) { break; }
+					--todo_count;
+					node_index = todo[todo_count];
+					first = todo_first[todo_count];
+				}
+				else {
+					// the near child of the first active ray, the others of a coherent packet agree mostly.
+					todo_first[todo_count] = active;
+					if (packet.mRays[active].Sign(node.mnAxis)) {
+						todo[todo_count++] = node_index + 1;
+						node_index = node.mnOffset;
+					}
+					else {
+						todo[todo_count++] = node.mnOffset;
+						node_index = node_index + 1;
+					}
+					first = active;
+				}
+			}
+			else {
+				if (todo_count == 0) { break; }
+				--todo_count;
+				node_index = todo[todo_count];
+				first = todo_first[todo_count];
+			}
+		}
+	}
+}
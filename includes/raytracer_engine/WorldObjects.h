@@ -1,11 +1,81 @@
 #pragma once
 
+#include <set>
+
 #include "GeometricObject.h"
 #include "GeometricObjectPlus.h"
 #include "ImageIO.h"
+#include "IGeometricAcceleration.h"
+#include "BVHAccel.h"
+#include "Instance.h"
+#include "RayPacket.h"
 
 namespace LaplataRayTracer
 {
 	//
-	using SceneObjects = vector<Hitable * >;
+	// The container of all the hitable objects in the scene, it is still a vector so that the objects
+	// can be added and visited just like before, but it also holds a scene-wide BVH upon them.
+	// All the tracers find the closest hit via ClosestHit, the objects without a bounding-box
+	// (like the infinite planes) are tested one by one outside of the BVH.
+	// It is a two-level structure with the instances: the scene BVH is built upon the world bounds
+	// of the instances, and the acceleration structure of a proxy object (mesh's BVH or grid...)
+	// shared by many instances is built only once per BuildupAccelerationStructure, the ray is transformed
+	// into the object space only when a scene BVH leaf is entered.
+	class SceneObjects : public vector<Hitable * >, public IGeometricAcceleration
+	{
+	public:
+		SceneObjects();
+		virtual ~SceneObjects();
+
+	public:
+		// From IGeometricAcceleration
+		virtual void BuildupAccelerationStructure();
+
+	public:
+		bool ClosestHit(Ray const& ray, HitRecord& rec) const;
+		// The closest hits of all the rays of a packet, the same as calling ClosestHit for each of them,
+		// but the rays walk down the scene BVH together.
+		void ClosestHitPacket(RayPacket& packet) const;
+		// The occlusion query of the shadow rays: true as soon as any object is hit closer than tmax,
+		// there is no closest-hit ordering and no hit record.
+		bool Occluded(Ray const& ray, float tmax) const;
+
+		void ReleaseAccelerationStructure();
+
+	public:
+		// Turn off the BVH to fall back to the linear loop upon all the objects, for validation.
+		inline void EnableAcceleration(bool enable) { mbEnableAcceleration = enable; }
+		inline bool IsAccelerationEnabled() const { return mbEnableAcceleration; }
+
+		inline void SetBVHBuildMode(EBVHBuildMode mode, int threadCount = 0) { mBVH.SetBuildMode(mode, threadCount); }
+		// The moving objects are bounded per ray time (see BVHTree::SetMotionBounds) instead of by the boxes
+		// swept over their whole motion, it takes effect at the next build.
+		inline void EnableMotionBounds(bool enable) { mbEnableMotionBounds = enable; }
+		inline const BVHTree& GetBVH() const { return mBVH; }
+		inline int BottomLevelCount() const { return (int)msetBottomLevels.size(); }
+
+	public:
+		inline static float KEpsilon() { return 0.0001f; }
+
+	private:
+		void build_bottom_levels();
+		void release_top_level();
+
+	private:
+		bool closest_hit_linear(Ray const& ray, HitRecord& rec) const;
+		bool closest_hit_bvh(Ray const& ray, HitRecord& rec) const;
+		void closest_hit_packet_bvh(RayPacket& packet) const;
+		bool occluded_linear(Ray const& ray, float tmax) const;
+		bool occluded_bvh(Ray const& ray, float tmax) const;
+
+	private:
+		BVHTree				mBVH;
+		vector<Hitable * >	mvecBVHObjects; // in the order of the BVH leaves
+		vector<Hitable * >	mvecUnboundedObjects;
+		std::set<GeometricObject * > msetBottomLevels; // the built proxies of the instances, just the references.
+		bool				mbAccelerationBuilt;
+		bool				mbEnableAcceleration;
+		bool				mbEnableMotionBounds;
+
+	};
 }